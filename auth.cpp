@@ -0,0 +1,300 @@
+#include "auth.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+static const char HASH_PREFIX[] = "pbkdf2-sha256$";
+static const size_t SALT_BYTES = 16;
+static const size_t KEY_BYTES = 32;
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static const uint32_t INITIAL_STATE[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                          0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+static inline uint32_t rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+static void compress(uint32_t state[8], const uint8_t block[64]) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t(block[4 * i]) << 24) | (uint32_t(block[4 * i + 1]) << 16) |
+               (uint32_t(block[4 * i + 2]) << 8) | uint32_t(block[4 * i + 3]);
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+        uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+static void store_state(const uint32_t state[8], uint8_t out[32]) {
+    for (int i = 0; i < 8; i++) {
+        out[4 * i] = static_cast<uint8_t>(state[i] >> 24);
+        out[4 * i + 1] = static_cast<uint8_t>(state[i] >> 16);
+        out[4 * i + 2] = static_cast<uint8_t>(state[i] >> 8);
+        out[4 * i + 3] = static_cast<uint8_t>(state[i]);
+    }
+}
+
+// SHA-256 of the bytes already absorbed into state (prefix_len of them, a
+// multiple of 64) followed by data.
+static void sha256_finish(const uint32_t prefix[8], uint64_t prefix_len, const uint8_t* data, size_t size,
+                          uint8_t out[32]) {
+    uint32_t state[8];
+    std::memcpy(state, prefix, sizeof(state));
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        compress(state, data + i);
+    }
+
+    uint8_t block[128] = {};
+    size_t rest = size - i;
+    std::memcpy(block, data + i, rest);
+    block[rest] = 0x80;
+    size_t blocks = rest + 9 <= 64 ? 1 : 2;
+    uint64_t bits = (prefix_len + size) * 8;
+    for (int b = 0; b < 8; b++) {
+        block[blocks * 64 - 1 - b] = static_cast<uint8_t>(bits >> (8 * b));
+    }
+    for (size_t b = 0; b < blocks; b++) {
+        compress(state, block + 64 * b);
+    }
+    store_state(state, out);
+}
+
+static void sha256(const uint8_t* data, size_t size, uint8_t out[32]) {
+    sha256_finish(INITIAL_STATE, 0, data, size, out);
+}
+
+// HMAC-SHA256 with the key's inner and outer pad blocks absorbed once, so
+// each PBKDF2 iteration costs two compressions.
+struct HmacKey {
+    uint32_t inner[8];
+    uint32_t outer[8];
+
+    explicit HmacKey(const std::string& key) {
+        uint8_t block[64] = {};
+        if (key.size() > 64) {
+            sha256(reinterpret_cast<const uint8_t*>(key.data()), key.size(), block);
+        } else {
+            std::memcpy(block, key.data(), key.size());
+        }
+        uint8_t pad[64];
+        std::memcpy(inner, INITIAL_STATE, sizeof(inner));
+        std::memcpy(outer, INITIAL_STATE, sizeof(outer));
+        for (int i = 0; i < 64; i++) pad[i] = block[i] ^ 0x36;
+        compress(inner, pad);
+        for (int i = 0; i < 64; i++) pad[i] = block[i] ^ 0x5c;
+        compress(outer, pad);
+    }
+
+    void mac(const uint8_t* data, size_t size, uint8_t out[32]) const {
+        uint8_t digest[32];
+        sha256_finish(inner, 64, data, size, digest);
+        sha256_finish(outer, 64, digest, sizeof(digest), out);
+    }
+};
+
+// PBKDF2-HMAC-SHA256 with a single output block, which is all KEY_BYTES
+// needs.
+static void pbkdf2(const std::string& password, const uint8_t* salt, size_t salt_size, uint32_t iterations,
+                   uint8_t out[KEY_BYTES]) {
+    HmacKey key(password);
+    std::string first(reinterpret_cast<const char*>(salt), salt_size);
+    first.append("\0\0\0\1", 4);
+
+    uint8_t u[32];
+    key.mac(reinterpret_cast<const uint8_t*>(first.data()), first.size(), u);
+    std::memcpy(out, u, KEY_BYTES);
+    for (uint32_t i = 1; i < iterations; i++) {
+        key.mac(u, sizeof(u), u);
+        for (size_t j = 0; j < KEY_BYTES; j++) {
+            out[j] ^= u[j];
+        }
+    }
+}
+
+static void random_bytes(uint8_t* out, size_t size) {
+    static std::mutex mutex;
+    static std::random_device device;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < size; i += 4) {
+        uint32_t word = device();
+        for (size_t j = 0; j < 4 && i + j < size; j++) {
+            out[i + j] = static_cast<uint8_t>(word >> (8 * j));
+        }
+    }
+}
+
+static std::string to_hex(const uint8_t* data, size_t size) {
+    static const char DIGITS[] = "0123456789abcdef";
+    std::string hex(size * 2, '0');
+    for (size_t i = 0; i < size; i++) {
+        hex[2 * i] = DIGITS[data[i] >> 4];
+        hex[2 * i + 1] = DIGITS[data[i] & 15];
+    }
+    return hex;
+}
+
+static bool from_hex(const std::string& hex, uint8_t* out, size_t size) {
+    if (hex.size() != size * 2) return false;
+    for (size_t i = 0; i < hex.size(); i++) {
+        char c = hex[i];
+        int v = (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+        if (v < 0) return false;
+        out[i / 2] = static_cast<uint8_t>(i % 2 == 0 ? v << 4 : out[i / 2] | v);
+    }
+    return true;
+}
+
+// Time depends only on the lengths, never on where the inputs differ.
+static bool equal_constant_time(const uint8_t* a, const uint8_t* b, size_t size) {
+    uint8_t diff = 0;
+    for (size_t i = 0; i < size; i++) {
+        diff |= a[i] ^ b[i];
+    }
+    return diff == 0;
+}
+
+static std::string token_key(const std::string& token) {
+    uint8_t digest[32];
+    sha256(reinterpret_cast<const uint8_t*>(token.data()), token.size(), digest);
+    return std::string(reinterpret_cast<const char*>(digest), sizeof(digest));
+}
+
+std::string hash_password(const std::string& password, uint32_t iterations) {
+    uint8_t salt[SALT_BYTES];
+    uint8_t key[KEY_BYTES];
+    random_bytes(salt, sizeof(salt));
+    pbkdf2(password, salt, sizeof(salt), iterations, key);
+    return HASH_PREFIX + std::to_string(iterations) + "$" + to_hex(salt, sizeof(salt)) + "$" +
+           to_hex(key, sizeof(key));
+}
+
+bool is_password_hash(const std::string& stored) {
+    return stored.compare(0, std::strlen(HASH_PREFIX), HASH_PREFIX) == 0;
+}
+
+bool check_password(const std::string& password, const std::string& stored) {
+    if (!is_password_hash(stored)) {
+        return password.size() == stored.size() &&
+               equal_constant_time(reinterpret_cast<const uint8_t*>(password.data()),
+                                   reinterpret_cast<const uint8_t*>(stored.data()), stored.size());
+    }
+
+    size_t start = std::strlen(HASH_PREFIX);
+    size_t salt_at = stored.find('$', start);
+    size_t key_at = salt_at == std::string::npos ? salt_at : stored.find('$', salt_at + 1);
+    if (key_at == std::string::npos) {
+        return false;
+    }
+    uint32_t iterations = static_cast<uint32_t>(std::strtoul(stored.c_str() + start, nullptr, 10));
+    uint8_t salt[SALT_BYTES];
+    uint8_t expected[KEY_BYTES];
+    if (iterations == 0 || !from_hex(stored.substr(salt_at + 1, key_at - salt_at - 1), salt, sizeof(salt)) ||
+        !from_hex(stored.substr(key_at + 1), expected, sizeof(expected))) {
+        return false;
+    }
+
+    uint8_t key[KEY_BYTES];
+    pbkdf2(password, salt, sizeof(salt), iterations, key);
+    return equal_constant_time(key, expected, sizeof(key));
+}
+
+LoginLimiter::LoginLimiter(double capacity, double per_second) : capacity(capacity), per_second(per_second) {}
+
+bool LoginLimiter::try_acquire(const std::string& user) {
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = buckets.find(user);
+    if (it == buckets.end()) {
+        it = buckets.emplace(user, Bucket{capacity, now}).first;
+    }
+
+    Bucket& b = it->second;
+    double elapsed = std::chrono::duration<double>(now - b.updated).count();
+    b.tokens = std::min(capacity, b.tokens + elapsed * per_second);
+    b.updated = now;
+    if (b.tokens < 1) {
+        return false;
+    }
+    b.tokens -= 1;
+    return true;
+}
+
+SessionCache::SessionCache(size_t capacity, std::chrono::seconds ttl) : capacity(capacity), ttl(ttl) {}
+
+std::string SessionCache::issue(const std::string& username) {
+    uint8_t bytes[16];
+    random_bytes(bytes, sizeof(bytes));
+    std::string token = to_hex(bytes, sizeof(bytes));
+    std::string key = token_key(token);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    sessions.push_front({key, username, std::chrono::steady_clock::now() + ttl});
+    by_key[key] = sessions.begin();
+    while (sessions.size() > capacity) {
+        by_key.erase(sessions.back().key);
+        sessions.pop_back();
+    }
+    return token;
+}
+
+bool SessionCache::lookup(const std::string& token, std::string& username) {
+    std::string key = token_key(token);
+    auto now = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = by_key.find(key);
+    if (it == by_key.end()) {
+        return false;
+    }
+    if (it->second->expires <= now) {
+        sessions.erase(it->second);
+        by_key.erase(it);
+        return false;
+    }
+    it->second->expires = now + ttl;
+    sessions.splice(sessions.begin(), sessions, it->second);
+    username = it->second->username;
+    return true;
+}
+
+size_t SessionCache::size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return sessions.size();
+}
@@ -0,0 +1,73 @@
+#ifndef AUTH_H
+#define AUTH_H
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Admin passwords are stored as
+//
+//   pbkdf2-sha256$<iterations>$<salt hex>$<key hex>
+//
+// PBKDF2-HMAC-SHA256 over a random 16-byte salt, with a 32-byte key. The
+// iteration count is the cost; it is kept in each hash, so raising it
+// applies to passwords hashed from then on and old hashes still verify.
+const uint32_t PASSWORD_ITERATIONS = 100000;
+
+std::string hash_password(const std::string& password, uint32_t iterations = PASSWORD_ITERATIONS);
+bool is_password_hash(const std::string& stored);
+// Compares the derived key in constant time. A stored value that is not
+// a hash is taken as a plaintext password from an older students.db.
+bool check_password(const std::string& password, const std::string& stored);
+
+// Token bucket per user: each login attempt takes a token, and tokens come
+// back at a fixed rate up to a burst of `capacity`. Once a user's bucket
+// is empty, attempts are refused before any hashing is done. Callers
+// should map unknown usernames to one shared key so the table stays small.
+class LoginLimiter {
+private:
+    struct Bucket {
+        double tokens;
+        std::chrono::steady_clock::time_point updated;
+    };
+
+    std::mutex mutex;
+    std::unordered_map<std::string, Bucket> buckets;
+    double capacity;
+    double per_second;
+
+public:
+    LoginLimiter(double capacity = 5, double per_second = 0.5);
+    bool try_acquire(const std::string& user);
+};
+
+// Session tokens issued after a successful login, so later requests can
+// authenticate without paying for the password hash again. Holds at most
+// `capacity` sessions, dropping the least recently used; a session also
+// expires `ttl` after it was last used. Tokens are 128 random bits and are
+// kept only as their SHA-256.
+class SessionCache {
+private:
+    struct Session {
+        std::string key;
+        std::string username;
+        std::chrono::steady_clock::time_point expires;
+    };
+
+    std::mutex mutex;
+    std::list<Session> sessions; // most recently used first
+    std::unordered_map<std::string, std::list<Session>::iterator> by_key;
+    size_t capacity;
+    std::chrono::seconds ttl;
+
+public:
+    SessionCache(size_t capacity = 1024, std::chrono::seconds ttl = std::chrono::minutes(30));
+    std::string issue(const std::string& username);
+    bool lookup(const std::string& token, std::string& username);
+    size_t size();
+};
+
+#endif // AUTH_H
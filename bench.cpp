@@ -0,0 +1,1611 @@
+// Microbenchmarks for Database operations over a synthetic roster.
+//
+//   student_bench [--rows=100000] [--ops=10000] [--search-ops=1000]
+//                 [--reps=5] [--seed=42] [--db=bench.db] [--json=-]
+//                 [--csv=path] [--shards=N] [--threads=32] [--lag-ops=N]
+//                 [--procs=N] [--readers=N] [--writers=N] [--crash-rounds=N]
+//                 [--fold-ops=N] [--reg-races=N] [--sweep=N,N,...]
+//
+// Generates `rows` students with skewed name, major and age distributions
+// (a few majors and names are far more common than the rest, as in a real
+// roster), then times init/load, get, search, ranked search, a query on
+// major and age through the indexes and as a full scan, every student in
+// a major, paged and sorted listing, add, update, delete and save. The
+// JSON config records the table's bytes per row and the process RSS. A replayed trace of repeated searches with some
+// updates mixed in is timed with the search cache off and on. Add, update
+// and delete are timed again with the log written asynchronously, along
+// with an update followed by a flush() that waits for it to be on disk,
+// and then updates and deletes of random rows, which mostly time the
+// index maintenance.
+// The roster is also saved and loaded in the text, binary and compressed
+// formats, with the size of each file.
+// Runs are repeatable for a given seed. Results are written as JSON (to
+// stdout by default) with ops/sec and latency percentiles per operation.
+// --csv also writes the generated dataset in the import format.
+// --shards also loads the roster into a ShardedDatabase of that many shards
+// and times search with pools of 1, 2, 4, ... up to --threads threads.
+// --lag-ops has a follower tail a leader's change feed while the leader
+// makes that many updates, and reports how long each took to reach it.
+// --procs has 1, 2, 4, ... up to that many processes share one database
+// and race to update the same few rows, each update checked against the
+// version it read (POSIX only).
+// --readers and --writers run that many threads against one database at
+// once: readers look up, search, query and scan while writers add, update
+// and delete, and every row is checked for torn or lost writes. Build with
+// -fsanitize=thread to have data races reported as well.
+// --crash-rounds checks that commits survive crashes: a transaction's log
+// is replayed cut off at every byte, then a child process committing
+// transactions is killed with SIGKILL that many times, and each recovery
+// must find every transaction whole (POSIX only).
+// --fold-ops checks every case-insensitive search kernel against a plain
+// fold-and-find on random texts, failing on any difference, then times
+// each, and the old fold-and-find, that many times per query length and
+// field size.
+// --reg-races has 8 threads race to give the same reg_nos to rows of a
+// ShardedDatabase, by add and by update, failing if any reg_no is won more
+// than once or ends up on more than one row.
+// --sweep repeats batch and single inserts, id lookups and reg_no
+// uniqueness checks, along with the linear scan they replace, startup in
+// each format, eager and lazy, and listing the roster to a file and to a
+// pseudo-terminal, on rosters of each of the given sizes.
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "database.h"
+#include "fold_search.h"
+#include "metrics.h"
+#include "replica.h"
+#include "sharded_database.h"
+#include "student_pager.h"
+#include "thread_pool.h"
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <signal.h>
+    #include <sys/wait.h>
+    #include <unistd.h>
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    int rows = 100000;
+    int ops = 10000;
+    int search_ops = 1000;
+    int reps = 5;
+    unsigned seed = 42;
+    std::string db = "bench.db";
+    std::string json = "-";
+    std::string csv;
+    int shards = 0;
+    int threads = 32;
+    int lag_ops = 0;
+    int procs = 0;
+    int readers = 0;
+    int writers = 0;
+    int crash_rounds = 0;
+    int fold_ops = 0;
+    int reg_races = 0;
+    std::vector<int> sweep; // roster sizes
+};
+
+// Memory taken by the benchmark database once the roster is loaded.
+struct Footprint {
+    uint64_t table_bytes = 0; // Database::memory_usage()
+    uint64_t rss_before = 0;  // process RSS before opening it...
+    uint64_t rss_after = 0;   // ...and after loading the roster, indexes included
+};
+
+struct Result {
+    std::string name;
+    std::vector<double> latencies_us;
+    double seconds = 0;
+    uint64_t file_bytes = 0; // size of the file written, for save and load
+    uint64_t stale = 0;      // attempts refused as stale, for shared updates
+};
+
+static const char* FIRST_NAMES[] = {
+    "Aarav", "Priya", "Rahul", "Sneha", "Vikram", "Anjali", "Rohit", "Kavya", "Arjun", "Meera",
+    "Aditya", "Ishita", "Karan", "Divya", "Nikhil", "Pooja", "Siddharth", "Neha", "Varun", "Ritika",
+    "Amit", "Shreya", "Manish", "Tanvi", "Harsh", "Nandini", "Yash", "Aisha", "Kunal", "Simran",
+    "James", "Maria", "Chen", "Fatima", "Lucas", "Sofia", "Omar", "Yuki", "Elena", "Kwame"};
+
+static const char* LAST_NAMES[] = {
+    "Sharma", "Patel", "Reddy", "Kumar", "Singh", "Gupta", "Iyer", "Nair", "Rao", "Das",
+    "Mehta", "Joshi", "Verma", "Chopra", "Bose", "Menon", "Pillai", "Agarwal", "Bhat", "Kapoor",
+    "Smith", "Garcia", "Wang", "Khan", "Silva", "Rossi", "Haddad", "Tanaka", "Petrova", "Mensah"};
+
+static const char* MAJORS[] = {
+    "Computer Science", "Electronics", "Mechanical", "Electrical", "Civil", "Information Technology",
+    "Mathematics", "Physics", "Chemistry", "Biotechnology", "Chemical", "Aerospace",
+    "Economics", "Commerce", "Business Administration", "Psychology", "English", "History",
+    "Architecture", "Law", "Medicine", "Pharmacy", "Statistics", "Data Science",
+    "Artificial Intelligence", "Robotics", "Materials Science", "Environmental Science",
+    "Agriculture", "Fine Arts"};
+
+template <size_t N>
+static std::discrete_distribution<size_t> zipf(const char* const (&)[N], double exponent) {
+    std::vector<double> weights(N);
+    for (size_t k = 0; k < N; k++) {
+        weights[k] = 1.0 / std::pow(static_cast<double>(k + 1), exponent);
+    }
+    return std::discrete_distribution<size_t>(weights.begin(), weights.end());
+}
+
+// Draws students with Zipf-distributed first names, last names and majors
+// and ages clustered around 19-21.
+class RosterGenerator {
+private:
+    std::mt19937_64 rng;
+    std::discrete_distribution<size_t> first, last, major;
+    std::discrete_distribution<int> age;
+    long serial;
+
+public:
+    explicit RosterGenerator(unsigned seed)
+        : rng(seed), first(zipf(FIRST_NAMES, 1.0)), last(zipf(LAST_NAMES, 0.9)), major(zipf(MAJORS, 1.2)),
+          age({2, 10, 18, 20, 17, 12, 8, 5, 3, 2, 1, 1, 1}), serial(0) {}
+
+    Student next() {
+        Student s;
+        s.id = 0;
+        s.name = std::string(FIRST_NAMES[first(rng)]) + " " + LAST_NAMES[last(rng)];
+        s.reg_no = "RA" + std::to_string(2015 + serial % 10) + std::to_string(1000000 + serial);
+        s.age = 17 + age(rng);
+        s.major = MAJORS[major(rng)];
+        serial++;
+        return s;
+    }
+
+    // Search terms in the proportions users type them: mostly name
+    // fragments, then majors, then reg_no prefixes, with a few misses.
+    std::string query() {
+        switch (rng() % 10) {
+            case 0: case 1: case 2: case 3: {
+                std::string name = FIRST_NAMES[first(rng)];
+                return name.substr(0, 3 + rng() % (name.size() - 2));
+            }
+            case 4: case 5:
+                return LAST_NAMES[last(rng)];
+            case 6: case 7:
+                return MAJORS[major(rng)];
+            case 8: {
+                long n = serial > 0 ? static_cast<long>(rng() % serial) : 0;
+                std::string reg = "RA" + std::to_string(2015 + n % 10) + std::to_string(1000000 + n);
+                return reg.substr(0, 8 + rng() % 5);
+            }
+            default:
+                return "zq" + std::to_string(rng() % 1000);
+        }
+    }
+
+    std::mt19937_64& engine() { return rng; }
+};
+
+static bool parse_options(int argc, char* argv[], Options& opt) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) return false;
+        std::string key = arg.substr(2, eq - 2);
+        std::string value = arg.substr(eq + 1);
+        if (key == "rows") opt.rows = std::atoi(value.c_str());
+        else if (key == "ops") opt.ops = std::atoi(value.c_str());
+        else if (key == "search-ops") opt.search_ops = std::atoi(value.c_str());
+        else if (key == "reps") opt.reps = std::atoi(value.c_str());
+        else if (key == "seed") opt.seed = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+        else if (key == "db") opt.db = value;
+        else if (key == "json") opt.json = value;
+        else if (key == "csv") opt.csv = value;
+        else if (key == "shards") opt.shards = std::atoi(value.c_str());
+        else if (key == "threads") opt.threads = std::atoi(value.c_str());
+        else if (key == "lag-ops") opt.lag_ops = std::atoi(value.c_str());
+        else if (key == "procs") opt.procs = std::atoi(value.c_str());
+        else if (key == "readers") opt.readers = std::atoi(value.c_str());
+        else if (key == "writers") opt.writers = std::atoi(value.c_str());
+        else if (key == "crash-rounds") opt.crash_rounds = std::atoi(value.c_str());
+        else if (key == "fold-ops") opt.fold_ops = std::atoi(value.c_str());
+        else if (key == "reg-races") opt.reg_races = std::atoi(value.c_str());
+        else if (key == "sweep") {
+            size_t start = 0;
+            while (start <= value.size()) {
+                size_t comma = std::min(value.find(',', start), value.size());
+                int size = std::atoi(value.substr(start, comma - start).c_str());
+                if (size <= 0) return false;
+                opt.sweep.push_back(size);
+                start = comma + 1;
+            }
+        }
+        else return false;
+    }
+    return opt.rows > 0 && opt.ops > 0 && opt.search_ops > 0 && opt.reps > 0 && !opt.db.empty() &&
+           opt.shards >= 0 && opt.threads > 0 && opt.lag_ops >= 0 && opt.procs >= 0 && opt.readers >= 0 &&
+           opt.writers >= 0 && opt.crash_rounds >= 0 && opt.fold_ops >= 0 && opt.reg_races >= 0;
+}
+
+static void remove_database(const std::string& path) {
+    std::remove(path.c_str());
+    std::remove((path + ".wal").c_str());
+    std::remove((path + ".changes").c_str());
+    std::remove((path + ".lock").c_str());
+}
+
+// Starts the database off in the text format with an admin already in
+// place, so init() has nothing to announce on stdout.
+static void seed_database(const std::string& path) {
+    remove_database(path);
+    std::ofstream file(path);
+    file << "[ADMINS]\nbench:bench\n\n[STUDENTS]\n";
+}
+
+// Times op(i) for i in [0, count), one sample per call.
+template <typename Op>
+static Result measure(const std::string& name, int count, Op op) {
+    Result result;
+    result.name = name;
+    result.latencies_us.reserve(count);
+    auto start = Clock::now();
+    for (int i = 0; i < count; i++) {
+        auto before = Clock::now();
+        op(i);
+        result.latencies_us.push_back(std::chrono::duration<double, std::micro>(Clock::now() - before).count());
+    }
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return result;
+}
+
+static void write_json(std::ostream& out, const Options& opt, const Footprint& footprint,
+                       const std::vector<Result>& results) {
+    out << "{\n  \"config\": {\"rows\": " << opt.rows << ", \"ops\": " << opt.ops
+        << ", \"search_ops\": " << opt.search_ops << ", \"reps\": " << opt.reps << ", \"seed\": " << opt.seed
+        << ", \"shards\": " << opt.shards << ", \"hardware_threads\": " << std::thread::hardware_concurrency()
+        << ", \"search_kernel\": \"" << fold_search_kernel() << "\", \"table_bytes\": " << footprint.table_bytes
+        << ", \"table_bytes_per_row\": " << footprint.table_bytes / opt.rows
+        << ", \"rss_bytes\": " << footprint.rss_after << ", \"rss_bytes_per_row\": "
+        << (footprint.rss_after > footprint.rss_before ? (footprint.rss_after - footprint.rss_before) / opt.rows : 0)
+        << "},\n  \"benchmarks\": [";
+
+    for (size_t r = 0; r < results.size(); r++) {
+        std::vector<double> sorted = results[r].latencies_us;
+        std::sort(sorted.begin(), sorted.end());
+        double sum = 0;
+        for (double v : sorted) sum += v;
+        auto percentile = [&](double p) {
+            return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+        };
+
+        char extra[96] = "";
+        if (results[r].file_bytes > 0) {
+            std::snprintf(extra, sizeof(extra), ", \"file_bytes\": %llu",
+                          static_cast<unsigned long long>(results[r].file_bytes));
+        } else if (results[r].stale > 0) {
+            std::snprintf(extra, sizeof(extra), ", \"stale_attempts\": %llu",
+                          static_cast<unsigned long long>(results[r].stale));
+        }
+        char line[560];
+        std::snprintf(line, sizeof(line),
+                      "%s\n    {\"name\": \"%s\", \"ops\": %zu, \"seconds\": %.6f, \"ops_per_sec\": %.1f, "
+                      "\"latency_us\": {\"mean\": %.2f, \"p50\": %.2f, \"p90\": %.2f, \"p99\": %.2f, "
+                      "\"p999\": %.2f, \"max\": %.2f}%s}",
+                      r == 0 ? "" : ",", results[r].name.c_str(), sorted.size(), results[r].seconds,
+                      sorted.size() / results[r].seconds, sum / sorted.size(), percentile(0.50),
+                      percentile(0.90), percentile(0.99), percentile(0.999), sorted.back(), extra);
+        out << line;
+    }
+    out << "\n  ]\n}\n";
+}
+
+static uint64_t size_of(const std::string& path) {
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(path, ec);
+    return ec ? 0 : size;
+}
+
+// Times init() of file, reps times, lazily with a cache of lazy_bytes if
+// that is not 0. Each run opens a fresh copy at scratch, since closing a
+// database checkpoints it in a format of its own.
+static bool measure_load(const std::string& name, const std::string& file, const std::string& scratch,
+                         size_t lazy_bytes, int reps, std::vector<Result>& results) {
+    Result result;
+    result.name = name;
+    result.file_bytes = size_of(file);
+    for (int rep = 0; rep < reps; rep++) {
+        remove_database(scratch);
+        std::filesystem::copy_file(file, scratch);
+        auto before = Clock::now();
+        auto db = std::make_unique<Database>(scratch);
+        if (lazy_bytes > 0) db->set_lazy(lazy_bytes);
+        bool ok = db->init();
+        double us = std::chrono::duration<double, std::micro>(Clock::now() - before).count();
+        if (!ok) return false;
+        result.latencies_us.push_back(us);
+        result.seconds += us * 1e-6;
+    }
+    results.push_back(result);
+    remove_database(scratch);
+    return true;
+}
+
+// Saves the roster in each format and times loading it back.
+static bool run_formats(const Options& opt, std::vector<Result>& results) {
+    std::string text = opt.db + ".txt";
+    std::string packed = opt.db + ".packed";
+    std::string scratch = opt.db + ".load";
+    {
+        Database db(opt.db);
+        if (!db.init()) return false;
+        results.push_back(measure("save_text", opt.reps, [&](int) {
+            db.export_text(text);
+        }));
+        results.back().file_bytes = size_of(text);
+        results.push_back(measure("save_binary", opt.reps, [&](int) {
+            db.save();
+        }));
+        results.back().file_bytes = size_of(opt.db);
+    }
+    std::filesystem::copy_file(opt.db, packed, std::filesystem::copy_options::overwrite_existing);
+    {
+        Database db(packed);
+        db.set_compressed(true);
+        if (!db.init()) return false;
+        results.push_back(measure("save_compressed", opt.reps, [&](int) {
+            db.save();
+        }));
+        results.back().file_bytes = size_of(packed);
+    }
+
+    const std::pair<const char*, std::string> formats[] = {
+        {"load_text", text}, {"load_binary", opt.db}, {"load_compressed", packed}};
+    for (const auto& format : formats) {
+        if (!measure_load(format.first, format.second, scratch, 0, opt.reps, results)) return false;
+    }
+    remove_database(text);
+    remove_database(packed);
+    return true;
+}
+
+// Runs every benchmark after init against one open database.
+static bool run_operations(const Options& opt, RosterGenerator& gen, const std::vector<Student>& roster,
+                           std::vector<Result>& results) {
+    Database db(opt.db);
+    if (!db.init()) {
+        return false;
+    }
+    auto& rng = gen.engine();
+    int rows = opt.rows;
+
+    results.push_back(measure("get_student", opt.ops, [&](int) {
+        db.get_student(1 + static_cast<int>(rng() % rows));
+    }));
+
+    std::vector<std::string> queries;
+    for (int i = 0; i < opt.search_ops; i++) {
+        queries.push_back(gen.query());
+    }
+    // Distinct random queries measure the search itself, so the cache is
+    // kept out of it.
+    db.set_search_cache(0);
+    results.push_back(measure("search_students", opt.search_ops, [&](int i) {
+        db.search_students(queries[i]);
+    }));
+
+    // A front desk replaying a few dozen favourite queries, most often the
+    // first ones, with one update to a random row every 20 searches.
+    std::vector<std::string> favourites(queries.begin(), queries.begin() + std::min(opt.search_ops, 40));
+    std::vector<double> weights(favourites.size());
+    for (size_t k = 0; k < weights.size(); k++) weights[k] = 1.0 / (k + 1);
+    std::discrete_distribution<size_t> pick(weights.begin(), weights.end());
+    std::vector<std::string> trace;
+    std::vector<Student> edits;
+    for (int i = 0; i < opt.search_ops * 5; i++) {
+        trace.push_back(favourites[pick(rng)]);
+        edits.push_back(gen.next());
+        edits.back().id = 1 + static_cast<int>(rng() % rows);
+    }
+    for (size_t cache : {size_t(0), size_t(256)}) {
+        db.set_search_cache(cache);
+        results.push_back(measure(cache ? "search_trace_cached" : "search_trace_uncached",
+                                  static_cast<int>(trace.size()), [&](int i) {
+            if (i % 20 == 19) {
+                const Student& e = edits[i];
+                db.update_student(e.id, e.name, roster[e.id - 1].reg_no, e.age, e.major);
+            }
+            db.search_students(trace[i]);
+        }));
+    }
+
+    // Ranked search on the same queries with one letter changed. The first
+    // call builds the word index and is timed on its own.
+    std::vector<std::string> typos = queries;
+    for (auto& q : typos) {
+        if (q.size() >= 4) q[1 + rng() % (q.size() - 2)] = static_cast<char>('a' + rng() % 26);
+    }
+    results.push_back(measure("search_ranked_first", 1, [&](int) {
+        db.search_ranked(typos[0], 10);
+    }));
+    results.push_back(measure("search_ranked", opt.search_ops, [&](int i) {
+        db.search_ranked(typos[i], 10);
+    }));
+
+    // A major and a three-year age band, taken from random rows so popular
+    // majors come up as often as they do in the roster: once through the
+    // planner's indexes and once as the full scan they replace.
+    std::vector<StudentQuery> filters(opt.search_ops);
+    for (auto& filter : filters) {
+        const Student& s = roster[rng() % rows];
+        filter.major = s.major;
+        filter.min_age = s.age - 1;
+        filter.max_age = s.age + 1;
+    }
+    size_t matched = 0;
+    results.push_back(measure("query_indexed", opt.search_ops, [&](int i) {
+        StudentCursor cursor = db.query(filters[i]);
+        Student s;
+        while (cursor.next(s)) matched++;
+    }));
+    results.push_back(measure("query_scan", opt.search_ops, [&](int i) {
+        const StudentQuery& filter = filters[i];
+        db.for_each_student([&](const Student& s) {
+            if (s.major == *filter.major && s.age >= *filter.min_age && s.age <= *filter.max_age) matched++;
+        });
+    }));
+
+    // Every student in one major, picked as above: through the major
+    // column's dictionary codes, and as a visitor comparing strings.
+    results.push_back(measure("scan_major", opt.search_ops, [&](int i) {
+        db.for_each_student_in_major(*filters[i].major, [&](const Student&) { matched++; });
+    }));
+    results.push_back(measure("scan_major_visitor", opt.search_ops, [&](int i) {
+        const std::string& major = *filters[i].major;
+        db.for_each_student([&](const Student& s) {
+            if (s.major == major) matched++;
+        });
+    }));
+
+    // Listing a page of 50 at a time: walking the roster by id with
+    // students_after(), and jumping to random pages of it sorted by age,
+    // oldest first.
+    int after = 0;
+    results.push_back(measure("list_page", opt.search_ops, [&](int) {
+        std::vector<Student> page = db.students_after(after, 50);
+        after = page.size() < 50 ? 0 : page.back().id;
+    }));
+    StudentQuery sorted;
+    sorted.order = StudentQuery::Order::Age;
+    sorted.descending = true;
+    sorted.limit = 50;
+    results.push_back(measure("list_sorted_page", opt.search_ops, [&](int) {
+        sorted.offset = 50 * (rng() % (rows / 50 + 1));
+        StudentCursor cursor = db.query(sorted);
+        Student s;
+        while (cursor.next(s)) matched++;
+    }));
+    if (matched == 0) {
+        std::cerr << "Queries matched no rows" << std::endl;
+        return false;
+    }
+
+    std::vector<Student> extra;
+    for (int i = 0; i < opt.ops; i++) {
+        extra.push_back(gen.next());
+    }
+    results.push_back(measure("add_student", opt.ops, [&](int i) {
+        db.add_student(extra[i].name, extra[i].reg_no, extra[i].age, extra[i].major);
+    }));
+
+    results.push_back(measure("update_student", opt.ops, [&](int i) {
+        int id = 1 + static_cast<int>(rng() % rows);
+        const Student& s = extra[i];
+        db.update_student(id, s.name, roster[id - 1].reg_no, s.age, s.major);
+    }));
+
+    // Distinct ids, so every delete removes a row.
+    std::vector<int> victims(rows);
+    for (int i = 0; i < rows; i++) victims[i] = i + 1;
+    std::shuffle(victims.begin(), victims.end(), rng);
+    int deletes = std::min(opt.ops, rows);
+    results.push_back(measure("delete_student", deletes, [&](int i) {
+        db.delete_student(victims[i]);
+    }));
+
+    results.push_back(measure("save", opt.reps, [&](int) {
+        db.save();
+    }));
+    return true;
+}
+
+// The same writes on a reopened database with the log written in the
+// background, on rows of their own so that every one succeeds. Then, with
+// the log out of the way, updates and deletes of random roster rows, which
+// move ids in the middle of long index postings (common trigrams, popular
+// majors and ages) rather than at their ends.
+static bool run_async(const Options& opt, RosterGenerator& gen, const std::vector<Student>& roster,
+                      std::vector<Result>& results) {
+    Database db(opt.db);
+    db.set_async_log(std::chrono::milliseconds(10), 1024);
+    if (!db.init()) {
+        return false;
+    }
+    std::vector<Student> extra;
+    for (int i = 0; i < opt.ops; i++) {
+        extra.push_back(gen.next());
+    }
+    std::vector<int> ids(opt.ops);
+    results.push_back(measure("add_student_async", opt.ops, [&](int i) {
+        ids[i] = db.add_student(extra[i].name, extra[i].reg_no, extra[i].age, extra[i].major);
+    }));
+    results.push_back(measure("update_student_async", opt.ops, [&](int i) {
+        const Student& s = extra[opt.ops - 1 - i];
+        db.update_student(ids[i], s.name, extra[i].reg_no, s.age, s.major);
+    }));
+    int flushes = std::max(opt.ops / 10, 1);
+    results.push_back(measure("update_flush_async", flushes, [&](int i) {
+        const Student& s = extra[i];
+        db.update_student(ids[i], s.name, s.reg_no, s.age, s.major);
+        db.flush();
+    }));
+    results.push_back(measure("delete_student_async", opt.ops, [&](int i) {
+        db.delete_student(ids[i]);
+    }));
+
+    // Earlier runs deleted some of the roster; only rows still there count.
+    std::vector<int> live;
+    for (int id = 1; id <= static_cast<int>(roster.size()); id++) {
+        if (db.get_student(id)) live.push_back(id);
+    }
+    std::shuffle(live.begin(), live.end(), gen.engine());
+    int count = std::min(opt.ops, static_cast<int>(live.size()));
+    if (count == 0) {
+        return true; // delete_student took every row of a small roster
+    }
+    results.push_back(measure("update_random_async", count, [&](int i) {
+        const Student& s = extra[i];
+        db.update_student(live[i], s.name, roster[live[i] - 1].reg_no, s.age, s.major);
+    }));
+    results.push_back(measure("delete_random_async", count, [&](int i) {
+        db.delete_student(live[i]);
+    }));
+    return true;
+}
+
+// Search throughput over a sharded copy of the roster as the pool grows.
+// The calling thread also works through the shards, alongside the pool.
+static bool run_sharded(const Options& opt, RosterGenerator& gen, const std::vector<Student>& roster,
+                        std::vector<Result>& results) {
+    size_t shards = static_cast<size_t>(opt.shards);
+    for (size_t k = 0; k < shards; k++) {
+        seed_database(ShardedDatabase::shard_path(opt.db, k, shards));
+    }
+    {
+        ThreadPool pool(opt.threads);
+        ShardedDatabase db(opt.db, shards, pool);
+        std::vector<size_t> rejected;
+        if (!db.init() || db.add_students(roster, rejected) != roster.size()) {
+            std::cerr << "Cannot build the sharded benchmark database at " << opt.db << std::endl;
+            return false;
+        }
+    }
+
+    std::vector<std::string> queries;
+    for (int i = 0; i < opt.search_ops; i++) {
+        queries.push_back(gen.query());
+    }
+    for (int threads = 1; threads <= opt.threads; threads *= 2) {
+        ThreadPool pool(threads);
+        ShardedDatabase db(opt.db, shards, pool);
+        if (!db.init()) {
+            return false;
+        }
+        std::string name = "sharded_search_" + std::to_string(threads) + "t";
+        results.push_back(measure(name, opt.search_ops, [&](int i) {
+            db.search_students(queries[i]);
+        }));
+    }
+
+    for (size_t k = 0; k < shards; k++) {
+        remove_database(ShardedDatabase::shard_path(opt.db, k, shards));
+    }
+    return true;
+}
+
+// REG_RACERS threads race to give opt.reg_races reg_nos to a row each, on
+// a ShardedDatabase of --shards shards (8 if not given). They walk the
+// reg_nos in the same order, so they collide on every one: even threads
+// add a new row with it, odd threads add a row of their own under a
+// private reg_no and then move it onto the contested one. Exactly one
+// racer may win each reg_no, and afterwards each must be on exactly one
+// row, in memory and after reopening.
+static bool run_reg_race(const Options& opt, std::vector<Result>& results) {
+    const int REG_RACERS = 8;
+    std::string path = opt.db + ".race";
+    size_t shards = opt.shards > 0 ? static_cast<size_t>(opt.shards) : 8;
+    for (size_t k = 0; k < shards; k++) {
+        seed_database(ShardedDatabase::shard_path(path, k, shards));
+    }
+    auto contested = [](int k) { return "RACE-" + std::to_string(k); };
+
+    std::string problem;
+    std::vector<std::vector<double>> latencies(REG_RACERS);
+    double seconds = 0;
+    {
+        ThreadPool pool(REG_RACERS);
+        ShardedDatabase db(path, shards, pool);
+        if (!db.init()) {
+            std::cerr << "Cannot build the reg_no race database at " << path << std::endl;
+            return false;
+        }
+        std::vector<std::atomic<int>> wins(opt.reg_races);
+        for (auto& w : wins) w.store(0);
+        std::atomic<int> ready(0);
+        std::atomic<int> failed_adds(0); // private reg_nos, which must not clash
+
+        auto racer = [&](int t) {
+            ready.fetch_add(1);
+            while (ready.load() < REG_RACERS) {
+                std::this_thread::yield();
+            }
+            for (int k = 0; k < opt.reg_races; k++) {
+                std::string reg_no = contested(k);
+                int own = 0;
+                if (t % 2 == 1) {
+                    own = db.add_student("Racer", "RACER-" + std::to_string(t) + "-" + std::to_string(k), 20, "Law");
+                    if (own <= 0) {
+                        failed_adds.fetch_add(1);
+                        continue;
+                    }
+                }
+                auto before = Clock::now();
+                bool won = t % 2 == 0 ? db.add_student("Racer", reg_no, 20, "Law") > 0
+                                      : db.update_student(own, "Racer", reg_no, 20, "Law");
+                latencies[t].push_back(std::chrono::duration<double, std::micro>(Clock::now() - before).count());
+                if (won) wins[k].fetch_add(1);
+            }
+        };
+        auto start = Clock::now();
+        std::vector<std::thread> racers;
+        for (int t = 0; t < REG_RACERS; t++) racers.emplace_back(racer, t);
+        for (auto& t : racers) t.join();
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        if (failed_adds.load() > 0) {
+            problem = std::to_string(failed_adds.load()) + " adds under a private reg_no failed";
+        }
+        for (int k = 0; k < opt.reg_races && problem.empty(); k++) {
+            if (wins[k].load() != 1) {
+                problem = std::to_string(wins[k].load()) + " racers won " + contested(k);
+            }
+        }
+    }
+
+    // Every contested reg_no on exactly one row, also once reopened.
+    for (int pass = 0; pass < 2 && problem.empty(); pass++) {
+        ThreadPool pool(1);
+        ShardedDatabase db(path, shards, pool);
+        if (!db.init()) {
+            problem = "cannot reopen the race database";
+            break;
+        }
+        std::vector<int> rows(opt.reg_races, 0);
+        int after_id = 0;
+        for (std::vector<Student> page; !(page = db.students_after(after_id, 4096)).empty();) {
+            for (const Student& s : page) {
+                if (s.reg_no.compare(0, 5, "RACE-") == 0) rows[std::atoi(s.reg_no.c_str() + 5)]++;
+            }
+            after_id = page.back().id;
+        }
+        for (int k = 0; k < opt.reg_races && problem.empty(); k++) {
+            if (rows[k] != 1) problem = contested(k) + " is on " + std::to_string(rows[k]) + " rows";
+        }
+    }
+    for (size_t k = 0; k < shards; k++) {
+        remove_database(ShardedDatabase::shard_path(path, k, shards));
+    }
+    if (!problem.empty()) {
+        std::cerr << "reg_no race over " << shards << " shards failed: " << problem << std::endl;
+        return false;
+    }
+
+    Result race;
+    race.name = "sharded_reg_race_" + std::to_string(REG_RACERS) + "t";
+    race.seconds = seconds;
+    for (const auto& l : latencies) race.latencies_us.insert(race.latencies_us.end(), l.begin(), l.end());
+    results.push_back(race);
+    return true;
+}
+
+// Lists the roster into the file or device at path, reps times, as the
+// admin menu does when its output is redirected: pages of 4096 rows, each
+// formatted into one buffer and written with one flush. With per_row,
+// every row is flushed on its own instead, as the menu used to. Each
+// sample is one whole listing.
+static Result measure_listing(const std::string& name, const Database& db, const std::string& path, bool per_row,
+                              int reps) {
+    return measure(name, reps, [&](int) {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        std::string buffer;
+        auto write = [&]() {
+            out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            out.flush();
+            buffer.clear();
+        };
+        if (per_row) {
+            db.for_each_student([&](const Student& s) {
+                append_student_row(buffer, s);
+                write();
+            });
+            return;
+        }
+        StudentPager pager(db, 4096);
+        while (!pager.done()) {
+            pager.next_page(buffer);
+            write();
+        }
+    });
+}
+
+#ifndef _WIN32
+// The same listings into a pseudo-terminal, with a thread draining the
+// other end as a terminal emulator would.
+static bool measure_pty_listing(const Database& db, const std::string& suffix, int reps,
+                                std::vector<Result>& results) {
+    int master = ::posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || ::grantpt(master) != 0 || ::unlockpt(master) != 0) {
+        std::cerr << "Cannot open a pseudo-terminal" << std::endl;
+        if (master >= 0) ::close(master);
+        return false;
+    }
+    std::string terminal = ::ptsname(master);
+    // Held open between listings, so the drain never sees a hangup until
+    // the end.
+    int held = ::open(terminal.c_str(), O_RDWR | O_NOCTTY);
+    std::thread drain([master] {
+        char buf[65536];
+        while (::read(master, buf, sizeof(buf)) > 0) {
+        }
+    });
+    results.push_back(measure_listing("list_pty" + suffix, db, terminal, false, reps));
+    results.push_back(measure_listing("list_pty_per_row" + suffix, db, terminal, true, reps));
+    ::close(held);
+    drain.join();
+    ::close(master);
+    return held >= 0;
+}
+#endif
+
+// The same operations on rosters of each size in opt.sweep, each built in
+// a scratch database of its own, to show how their cost grows with the
+// roster. Names end in the size, as in get_student_100000.
+static bool run_sweep(const Options& opt, std::vector<Result>& results) {
+    std::string path = opt.db + ".sweep";
+    for (int size : opt.sweep) {
+        RosterGenerator gen(opt.seed);
+        std::vector<Student> roster;
+        roster.reserve(size);
+        for (int i = 0; i < size; i++) {
+            roster.push_back(gen.next());
+        }
+        seed_database(path);
+        Database db(path);
+        if (!db.init()) {
+            return false;
+        }
+        auto& rng = gen.engine();
+        std::string suffix = "_" + std::to_string(size);
+
+        // Insert throughput: the roster goes in as batches of 1000, each
+        // one sample, then single adds go on top of the full roster.
+        const int batch = 1000;
+        std::vector<size_t> rejected;
+        bool built = true;
+        results.push_back(measure("add_students" + suffix, (size + batch - 1) / batch, [&](int i) {
+            auto first = roster.begin() + static_cast<size_t>(i) * batch;
+            std::vector<Student> rows(first, first + std::min(batch, size - i * batch));
+            built = built && db.add_students(rows, rejected) == rows.size();
+        }));
+        if (!built) {
+            std::cerr << "Cannot build the sweep database at " << path << std::endl;
+            return false;
+        }
+        std::vector<Student> extra;
+        for (int i = 0; i < opt.ops; i++) {
+            extra.push_back(gen.next());
+        }
+        results.push_back(measure("add_student" + suffix, opt.ops, [&](int i) {
+            built = built && db.add_student(extra[i].name, extra[i].reg_no, extra[i].age, extra[i].major) > 0;
+        }));
+
+        // Lookups by id, and adds and updates turned away because the
+        // reg_no is taken: the uniqueness check without the write. The old
+        // check, a scan comparing every reg_no, is timed for comparison on
+        // fewer operations.
+        results.push_back(measure("get_student" + suffix, opt.ops, [&](int) {
+            db.get_student(1 + static_cast<int>(rng() % size));
+        }));
+        results.push_back(measure("add_duplicate" + suffix, opt.ops, [&](int) {
+            const Student& s = roster[rng() % size];
+            db.add_student(s.name, s.reg_no, s.age, s.major);
+        }));
+        results.push_back(measure("update_duplicate" + suffix, opt.ops, [&](int) {
+            int id = 1 + static_cast<int>(rng() % size);
+            const Student& s = roster[id - 1];
+            const std::string& taken = roster[rng() % size].reg_no;
+            if (taken != s.reg_no) db.update_student(id, s.name, taken, s.age, s.major);
+        }));
+        bool found = true;
+        results.push_back(measure("reg_no_scan" + suffix, std::max(opt.ops / 100, 1), [&](int) {
+            const std::string& reg_no = roster[rng() % size].reg_no;
+            bool seen = false;
+            db.for_each_student([&](const Student& s) {
+                if (s.reg_no == reg_no) seen = true;
+            });
+            found = found && seen;
+        }));
+        if (!built || !found || db.student_count() != roster.size() + extra.size()) {
+            std::cerr << "Sweep at " << size << " rows lost or changed a row" << std::endl;
+            return false;
+        }
+
+        // Startup in each format, and lazily from the binary one, which
+        // only reads the header and admins up front.
+        std::string text = path + ".txt";
+        std::string packed = path + ".packed";
+        std::string scratch = path + ".load";
+        if (!db.export_text(text) || !db.save()) {
+            return false;
+        }
+        std::filesystem::copy_file(path, packed, std::filesystem::copy_options::overwrite_existing);
+        {
+            Database compressed(packed);
+            compressed.set_compressed(true);
+            if (!compressed.init() || !compressed.save()) return false;
+        }
+        if (!measure_load("init_text" + suffix, text, scratch, 0, opt.reps, results) ||
+            !measure_load("init_binary" + suffix, path, scratch, 0, opt.reps, results) ||
+            !measure_load("init_binary_lazy" + suffix, path, scratch, 64 << 20, opt.reps, results) ||
+            !measure_load("init_compressed" + suffix, packed, scratch, 0, opt.reps, results)) {
+            return false;
+        }
+        remove_database(text);
+        remove_database(packed);
+
+        std::string listing = path + ".list";
+        results.push_back(measure_listing("list_file" + suffix, db, listing, false, opt.reps));
+        results.push_back(measure_listing("list_file_per_row" + suffix, db, listing, true, opt.reps));
+        std::remove(listing.c_str());
+#ifndef _WIN32
+        if (!measure_pty_listing(db, suffix, opt.reps, results)) {
+            return false;
+        }
+#endif
+    }
+    remove_database(path);
+    return true;
+}
+
+// Rows written by the stress writers hold a serial n in their name, and
+// their age and major follow from it, so a row whose fields disagree was
+// read halfway through a write.
+static void stress_row(int n, Student& s) {
+    s.name = "Stress " + std::to_string(n);
+    s.age = 18 + n % 10;
+    s.major = MAJORS[n % std::size(MAJORS)];
+}
+
+static bool stress_row_whole(const Student& s) {
+    if (s.name.compare(0, 7, "Stress ") != 0) return true;
+    Student expected;
+    stress_row(std::atoi(s.name.c_str() + 7), expected);
+    return s.name == expected.name && s.age == expected.age && s.major == expected.major;
+}
+
+// opt.readers reader threads and opt.writers writer threads on one
+// database. Writers share opt.ops writes between them, on rows of their
+// own: adds, updates and deletes in a 1:2:1 mix. Readers run until the
+// writers finish (or opt.ops operations each if there are none), cycling
+// through get_student, search_students, search_ranked, a query cursor
+// and, now and then, a full scan, and check what they get back: every row whole, search
+// results in id order, query rows within the query's bounds. At the end
+// the rows each writer left must be there, in memory and after reopening.
+static bool run_stress(const Options& opt, RosterGenerator& gen, const std::vector<Student>& roster,
+                       std::vector<Result>& results) {
+    std::string path = opt.db + ".stress";
+    seed_database(path);
+    auto db = std::make_unique<Database>(path);
+    std::vector<size_t> rejected;
+    if (!db->init() || db->add_students(roster, rejected) != roster.size()) {
+        std::cerr << "Cannot build the stress database at " << path << std::endl;
+        remove_database(path);
+        return false;
+    }
+
+    std::vector<std::string> queries;
+    for (int i = 0; i < opt.search_ops; i++) {
+        queries.push_back(gen.query());
+    }
+    std::mutex problem_mutex;
+    std::string problem;
+    auto fail = [&](const std::string& what) {
+        std::lock_guard<std::mutex> lock(problem_mutex);
+        if (problem.empty()) problem = what;
+    };
+
+    // Each writer's rows, as id -> serial of its last write.
+    std::vector<std::vector<std::pair<int, int>>> owned(opt.writers);
+    std::vector<std::vector<double>> write_latencies(opt.writers);
+    std::vector<std::vector<double>> read_latencies(opt.readers);
+    std::atomic<bool> writing(opt.writers > 0);
+    std::atomic<int> readers_started(0); // writers wait for every reader
+    int per_writer = opt.writers > 0 ? std::max(opt.ops / opt.writers, 1) : 0;
+
+    auto writer = [&](int w) {
+        std::mt19937 rng(opt.seed + 1000 + w);
+        auto& rows = owned[w];
+        Student s;
+        while (readers_started.load(std::memory_order_acquire) < opt.readers) {
+            std::this_thread::yield();
+        }
+        for (int i = 0; i < per_writer; i++) {
+            int n = w * per_writer + i;
+            stress_row(n, s);
+            unsigned op = rows.empty() ? 0 : rng() % 4;
+            size_t pick = rows.empty() ? 0 : rng() % rows.size();
+            auto before = Clock::now();
+            if (op == 0) {
+                std::string reg_no = "ST" + std::to_string(w) + "-" + std::to_string(i);
+                int id = db->add_student(s.name, reg_no, s.age, s.major);
+                if (id <= 0) fail("add_student failed for " + reg_no);
+                else rows.emplace_back(id, n);
+            } else if (op < 3) {
+                int id = rows[pick].first;
+                std::optional<Student> old = db->get_student(id);
+                if (!old || !db->update_student(id, s.name, old->reg_no, s.age, s.major)) {
+                    fail("update_student failed for id " + std::to_string(id));
+                }
+                rows[pick].second = n;
+            } else {
+                if (!db->delete_student(rows[pick].first)) {
+                    fail("delete_student failed for id " + std::to_string(rows[pick].first));
+                }
+                rows[pick] = rows.back();
+                rows.pop_back();
+            }
+            write_latencies[w].push_back(std::chrono::duration<double, std::micro>(Clock::now() - before).count());
+        }
+    };
+
+    auto reader = [&](int r) {
+        std::mt19937 rng(opt.seed + 2000 + r);
+        auto& latencies = read_latencies[r];
+        readers_started.fetch_add(1, std::memory_order_release);
+        for (int i = 0; opt.writers > 0 ? i == 0 || writing.load(std::memory_order_acquire) : i < opt.ops; i++) {
+            auto before = Clock::now();
+            if (i % 64 == 63) {
+                db->for_each_student([&](const Student& s) {
+                    if (!stress_row_whole(s)) fail("scan saw a torn row: " + s.name);
+                });
+            } else if (i % 4 == 0) {
+                int top = static_cast<int>(roster.size()) + opt.ops + 1;
+                std::optional<Student> s = db->get_student(1 + static_cast<int>(rng() % top));
+                if (s && !stress_row_whole(*s)) fail("get_student saw a torn row: " + s->name);
+            } else if (i % 4 == 1) {
+                std::vector<Student> found = db->search_students(queries[rng() % queries.size()]);
+                for (size_t k = 0; k < found.size(); k++) {
+                    if (!stress_row_whole(found[k])) fail("search saw a torn row: " + found[k].name);
+                    if (k > 0 && found[k - 1].id >= found[k].id) fail("search results out of id order");
+                }
+            } else if (i % 4 == 2) {
+                for (const auto& hit : db->search_ranked(queries[rng() % queries.size()], 10)) {
+                    if (!stress_row_whole(hit.student)) fail("ranked search saw a torn row: " + hit.student.name);
+                }
+            } else {
+                StudentQuery query;
+                query.major = MAJORS[rng() % std::size(MAJORS)];
+                query.min_age = 18 + static_cast<int>(rng() % 6);
+                query.max_age = *query.min_age + 4;
+                query.limit = 100;
+                StudentCursor cursor = db->query(query);
+                Student s;
+                while (cursor.next(s)) {
+                    if (s.major != *query.major || s.age < *query.min_age || s.age > *query.max_age) {
+                        fail("query returned a row outside its bounds: id " + std::to_string(s.id));
+                    }
+                    if (!stress_row_whole(s)) fail("query saw a torn row: " + s.name);
+                }
+            }
+            latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - before).count());
+        }
+    };
+
+    auto start = Clock::now();
+    std::vector<std::thread> readers, writers;
+    for (int r = 0; r < opt.readers; r++) readers.emplace_back(reader, r);
+    for (int w = 0; w < opt.writers; w++) writers.emplace_back(writer, w);
+    for (auto& t : writers) t.join();
+    writing.store(false, std::memory_order_release);
+    for (auto& t : readers) t.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    // What the writers left must be exactly what a reader sees now, and
+    // again after the database is closed and reopened from disk.
+    size_t expected = roster.size();
+    for (const auto& rows : owned) expected += rows.size();
+    for (int pass = 0; pass < 2 && problem.empty(); pass++) {
+        if (pass == 1) {
+            db.reset();
+            db = std::make_unique<Database>(path);
+            if (!db->init()) fail("cannot reopen the stress database");
+        }
+        if (db->student_count() != expected) {
+            fail(std::to_string(db->student_count()) + " rows after the run, expected " + std::to_string(expected));
+        }
+        Student s;
+        for (const auto& rows : owned) {
+            for (const auto& [id, n] : rows) {
+                stress_row(n, s);
+                std::optional<Student> found = db->get_student(id);
+                if (!found || found->name != s.name || !stress_row_whole(*found)) {
+                    fail("row " + std::to_string(id) + " lost its last write");
+                }
+            }
+        }
+    }
+    db.reset();
+    remove_database(path);
+    if (!problem.empty()) {
+        std::cerr << "Stress run with " << opt.readers << " readers and " << opt.writers
+                  << " writers failed: " << problem << std::endl;
+        return false;
+    }
+
+    std::string suffix = "_" + std::to_string(opt.readers) + "r" + std::to_string(opt.writers) + "w";
+    if (opt.readers > 0) {
+        Result read;
+        read.name = "stress_read" + suffix;
+        read.seconds = seconds;
+        for (const auto& l : read_latencies) read.latencies_us.insert(read.latencies_us.end(), l.begin(), l.end());
+        results.push_back(read);
+    }
+    if (opt.writers > 0) {
+        Result write;
+        write.name = "stress_write" + suffix;
+        write.seconds = seconds;
+        for (const auto& l : write_latencies) write.latencies_us.insert(write.latencies_us.end(), l.begin(), l.end());
+        results.push_back(write);
+    }
+    return true;
+}
+
+#ifndef _WIN32
+// Each of n processes opens the same database in shared mode and raises the
+// age of one of a few hot rows by one, ops / n times: read the row and its
+// version, write it back, and start over if another process got there
+// first. Latency is per successful update, retries included. The ages must
+// add up to the updates made, or an update was lost.
+static bool run_contention(const Options& opt, std::vector<Result>& results) {
+    const int HOT_ROWS = 16;
+    std::string path = opt.db + ".shared";
+    seed_database(path);
+    std::vector<int> hot;
+    {
+        Database db(path);
+        db.set_shared();
+        if (!db.init()) return false;
+        for (int k = 0; k < HOT_ROWS; k++) {
+            std::string reg_no = "HOT" + std::to_string(k);
+            hot.push_back(db.add_student("Hot Row", reg_no, 0, "Contention"));
+        }
+    }
+    auto age_total = [&path, &hot]() {
+        Database db(path);
+        db.set_shared();
+        long total = 0;
+        if (db.init()) {
+            for (int id : hot) total += db.get_student(id)->age;
+        }
+        return total;
+    };
+
+    long expected = 0;
+    for (int procs = 1; procs <= opt.procs; procs *= 2) {
+        int per_process = std::max(opt.ops / procs, 1);
+        std::vector<pid_t> children;
+        for (int k = 0; k < procs; k++) {
+            pid_t pid = fork();
+            if (pid != 0) {
+                children.push_back(pid);
+                continue;
+            }
+            std::vector<double> latencies;
+            uint64_t stale_count = 0;
+            {
+                Database db(path);
+                db.set_shared();
+                if (!db.init()) _exit(1);
+                std::mt19937 rng(opt.seed + k);
+                for (int i = 0; i < per_process; i++) {
+                    auto before = Clock::now();
+                    int id = hot[rng() % hot.size()];
+                    while (true) {
+                        db.refresh();
+                        uint64_t version = 0;
+                        std::optional<Student> s = db.get_student(id, version);
+                        bool stale = false;
+                        if (s && db.update_student(id, s->name, s->reg_no, s->age + 1, s->major, version, stale)) break;
+                        if (!stale) _exit(1);
+                        stale_count++;
+                    }
+                    latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - before).count());
+                }
+            }
+            std::ofstream out(path + ".w" + std::to_string(k), std::ios::binary);
+            out.write(reinterpret_cast<const char*>(&stale_count), sizeof(stale_count));
+            out.write(reinterpret_cast<const char*>(latencies.data()), latencies.size() * sizeof(double));
+            out.close();
+            _exit(out ? 0 : 1);
+        }
+
+        Result result;
+        result.name = "shared_update_" + std::to_string(procs) + "p";
+        auto start = Clock::now();
+        bool ok = true;
+        for (pid_t pid : children) {
+            int status = 0;
+            ok = waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0 && ok;
+        }
+        result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        for (int k = 0; k < procs; k++) {
+            std::string worker = path + ".w" + std::to_string(k);
+            std::ifstream in(worker, std::ios::binary);
+            uint64_t stale_count = 0;
+            std::vector<double> latencies(per_process);
+            ok = ok && in.read(reinterpret_cast<char*>(&stale_count), sizeof(stale_count)) &&
+                 in.read(reinterpret_cast<char*>(latencies.data()), latencies.size() * sizeof(double));
+            result.stale += stale_count;
+            result.latencies_us.insert(result.latencies_us.end(), latencies.begin(), latencies.end());
+            in.close();
+            std::remove(worker.c_str());
+        }
+        expected += static_cast<long>(per_process) * procs;
+        long total = age_total();
+        if (!ok || total != expected) {
+            std::cerr << "Shared update run with " << procs << " processes failed: ages add up to " << total
+                      << ", expected " << expected << std::endl;
+            remove_database(path);
+            return false;
+        }
+        results.push_back(result);
+    }
+    remove_database(path);
+    return true;
+}
+
+// Every row of the database at path, one per line. Opening it replays the
+// log, as the first start after a crash does.
+static bool recovered_rows(const std::string& path, std::string& rows) {
+    Database db(path);
+    if (!db.init()) return false;
+    rows.clear();
+    db.for_each_student([&rows](const Student& s) {
+        rows += std::to_string(s.id) + "|" + s.name + "|" + s.reg_no + "|" + std::to_string(s.age) + "|" +
+                s.major + "\n";
+    });
+    return true;
+}
+
+// Crash injection, in two parts. A child process commits one transaction
+// and exits without closing the database, so the batch is in the log only;
+// the database is then reopened from every prefix of that log, as if the
+// crash had cut the write off at each byte, and must come back either
+// without the transaction or with all of it. Then, opt.crash_rounds
+// times, a child commits transactions of 10 adds as fast as it can and is
+// killed with SIGKILL at a random moment, which may fall in a log write or
+// a checkpoint. On reopening, every transaction must be whole, none that
+// an earlier round recovered may be missing, and the ones present must be
+// numbered without gaps. Latency is the time to reopen and read the rows.
+static bool run_crash(const Options& opt, std::vector<Result>& results) {
+    std::string path = opt.db + ".crash";
+    std::string torn_path = opt.db + ".torn";
+    auto failed = [&](const std::string& what) {
+        std::cerr << "Crash test failed: " << what << std::endl;
+        remove_database(path);
+        remove_database(torn_path);
+        return false;
+    };
+
+    seed_database(path);
+    {
+        Database db(path);
+        if (!db.init()) return failed("cannot open " + path);
+        for (int i = 1; i <= 20; i++) {
+            db.add_student("Crash Row", "CR" + std::to_string(i), 20, "Physics");
+        }
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        Database db(path);
+        if (!db.init()) _exit(1);
+        Transaction tx = db.begin();
+        tx.add_student("Torn Add", "TORN1", 21, "Law");
+        tx.update_student(3, "Torn Update", "CR3", 22, "History");
+        tx.delete_student(5);
+        tx.add_student("Torn Add", "TORN2", 23, "Medicine");
+        tx.update_student(7, "Torn Update", "TORN3", 24, "Economics");
+        _exit(tx.commit() ? 0 : 1); // skips the destructor's checkpoint
+    }
+    int status = 0;
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        return failed("the child could not commit its transaction");
+    }
+    std::string log;
+    {
+        std::ifstream in(path + ".wal", std::ios::binary);
+        log.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    Result torn;
+    torn.name = "crash_torn_prefix";
+    std::vector<std::string> states;
+    auto start = Clock::now();
+    for (size_t length = 0; length <= log.size(); length++) {
+        remove_database(torn_path);
+        std::error_code ec;
+        std::filesystem::copy_file(path, torn_path, ec);
+        std::ofstream(torn_path + ".wal", std::ios::binary).write(log.data(), static_cast<std::streamsize>(length));
+        auto before = Clock::now();
+        states.emplace_back();
+        if (ec || !recovered_rows(torn_path, states.back())) {
+            return failed("cannot reopen with the log cut at byte " + std::to_string(length));
+        }
+        torn.latencies_us.push_back(std::chrono::duration<double, std::micro>(Clock::now() - before).count());
+    }
+    torn.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    remove_database(torn_path);
+    if (states.front() == states.back()) {
+        return failed("the committed transaction is not in the log");
+    }
+    for (size_t length = 0; length < states.size(); length++) {
+        if (states[length] != states.front() && states[length] != states.back()) {
+            return failed("the log cut at byte " + std::to_string(length) + " recovers part of the transaction");
+        }
+    }
+    results.push_back(torn);
+
+    // Transaction k adds rows KILL<k>-0 .. KILL<k>-9.
+    Result killed;
+    killed.name = "crash_kill_recovery";
+    std::mt19937 rng(opt.seed);
+    int recovered = 0;
+    start = Clock::now();
+    for (int round = 0; round < opt.crash_rounds; round++) {
+        // The child says when it has opened the database, which takes
+        // longer as the rounds add rows, and the random delay starts then.
+        int opened[2];
+        if (pipe(opened) != 0) return failed("cannot create a pipe");
+        pid = fork();
+        if (pid == 0) {
+            close(opened[0]);
+            Database db(path);
+            char byte = 1;
+            if (!db.init() || write(opened[1], &byte, 1) != 1) _exit(1);
+            for (int k = recovered;; k++) {
+                Transaction tx = db.begin();
+                for (int j = 0; j < 10; j++) {
+                    tx.add_student("Crash Batch", "KILL" + std::to_string(k) + "-" + std::to_string(j), 20, "Physics");
+                }
+                if (!tx.commit()) _exit(1);
+            }
+        }
+        close(opened[1]);
+        char byte = 0;
+        bool started = read(opened[0], &byte, 1) == 1;
+        close(opened[0]);
+        if (started) {
+            std::this_thread::sleep_for(std::chrono::microseconds(rng() % 200000));
+        }
+        kill(pid, SIGKILL);
+        if (waitpid(pid, &status, 0) != pid || !started || !WIFSIGNALED(status)) {
+            return failed("the committing child exited before it was killed");
+        }
+
+        auto before = Clock::now();
+        Database db(path);
+        if (!db.init()) return failed("cannot reopen after round " + std::to_string(round));
+        std::map<int, int> transactions; // k -> rows recovered
+        db.for_each_student([&transactions](const Student& s) {
+            if (s.reg_no.compare(0, 4, "KILL") == 0) transactions[std::atoi(s.reg_no.c_str() + 4)]++;
+        });
+        killed.latencies_us.push_back(std::chrono::duration<double, std::micro>(Clock::now() - before).count());
+        int next = 0;
+        for (const auto& [k, rows] : transactions) {
+            if (rows != 10) {
+                return failed("transaction " + std::to_string(k) + " recovered " + std::to_string(rows) +
+                              " of its 10 rows in round " + std::to_string(round));
+            }
+            if (k != next++) {
+                return failed("transaction " + std::to_string(next - 1) + " is missing in round " +
+                              std::to_string(round));
+            }
+        }
+        if (next < recovered) {
+            return failed("round " + std::to_string(round) + " lost transactions recovered before");
+        }
+        recovered = next;
+    }
+    killed.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    results.push_back(killed);
+    remove_database(path);
+    return true;
+}
+#endif
+
+// The search path before contains_folded(): fold a copy, then find.
+static bool transform_find(std::string_view text, std::string_view lower_query) {
+    std::string folded(text);
+    std::transform(folded.begin(), folded.end(), folded.begin(), [](unsigned char c) {
+        return static_cast<char>(std::tolower(c));
+    });
+    return folded.find(lower_query) != std::string::npos;
+}
+
+// Case-insensitive substring search. Every kernel is first checked against
+// transform_find() on random texts of every length up to 300 and some
+// longer, over a small alphabet so that partial and overlapping matches
+// are common, with queries often cut from the text itself; any
+// disagreement fails the run. Then each kernel, the dispatched
+// contains_folded() and transform_find() are timed scanning 1024 fields
+// of each size for queries of each length, fold_ops times.
+static bool run_fold(const Options& opt, std::vector<Result>& results) {
+    std::vector<FoldSearchKernel> kernels = fold_search_kernels();
+    kernels.push_back({contains_folded, "dispatch"});
+    std::mt19937 rng(opt.seed);
+    const char alphabet[] = "aAbBcC-z\x80\xe9";
+    auto random_text = [&](size_t size, size_t letters) {
+        std::string text(size, ' ');
+        for (char& c : text) c = alphabet[rng() % letters];
+        return text;
+    };
+
+    int checks = 0;
+    for (size_t size = 0; size <= 4096; size += size < 300 ? 1 : 953) {
+        for (int round = 0; round < 40; round++) {
+            std::string text = random_text(size, round % 2 == 0 ? 4 : sizeof(alphabet) - 1);
+            size_t k = 1 + rng() % (round < 20 ? 4 : 40);
+            std::string query;
+            if (round % 3 != 0 && k <= size) {
+                size_t at = rng() % (size - k + 1);
+                query = text.substr(at, k);
+                if (round % 5 == 0) query.back() = 'z';
+            } else {
+                query = random_text(k, 4);
+            }
+            for (char& c : query) c = fold_ascii(c);
+            bool expected = transform_find(text, query);
+            for (const auto& kernel : kernels) {
+                if (kernel.contains(text, query) != expected) {
+                    std::cerr << "fold search: " << kernel.name << " says " << !expected << " for a query of "
+                              << query.size() << " byte(s) in " << text.size() << " byte(s)" << std::endl;
+                    return false;
+                }
+                checks++;
+            }
+        }
+    }
+    std::cerr << "fold search: " << checks << " checks agree" << std::endl;
+
+    kernels.push_back({transform_find, "transform_find"});
+    const size_t query_sizes[] = {1, 3, 8};
+    const size_t field_sizes[] = {12, 24, 48, 128, 512};
+    for (size_t q : query_sizes) {
+        for (size_t f : field_sizes) {
+            std::vector<std::string> fields;
+            for (int i = 0; i < 1024; i++) {
+                std::string field(f, ' ');
+                for (char& c : field) c = static_cast<char>('a' + rng() % 26 - (rng() % 2) * 32);
+                fields.push_back(field);
+            }
+            std::string query = fields[0].substr(f / 2, q);
+            for (char& c : query) c = fold_ascii(c);
+            for (const auto& kernel : kernels) {
+                size_t found = 0;
+                results.push_back(measure("fold_" + std::string(kernel.name) + "_q" + std::to_string(q) + "_f" +
+                                              std::to_string(f), opt.fold_ops, [&](int) {
+                    for (const auto& field : fields) {
+                        found += kernel.contains(field, query) ? 1 : 0;
+                    }
+                }));
+                if (found == 0) {
+                    return false; // fields[0] always matches; also keeps the scan from being optimized out
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Replication lag: the time from an update committing on the leader to the
+// follower having applied it. "replication_lag_idle" waits for each update
+// to arrive before making the next; "replication_lag" has the leader write
+// as fast as it can while a monitor thread watches the follower catch up.
+static bool run_replication(const Options& opt, RosterGenerator& gen, const std::vector<Student>& roster,
+                            std::vector<Result>& results) {
+    std::string leader_path = opt.db;
+    std::string follower_path = opt.db + ".follower";
+    seed_database(leader_path);
+    remove_database(follower_path);
+
+    Database leader(leader_path);
+    leader.enable_change_feed();
+    std::vector<size_t> rejected;
+    if (!leader.init() || leader.add_students(roster, rejected) != roster.size()) {
+        std::cerr << "Cannot build the leader database at " << leader_path << std::endl;
+        return false;
+    }
+    leader.save();
+    Database follower(follower_path);
+    if (!Replica::bootstrap(leader_path, follower_path) || !follower.init()) {
+        std::cerr << "Cannot start the follower at " << follower_path << std::endl;
+        return false;
+    }
+    Replica replica(follower, leader_path);
+    replica.start();
+
+    auto& rng = gen.engine();
+    int rows = static_cast<int>(roster.size());
+    auto update = [&](int i) {
+        int id = 1 + static_cast<int>(rng() % rows);
+        Student s = gen.next();
+        leader.update_student(id, s.name, roster[id - 1].reg_no, s.age, s.major);
+        (void)i;
+    };
+
+    results.push_back(measure("replication_lag_idle", std::min(opt.lag_ops, 1000), [&](int i) {
+        update(i);
+        uint64_t seq = leader.last_change();
+        while (follower.last_change() < seq) {
+            std::this_thread::yield();
+        }
+    }));
+
+    Result lag;
+    lag.name = "replication_lag";
+    uint64_t base = leader.last_change();
+    std::vector<Clock::time_point> committed(opt.lag_ops);
+    std::atomic<size_t> written(0);
+    auto start = Clock::now();
+    std::thread monitor([&] {
+        size_t seen = 0;
+        while (seen < committed.size()) {
+            size_t upto = std::min<size_t>(follower.last_change() - base, written.load(std::memory_order_acquire));
+            auto now = Clock::now();
+            for (; seen < upto; seen++) {
+                lag.latencies_us.push_back(std::chrono::duration<double, std::micro>(now - committed[seen]).count());
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    });
+    for (int i = 0; i < opt.lag_ops; i++) {
+        update(i);
+        committed[i] = Clock::now();
+        written.store(i + 1, std::memory_order_release);
+    }
+    monitor.join();
+    lag.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    results.push_back(lag);
+
+    replica.stop();
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    Options opt;
+    if (!parse_options(argc, argv, opt)) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--rows=N] [--ops=N] [--search-ops=N] [--reps=N] [--seed=N] [--db=path]"
+                     " [--json=path|-] [--csv=path] [--shards=N] [--threads=N] [--lag-ops=N] [--procs=N]"
+                     " [--readers=N] [--writers=N] [--crash-rounds=N] [--fold-ops=N] [--reg-races=N]"
+                     " [--sweep=N,N,...]" << std::endl;
+        return 1;
+    }
+
+    RosterGenerator gen(opt.seed);
+    std::vector<Student> roster;
+    roster.reserve(opt.rows);
+    for (int i = 0; i < opt.rows; i++) {
+        roster.push_back(gen.next());
+    }
+    if (!opt.csv.empty()) {
+        std::ofstream csv(opt.csv);
+        csv << "name,reg_no,age,major\n";
+        for (const auto& s : roster) {
+            csv << s.name << "," << s.reg_no << "," << s.age << "," << s.major << "\n";
+        }
+    }
+
+    std::vector<Result> results;
+    Footprint footprint;
+    {
+        seed_database(opt.db);
+        footprint.rss_before = process_resident_bytes();
+        Database db(opt.db);
+        std::vector<size_t> rejected;
+        if (!db.init() || db.add_students(roster, rejected) != roster.size()) {
+            std::cerr << "Cannot build the benchmark database at " << opt.db << std::endl;
+            return 1;
+        }
+        footprint.table_bytes = db.memory_usage();
+        footprint.rss_after = process_resident_bytes();
+    }
+
+    results.push_back(measure("init", opt.reps, [&](int) {
+        Database db(opt.db);
+        db.init();
+    }));
+
+    if (!run_formats(opt, results) || !run_operations(opt, gen, roster, results) || !run_async(opt, gen, roster, results)) {
+        return 1;
+    }
+    remove_database(opt.db);
+    if (opt.shards > 0 && !run_sharded(opt, gen, roster, results)) {
+        return 1;
+    }
+    if (opt.lag_ops > 0) {
+        bool ok = run_replication(opt, gen, roster, results);
+        remove_database(opt.db);
+        remove_database(opt.db + ".follower");
+        if (!ok) return 1;
+    }
+    if (opt.procs > 0) {
+#ifndef _WIN32
+        if (!run_contention(opt, results)) return 1;
+#else
+        std::cerr << "--procs needs fork() and is not supported on Windows" << std::endl;
+#endif
+    }
+    if ((opt.readers > 0 || opt.writers > 0) && !run_stress(opt, gen, roster, results)) {
+        return 1;
+    }
+    if (opt.crash_rounds > 0) {
+#ifndef _WIN32
+        if (!run_crash(opt, results)) return 1;
+#else
+        std::cerr << "--crash-rounds needs fork() and is not supported on Windows" << std::endl;
+#endif
+    }
+    if (opt.reg_races > 0 && !run_reg_race(opt, results)) {
+        return 1;
+    }
+    if (opt.fold_ops > 0 && !run_fold(opt, results)) {
+        return 1;
+    }
+    if (!opt.sweep.empty() && !run_sweep(opt, results)) {
+        return 1;
+    }
+
+    if (opt.json == "-") {
+        write_json(std::cout, opt, footprint, results);
+    } else {
+        std::ofstream out(opt.json);
+        write_json(out, opt, footprint, results);
+        if (!out) {
+            std::cerr << "Cannot write " << opt.json << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
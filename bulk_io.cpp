@@ -0,0 +1,531 @@
+#include "bulk_io.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+struct RejectedRow {
+    size_t line;
+    std::string reason;
+};
+
+// One slice of the input, parsed on its own thread. Line numbers are
+// relative to the slice until the results are merged.
+struct ImportChunk {
+    const char* begin;
+    const char* end;
+    size_t lines;
+    std::vector<Student> rows;
+    std::vector<size_t> row_lines;
+    std::vector<RejectedRow> rejected;
+};
+
+// Splits one CSV line into fields. Double-quoted fields may contain commas,
+// and "" inside them is a literal quote. Returns false on an unterminated
+// quote.
+static bool split_csv(const char* p, const char* end, std::vector<std::string>& fields) {
+    fields.clear();
+    std::string field;
+    while (true) {
+        field.clear();
+        if (p < end && *p == '"') {
+            p++;
+            while (true) {
+                if (p == end) return false;
+                if (*p == '"') {
+                    if (p + 1 < end && p[1] == '"') {
+                        field += '"';
+                        p += 2;
+                        continue;
+                    }
+                    p++;
+                    break;
+                }
+                field += *p++;
+            }
+            // Anything between the closing quote and the comma is kept.
+            while (p < end && *p != ',') field += *p++;
+        } else {
+            while (p < end && *p != ',') field += *p++;
+        }
+        fields.push_back(field);
+        if (p == end) return true;
+        p++; // Skip the comma
+    }
+}
+
+static bool parse_age(const std::string& text, int& age) {
+    if (text.empty()) return false;
+    char* end = nullptr;
+    long value = std::strtol(text.c_str(), &end, 10);
+    if (*end != '\0' || value < 0 || value > 150) return false;
+    age = static_cast<int>(value);
+    return true;
+}
+
+static bool is_header(const std::vector<std::string>& fields) {
+    if (fields.empty()) return false;
+    std::string first = fields[0];
+    std::transform(first.begin(), first.end(), first.begin(), ::tolower);
+    return first == "name" || first == "id";
+}
+
+static void parse_chunk(ImportChunk& chunk) {
+    std::vector<std::string> fields;
+    const char* p = chunk.begin;
+    chunk.lines = 0;
+
+    while (p < chunk.end) {
+        const char* eol = std::find(p, chunk.end, '\n');
+        const char* line_end = (eol > p && eol[-1] == '\r') ? eol - 1 : eol;
+        size_t line = ++chunk.lines;
+
+        if (line_end > p) {
+            if (!split_csv(p, line_end, fields)) {
+                chunk.rejected.push_back({line, "unterminated quote"});
+            } else if (fields.size() != 4 && fields.size() != 5) {
+                chunk.rejected.push_back({line, "expected 4 or 5 fields, got " + std::to_string(fields.size())});
+            } else {
+                size_t base = fields.size() - 4; // Skip a leading id column
+                Student s;
+                s.id = 0;
+                s.name = fields[base];
+                s.reg_no = fields[base + 1];
+                s.major = fields[base + 3];
+
+                if (s.name.empty() || s.reg_no.empty()) {
+                    chunk.rejected.push_back({line, "name and reg_no are required"});
+                } else if (!parse_age(fields[base + 2], s.age)) {
+                    chunk.rejected.push_back({line, "invalid age '" + fields[base + 2] + "'"});
+                } else if ((s.name + s.reg_no + s.major).find('|') != std::string::npos) {
+                    chunk.rejected.push_back({line, "fields may not contain '|'"});
+                } else {
+                    chunk.rows.push_back(std::move(s));
+                    chunk.row_lines.push_back(line);
+                }
+            }
+        }
+        p = eol + 1;
+    }
+}
+
+int import_csv(Database& db, const std::string& path) {
+    auto start = std::chrono::steady_clock::now();
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Cannot open " << path << std::endl;
+        return 1;
+    }
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    const std::string data = contents.str();
+
+    const char* begin = data.data();
+    const char* end = begin + data.size();
+    size_t first_line = 0;
+
+    std::vector<std::string> fields;
+    const char* eol = std::find(begin, end, '\n');
+    if (split_csv(begin, (eol > begin && eol[-1] == '\r') ? eol - 1 : eol, fields) && is_header(fields)) {
+        begin = eol < end ? eol + 1 : end;
+        first_line = 1;
+    }
+
+    // Split into roughly equal slices on line boundaries, one per thread,
+    // but keep slices big enough to be worth a thread.
+    const size_t min_chunk = 1 << 16;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t count = std::max<size_t>(1, std::min(threads, static_cast<size_t>(end - begin) / min_chunk));
+
+    std::vector<ImportChunk> chunks(count);
+    const char* p = begin;
+    for (size_t i = 0; i < count; i++) {
+        const char* stop = (i + 1 == count) ? end : std::min(end, p + (end - begin) / count);
+        stop = std::find(stop, end, '\n');
+        chunks[i].begin = p;
+        chunks[i].end = stop;
+        p = stop < end ? stop + 1 : end;
+    }
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < count; i++) {
+        workers.emplace_back(parse_chunk, std::ref(chunks[i]));
+    }
+    parse_chunk(chunks[0]);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    // Merge in input order so ids follow the file.
+    std::vector<Student> batch;
+    std::vector<size_t> batch_lines;
+    std::vector<RejectedRow> rejected;
+    size_t line_offset = first_line;
+    for (auto& chunk : chunks) {
+        for (size_t i = 0; i < chunk.rows.size(); i++) {
+            batch.push_back(std::move(chunk.rows[i]));
+            batch_lines.push_back(chunk.row_lines[i] + line_offset);
+        }
+        for (auto& r : chunk.rejected) {
+            rejected.push_back({r.line + line_offset, std::move(r.reason)});
+        }
+        line_offset += chunk.lines;
+    }
+
+    std::vector<size_t> duplicates;
+    size_t added = db.add_students(batch, duplicates);
+    if (added + duplicates.size() < batch.size()) {
+        std::cerr << "Cannot write the imported rows to the database; nothing was imported" << std::endl;
+        return 1;
+    }
+    for (size_t index : duplicates) {
+        rejected.push_back({batch_lines[index], "duplicate reg_no '" + batch[index].reg_no + "'"});
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Imported " << added << " student(s), rejected " << rejected.size()
+              << " row(s) in " << static_cast<long>(seconds * 1000) << " ms ("
+              << static_cast<long>(seconds > 0 ? (added + rejected.size()) / seconds : 0) << " rows/s)" << std::endl;
+
+    std::sort(rejected.begin(), rejected.end(),
+              [](const RejectedRow& a, const RejectedRow& b) { return a.line < b.line; });
+    for (const auto& r : rejected) {
+        std::cerr << "  line " << r.line << ": " << r.reason << std::endl;
+    }
+    return 0;
+}
+
+static void write_csv_field(std::ostream& out, const std::string& value) {
+    if (value.find_first_of(",\"\n") == std::string::npos) {
+        out << value;
+        return;
+    }
+    out << '"';
+    for (char c : value) {
+        if (c == '"') out << '"';
+        out << c;
+    }
+    out << '"';
+}
+
+int export_csv(const Database& db, const std::string& path) {
+    auto start = std::chrono::steady_clock::now();
+
+    std::ofstream file;
+    if (path != "-") {
+        file.open(path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            std::cerr << "Cannot open " << path << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = path == "-" ? std::cout : file;
+
+    out << "id,name,reg_no,age,major\n";
+    db.for_each_student([&out](const Student& s) {
+        out << s.id << ',';
+        write_csv_field(out, s.name);
+        out << ',';
+        write_csv_field(out, s.reg_no);
+        out << ',' << s.age << ',';
+        write_csv_field(out, s.major);
+        out << '\n';
+    });
+    out.flush();
+    if (!out) {
+        std::cerr << "Error writing " << path << std::endl;
+        return 1;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << "Exported " << db.student_count() << " student(s) in " << static_cast<long>(seconds * 1000)
+              << " ms (" << static_cast<long>(seconds > 0 ? db.student_count() / seconds : 0) << " rows/s)" << std::endl;
+    return 0;
+}
+
+// Writes value as a JSON string, escaping quotes, backslashes and control
+// characters.
+static void write_json_string(std::ostream& out, const std::string& value) {
+    out << '"';
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escape[8];
+            std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+            out << escape;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+static void write_json_student(std::ostream& out, const Student& s) {
+    out << "{\"id\":" << s.id << ",\"name\":";
+    write_json_string(out, s.name);
+    out << ",\"reg_no\":";
+    write_json_string(out, s.reg_no);
+    out << ",\"age\":" << s.age << ",\"major\":";
+    write_json_string(out, s.major);
+    out << '}';
+}
+
+static void write_json_error(std::ostream& out, size_t line, const std::string& error) {
+    out << "{\"line\":" << line << ",\"ok\":false,\"error\":";
+    write_json_string(out, error);
+    out << "}\n";
+}
+
+static bool parse_id(const std::string& text, int& id) {
+    if (text.empty()) return false;
+    char* end = nullptr;
+    long value = std::strtol(text.c_str(), &end, 10);
+    if (*end != '\0' || value <= 0 || value > std::numeric_limits<int>::max()) return false;
+    id = static_cast<int>(value);
+    return true;
+}
+
+// A write waiting for the next commit, with the script line it came from.
+// One with an error is only answered, in its place.
+struct PendingWrite {
+    enum class Op { Add, Update, Delete };
+
+    size_t line;
+    Op op;
+    Student student;
+    std::string error;
+};
+
+// Collects a script's writes, commits them as transactions and answers
+// each of them in script order.
+class WriteBatch {
+private:
+    Transaction txn;
+    std::vector<PendingWrite> pending;
+    std::ostream& out;
+
+    void stage(const PendingWrite& w) {
+        const Student& s = w.student;
+        if (w.op == PendingWrite::Op::Add) {
+            txn.add_student(s.name, s.reg_no, s.age, s.major);
+        } else if (w.op == PendingWrite::Op::Update) {
+            txn.update_student(s.id, s.name, s.reg_no, s.age, s.major);
+        } else {
+            txn.delete_student(s.id);
+        }
+    }
+
+    // Answers pending[begin, end) once the writes there without an error
+    // have been committed.
+    void answer(size_t begin, size_t end) {
+        const std::vector<int>& ids = txn.added_ids();
+        size_t added = 0;
+        for (size_t i = begin; i < end; i++) {
+            const PendingWrite& w = pending[i];
+            if (!w.error.empty()) {
+                write_json_error(out, w.line, w.error);
+                continue;
+            }
+            out << "{\"line\":" << w.line << ",\"ok\":true";
+            if (w.op == PendingWrite::Op::Add && added < ids.size()) {
+                out << ",\"id\":" << ids[added++];
+            }
+            out << "}\n";
+        }
+    }
+
+public:
+    size_t commits = 0;
+    size_t failed = 0;
+
+    WriteBatch(Database& db, std::ostream& out) : txn(db.begin()), out(out) {}
+
+    void add(size_t line, PendingWrite::Op op, const Student& s) { pending.push_back({line, op, s, ""}); }
+    // A command that failed before reaching the database. It is answered
+    // after the writes above it, to keep the answers in order.
+    void reject(size_t line, const std::string& error) {
+        if (pending.empty()) {
+            write_json_error(out, line, error);
+        } else {
+            pending.push_back({line, PendingWrite::Op::Add, Student(), error});
+        }
+    }
+    size_t size() const { return pending.size(); }
+
+    // Commits everything pending as one transaction. If a write fails, the
+    // ones before it are tried again without it and then the rest, so each
+    // failure costs one more commit. The retry can fail too: in shared
+    // mode it first takes in other processes' writes, which may have taken
+    // a reg_no. A commit the log could not take fails every write in it.
+    // Writes are only answered as done once a commit has taken them.
+    void flush() {
+        size_t begin = 0, end = pending.size();
+        while (begin < pending.size()) {
+            std::vector<size_t> staged;
+            for (size_t i = begin; i < end; i++) {
+                if (pending[i].error.empty()) {
+                    stage(pending[i]);
+                    staged.push_back(i);
+                }
+            }
+            if (staged.empty() || txn.commit()) {
+                if (!staged.empty()) {
+                    commits++;
+                }
+                answer(begin, end);
+                begin = end;
+                end = pending.size();
+            } else if (txn.failed_index() >= staged.size()) {
+                for (size_t i : staged) {
+                    pending[i].error = "cannot write log";
+                }
+                failed += staged.size();
+            } else {
+                // Everything before the failed write was valid in this
+                // order, so on its own it should commit.
+                end = staged[txn.failed_index()];
+                PendingWrite& bad = pending[end];
+                bad.error = bad.op == PendingWrite::Op::Add      ? "duplicate reg_no"
+                            : bad.op == PendingWrite::Op::Update ? "not found or duplicate reg_no"
+                                                                 : "not found";
+                failed++;
+            }
+        }
+        pending.clear();
+    }
+};
+
+// Fills s and op from an add, update or delete command, or explains what
+// is wrong with it.
+static bool parse_write(const std::string& command, const std::vector<std::string>& f, PendingWrite::Op& op,
+                        Student& s, std::string& error) {
+    if (command == "delete") {
+        op = PendingWrite::Op::Delete;
+        if (f.size() != 2 || !parse_id(f[1], s.id)) {
+            error = "usage: delete,<id>";
+            return false;
+        }
+        return true;
+    }
+
+    op = command == "add" ? PendingWrite::Op::Add : PendingWrite::Op::Update;
+    size_t base = op == PendingWrite::Op::Add ? 1 : 2;
+    if (f.size() != base + 4 || (base == 2 && !parse_id(f[1], s.id))) {
+        error = "usage: " + command + (base == 2 ? ",<id>" : "") + ",<name>,<reg_no>,<age>,<major>";
+        return false;
+    }
+    s.name = f[base];
+    s.reg_no = f[base + 1];
+    s.major = f[base + 3];
+    if (s.name.empty() || s.reg_no.empty()) {
+        error = "name and reg_no are required";
+    } else if (!parse_age(f[base + 2], s.age)) {
+        error = "invalid age '" + f[base + 2] + "'";
+    } else if ((s.name + s.reg_no + s.major).find('|') != std::string::npos) {
+        error = "fields may not contain '|'";
+    }
+    return error.empty();
+}
+
+int run_batch(Database& db, const std::string& path, size_t commit_every, const std::string& username,
+              const std::string& password) {
+    auto start = std::chrono::steady_clock::now();
+
+    std::ifstream file;
+    if (path != "-") {
+        file.open(path, std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "Cannot open " << path << std::endl;
+            return 1;
+        }
+    }
+    std::istream& in = path == "-" ? std::cin : file;
+
+    AuthResult auth = db.verify_admin(username, password);
+    if (auth != AuthResult::Ok) {
+        std::cerr << (auth == AuthResult::Throttled ? "Too many login attempts" : "Invalid credentials") << std::endl;
+        return 1;
+    }
+
+    // A write is answered when it commits, and a read commits the writes
+    // above it first, so answers come out in script order.
+    std::ostream& out = std::cout;
+    WriteBatch writes(db, out);
+    std::vector<std::string> f;
+    std::string text;
+    size_t line = 0, commands = 0, errors = 0;
+    while (std::getline(in, text)) {
+        line++;
+        if (!text.empty() && text.back() == '\r') text.pop_back();
+        if (text.empty() || text[0] == '#') continue;
+        commands++;
+
+        if (!split_csv(text.data(), text.data() + text.size(), f)) {
+            writes.reject(line, "unterminated quote");
+            errors++;
+            continue;
+        }
+        std::string command = f[0];
+        std::transform(command.begin(), command.end(), command.begin(), ::tolower);
+        Student s;
+        s.id = 0;
+
+        if (command == "add" || command == "update" || command == "delete") {
+            std::string error;
+            PendingWrite::Op op;
+            if (!parse_write(command, f, op, s, error)) {
+                writes.reject(line, error);
+                errors++;
+                continue;
+            }
+            writes.add(line, op, s);
+            if (commit_every > 0 && writes.size() >= commit_every) {
+                writes.flush();
+            }
+            continue;
+        }
+
+        writes.flush();
+        std::vector<Student> rows;
+        if (command == "get" && f.size() == 2 && parse_id(f[1], s.id)) {
+            std::optional<Student> found = db.get_student(s.id);
+            if (!found) {
+                write_json_error(out, line, "not found");
+                errors++;
+                continue;
+            }
+            rows.push_back(*found);
+        } else if (command == "search" && f.size() <= 2) {
+            rows = db.search_students(f.size() == 2 ? f[1] : "");
+        } else if (command == "list" && f.size() == 1) {
+            db.for_each_student([&rows](const Student& student) { rows.push_back(student); });
+        } else {
+            write_json_error(out, line, "unknown command or wrong number of fields");
+            errors++;
+            continue;
+        }
+
+        out << "{\"line\":" << line << ",\"ok\":true,\"students\":[";
+        for (size_t i = 0; i < rows.size(); i++) {
+            if (i > 0) out << ',';
+            write_json_student(out, rows[i]);
+        }
+        out << "]}\n";
+    }
+    writes.flush();
+    out.flush();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << "Ran " << commands << " command(s), " << errors + writes.failed << " failed, "
+              << writes.commits << " commit(s) in " << static_cast<long>(seconds * 1000) << " ms" << std::endl;
+    return 0;
+}
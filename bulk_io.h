@@ -0,0 +1,37 @@
+#ifndef BULK_IO_H
+#define BULK_IO_H
+
+#include <string>
+#include "database.h"
+
+// Non-interactive bulk transfer in CSV with the columns
+// name,reg_no,age,major. An optional leading id column (as written by
+// export_csv) is ignored on import, as is a header row. Both return a
+// process exit code.
+int import_csv(Database& db, const std::string& path);
+int export_csv(const Database& db, const std::string& path); // "-" for stdout
+
+// Runs a script of commands, one per line in the same CSV quoting:
+//
+//   get,<id>
+//   add,<name>,<reg_no>,<age>,<major>
+//   update,<id>,<name>,<reg_no>,<age>,<major>
+//   delete,<id>
+//   search,<query>
+//   list
+//
+// Blank lines and lines starting with '#' are skipped. username and
+// password are checked once, before anything runs. Each command gets one
+// JSON object on stdout, on its own line and in script order, carrying
+// its line number and either "ok": true with any results or "ok": false
+// and an "error".
+//
+// Writes are held back and committed together as one transaction once
+// commit_every of them are pending (0 for only at the end), and before
+// any read, so reads see every write above them. A write that fails is
+// reported and left out; the ones before it still commit. Reads path, or
+// stdin for "-", and returns a process exit code.
+int run_batch(Database& db, const std::string& path, size_t commit_every, const std::string& username,
+              const std::string& password);
+
+#endif // BULK_IO_H
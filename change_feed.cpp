@@ -0,0 +1,190 @@
+#include "change_feed.h"
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include "metrics.h"
+
+// Splits "<seq>|<record>" into its parts; false for anything else.
+static bool parse_change(const std::string& line, uint64_t& seq, std::string& record) {
+    size_t bar = line.find('|');
+    if (bar == std::string::npos || bar == 0) return false;
+    char* end = nullptr;
+    seq = std::strtoull(line.c_str(), &end, 10);
+    if (end != line.c_str() + bar) return false;
+    record.assign(line, bar + 1, std::string::npos);
+    return true;
+}
+
+ChangeFeed::ChangeFeed(const std::string& path) : path(path), file(nullptr), last(0) {}
+
+ChangeFeed::~ChangeFeed() {
+    close();
+}
+
+bool ChangeFeed::open(uint64_t keep_through) {
+    close();
+
+    // The kept part ends after the last whole change or batch numbered at
+    // most keep_through; a torn last line or batch is never kept.
+    std::uintmax_t keep_bytes = 0, offset = 0;
+    last = 0;
+    {
+        std::ifstream in(path, std::ios::binary);
+        std::string line, record;
+        uint64_t seq = 0;
+        size_t batch_left = 0;
+        while (std::getline(in, line)) {
+            if (in.eof()) break;
+            offset += line.size() + 1;
+            if (line.compare(0, 2, "T|") == 0) {
+                batch_left = std::strtoul(line.c_str() + 2, nullptr, 10);
+                continue;
+            }
+            if (!parse_change(line, seq, record)) continue;
+            if (batch_left > 0 && --batch_left > 0) continue;
+            if (seq > keep_through) break;
+            last = seq;
+            keep_bytes = offset;
+        }
+    }
+
+    std::error_code ec;
+    if (std::filesystem::exists(path, ec) && std::filesystem::file_size(path, ec) > keep_bytes && !ec) {
+        std::filesystem::resize_file(path, keep_bytes, ec);
+        if (ec) {
+            std::cerr << "Cannot truncate change feed: " << ec.message() << std::endl;
+            return false;
+        }
+    }
+    file = std::fopen(path.c_str(), "ab");
+    if (!file) {
+        std::cerr << "Cannot open change feed " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ChangeFeed::restart(uint64_t seq) {
+    close();
+    file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Cannot open change feed " << path << std::endl;
+        return false;
+    }
+    last = seq;
+    return true;
+}
+
+void ChangeFeed::close() {
+    if (!file) return;
+    std::fclose(file);
+    file = nullptr;
+}
+
+bool ChangeFeed::append(const std::string& records, size_t count, bool batch) {
+    if (!file) {
+        return false;
+    }
+
+    // One buffer and one write, so a follower never sees half a batch
+    // framed as a complete one.
+    std::string out;
+    out.reserve(records.size() + count * 12 + 16);
+    if (batch) {
+        out += "T|" + std::to_string(count) + "\n";
+    }
+    size_t start = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t end = records.find('\n', start);
+        out += std::to_string(++last);
+        out += '|';
+        out.append(records, start, end - start + 1);
+        start = end + 1;
+    }
+    if (std::fwrite(out.data(), 1, out.size(), file) != out.size() || std::fflush(file) != 0) {
+        std::cerr << "Cannot append to change feed" << std::endl;
+        return false;
+    }
+    metrics_add_bytes(out.size());
+    return true;
+}
+
+ChangeFeedReader::ChangeFeedReader(const std::string& path, uint64_t after_seq)
+    : path(path), file(nullptr), applied(after_seq), batch_count(0), batch_first(0) {}
+
+ChangeFeedReader::~ChangeFeedReader() {
+    if (file) {
+        std::fclose(file);
+    }
+}
+
+size_t ChangeFeedReader::poll(const Apply& apply) {
+    if (!file) {
+        file = std::fopen(path.c_str(), "rb");
+        if (!file) return 0;
+    }
+
+    // A refused change is read again after reopening, since everything up
+    // to applied is skipped anyway.
+    auto rewind = [this] {
+        std::fclose(file);
+        file = nullptr;
+        partial.clear();
+        batch.clear();
+        batch_count = 0;
+    };
+
+    size_t delivered = 0;
+    char buffer[65536];
+    std::string record;
+    std::vector<std::string> single(1);
+    while (true) {
+        size_t n = std::fread(buffer, 1, sizeof(buffer), file);
+        if (n == 0) {
+            std::clearerr(file); // at the end for now; read on next time
+            return delivered;
+        }
+        size_t start = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (buffer[i] != '\n') continue;
+            partial.append(buffer + start, i - start);
+            start = i + 1;
+            std::string line;
+            line.swap(partial);
+
+            if (line.compare(0, 2, "T|") == 0) {
+                batch_count = std::strtoul(line.c_str() + 2, nullptr, 10);
+                batch.clear();
+                continue;
+            }
+            uint64_t seq;
+            if (!parse_change(line, seq, record)) continue;
+            if (batch_count > 0) {
+                if (batch.empty()) batch_first = seq;
+                batch.push_back(record);
+                if (batch.size() < batch_count) continue;
+                batch_count = 0;
+                if (seq > applied) {
+                    if (!apply(batch_first, batch)) {
+                        rewind();
+                        return delivered;
+                    }
+                    delivered += batch.size();
+                    applied = seq;
+                }
+                batch.clear();
+                continue;
+            }
+            if (seq <= applied) continue; // before the starting point
+            single[0] = record;
+            if (!apply(seq, single)) {
+                rewind();
+                return delivered;
+            }
+            delivered++;
+            applied = seq;
+        }
+        partial.append(buffer + start, n - start);
+    }
+}
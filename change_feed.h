@@ -0,0 +1,86 @@
+#ifndef CHANGE_FEED_H
+#define CHANGE_FEED_H
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Ordered record of every committed change, kept next to the snapshot as
+// students.db.changes for other processes to follow. One line per change,
+// in the write-ahead log's layout prefixed with a sequence number:
+//
+//   <seq>|A|id|name|reg_no|age|major
+//   <seq>|U|id|name|reg_no|age|major
+//   <seq>|D|id
+//   T|count                           the next count changes are one batch
+//
+// Sequence numbers start at 1 and have no gaps. Unlike the log, the feed
+// is not emptied by checkpoints: the snapshot records the last sequence
+// number it includes instead, so a follower can start from a copy of the
+// snapshot and read on from there.
+//
+// The feed is flushed to the OS on every append but never fsynced; the
+// log is what makes changes durable. After a crash the database puts back
+// changes the feed lost from its log, and cuts off any the log lost.
+class ChangeFeed {
+private:
+    std::string path;
+    FILE* file;
+    uint64_t last; // sequence number of the last change in the file
+
+public:
+    explicit ChangeFeed(const std::string& path);
+    ~ChangeFeed();
+    ChangeFeed(const ChangeFeed&) = delete;
+    ChangeFeed& operator=(const ChangeFeed&) = delete;
+
+    // Opens the feed for appending, first cutting off a torn last line or
+    // batch and every change after keep_through. A missing file is
+    // created empty.
+    bool open(uint64_t keep_through = UINT64_MAX);
+    void close();
+    // Empties the feed and numbers the next change seq + 1. Followers
+    // behind seq can then only catch up from a newer copy of the snapshot.
+    bool restart(uint64_t seq);
+
+    // Appends count newline-terminated log records as changes last() + 1
+    // onwards, framed as one batch if batch is set.
+    bool append(const std::string& records, size_t count, bool batch);
+    uint64_t last_seq() const { return last; }
+    // Another process sharing the file has appended changes through seq;
+    // the next append here is numbered after them.
+    void skip_to(uint64_t seq) { last = seq; }
+};
+
+// Follows a feed file as it grows, from a given sequence number on. Works
+// across processes; the file does not need to exist yet.
+class ChangeFeedReader {
+private:
+    std::string path;
+    FILE* file;
+    uint64_t applied;                  // last sequence number delivered
+    std::string partial;               // line still being written
+    std::vector<std::string> batch;    // records of an unfinished batch
+    size_t batch_count;
+    uint64_t batch_first;
+
+public:
+    using Apply = std::function<bool(uint64_t first_seq, const std::vector<std::string>& records)>;
+
+    ChangeFeedReader(const std::string& path, uint64_t after_seq);
+    ~ChangeFeedReader();
+    ChangeFeedReader(const ChangeFeedReader&) = delete;
+    ChangeFeedReader& operator=(const ChangeFeedReader&) = delete;
+
+    // Hands every complete change that has arrived to apply, a single
+    // change or a whole batch per call, with the log records stripped of
+    // their sequence numbers. If apply returns false, polling stops and
+    // the next poll offers that change again. Returns the number of
+    // changes delivered; 0 means nothing new yet.
+    size_t poll(const Apply& apply);
+    uint64_t last_seq() const { return applied; }
+};
+
+#endif // CHANGE_FEED_H
@@ -1,181 +1,1740 @@
-#include "database.h"
-#include <iostream>
-#include <fstream>
-#include <sstream>
-#include <algorithm>
-
-Database::Database(const std::string& path) : db_path(path), next_id(1) {}
-
-Database::~Database() {
-    save_to_file();
-}
-
-void Database::load_from_file() {
-    std::ifstream file(db_path);
-    if (!file.is_open()) {
-        return; // File doesn't exist yet, will be created on save
-    }
-
-    std::string line, section;
-    while (std::getline(file, line)) {
-        if (line.empty() || line[0] == '#') continue;
-        
-        if (line == "[ADMINS]") {
-            section = "admins";
-        } else if (line == "[STUDENTS]") {
-            section = "students";
-        } else if (section == "admins") {
-            size_t pos = line.find(':');
-            if (pos != std::string::npos) {
-                std::string username = line.substr(0, pos);
-                std::string password = line.substr(pos + 1);
-                admins[username] = password;
-            }
-        } else if (section == "students") {
-            std::istringstream iss(line);
-            Student s;
-            char delim;
-            if (iss >> s.id >> delim && std::getline(iss, s.name, '|') &&
-                std::getline(iss, s.reg_no, '|') && iss >> s.age >> delim &&
-                std::getline(iss, s.major)) {
-                students.push_back(s);
-                if (s.id >= next_id) {
-                    next_id = s.id + 1;
-                }
-            }
-        }
-    }
-    file.close();
-}
-
-void Database::save_to_file() {
-    std::ofstream file(db_path);
-    if (!file.is_open()) {
-        std::cerr << "Cannot save database to file" << std::endl;
-        return;
-    }
-
-    file << "# Student Management System Database\n\n";
-    
-    file << "[ADMINS]\n";
-    for (const auto& pair : admins) {
-        file << pair.first << ":" << pair.second << "\n";
-    }
-
-    file << "\n[STUDENTS]\n";
-    for (const auto& s : students) {
-        file << s.id << "|" << s.name << "|" << s.reg_no << "|" 
-             << s.age << "|" << s.major << "\n";
-    }
-
-    file.close();
-}
-
-bool Database::init() {
-    load_from_file();
-    
-    // Add default admin if none exists
-    if (admins.empty()) {
-        admins["admin"] = "admin123";
-        save_to_file();
-        std::cout << "Default admin created: username='admin', password='admin123'" << std::endl;
-    }
-
-    return true;
-}
-
-bool Database::verify_admin(const std::string& username, const std::string& password) {
-    auto it = admins.find(username);
-    return it != admins.end() && it->second == password;
-}
-
-int Database::add_student(const std::string& name, const std::string& reg_no, int age, const std::string& major) {
-    // Check if reg_no already exists
-    for (const auto& s : students) {
-        if (s.reg_no == reg_no) {
-            return -1;
-        }
-    }
-
-    Student s;
-    s.id = next_id++;
-    s.name = name;
-    s.reg_no = reg_no;
-    s.age = age;
-    s.major = major;
-    
-    students.push_back(s);
-    save_to_file();
-    
-    return s.id;
-}
-
-std::vector<Student> Database::get_all_students() {
-    return students;
-}
-
-Student* Database::get_student(int id) {
-    for (auto& s : students) {
-        if (s.id == id) {
-            return new Student(s);
-        }
-    }
-    return nullptr;
-}
-
-bool Database::update_student(int id, const std::string& name, const std::string& reg_no, int age, const std::string& major) {
-    for (auto& s : students) {
-        if (s.id == id) {
-            // Check if new reg_no conflicts with another student
-            for (const auto& other : students) {
-                if (other.id != id && other.reg_no == reg_no) {
-                    return false;
-                }
-            }
-            
-            s.name = name;
-            s.reg_no = reg_no;
-            s.age = age;
-            s.major = major;
-            save_to_file();
-            return true;
-        }
-    }
-    return false;
-}
-
-bool Database::delete_student(int id) {
-    auto it = std::remove_if(students.begin(), students.end(),
-                             [id](const Student& s) { return s.id == id; });
-    
-    if (it != students.end()) {
-        students.erase(it, students.end());
-        save_to_file();
-        return true;
-    }
-    return false;
-}
-
-std::vector<Student> Database::search_students(const std::string& query) {
-    std::vector<Student> results;
-    std::string lower_query = query;
-    std::transform(lower_query.begin(), lower_query.end(), lower_query.begin(), ::tolower);
-    
-    for (const auto& s : students) {
-        std::string name_lower = s.name;
-        std::string reg_no_lower = s.reg_no;
-        std::string major_lower = s.major;
-        
-        std::transform(name_lower.begin(), name_lower.end(), name_lower.begin(), ::tolower);
-        std::transform(reg_no_lower.begin(), reg_no_lower.end(), reg_no_lower.begin(), ::tolower);
-        std::transform(major_lower.begin(), major_lower.end(), major_lower.begin(), ::tolower);
-        
-        if (name_lower.find(lower_query) != std::string::npos ||
-            reg_no_lower.find(lower_query) != std::string::npos ||
-            major_lower.find(lower_query) != std::string::npos) {
-            results.push_back(s);
-        }
-    }
-    
-    return results;
-}
+#include "database.h"
+#include "auth.h"
+#include "fold_search.h"
+#include "metrics.h"
+#include "packed_snapshot.h"
+#include "paged_snapshot.h"
+#include "snapshot.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+
+static std::string format_student(const StudentView& s) {
+    std::string line = std::to_string(s.id);
+    line += '|';
+    line += s.name;
+    line += '|';
+    line += s.reg_no;
+    line += '|';
+    line += std::to_string(s.age);
+    line += '|';
+    line += s.major;
+    return line;
+}
+
+static bool parse_student(const std::string& line, Student& s) {
+    std::istringstream iss(line);
+    char delim;
+    return iss >> s.id >> delim && std::getline(iss, s.name, '|') &&
+           std::getline(iss, s.reg_no, '|') && iss >> s.age >> delim &&
+           std::getline(iss, s.major);
+}
+
+static bool matches_query(const StudentView& s, const std::string& lower_query) {
+    return contains_folded(s.name, lower_query) ||
+           contains_folded(s.reg_no, lower_query) ||
+           contains_folded(s.major, lower_query);
+}
+
+Database::Database(const std::string& path)
+    : db_path(path), next_id(1), wal(path + ".wal"), feed(path + ".changes"), feed_enabled(false),
+      change_seq(0), async_log(false), flush_interval(0), flush_backlog(0), queued(0), taken(0), durable(0),
+      unlogged_count(0), log_failed(false), flush_requested(false), stopping(false), sync_pending(false), shared(false), files(path + ".lock"), checkpoint_threshold(10000), ready(false), lazy_budget(0),
+      id_base(1), id_stride(1), compressed(false), search_cache(256, 1000000) {}
+
+void Database::set_lazy(size_t page_cache_bytes) {
+    lazy_budget = page_cache_bytes;
+}
+
+void Database::set_compressed(bool on) {
+    compressed = on;
+}
+
+void Database::set_id_sequence(int base, int stride) {
+    id_base = base;
+    id_stride = std::max(stride, 1);
+}
+
+void Database::set_search_cache(size_t max_queries, size_t max_ids) {
+    std::unique_lock<RwLock> lock(mutex);
+    search_cache.resize(max_queries, max_ids);
+}
+
+void Database::set_async_log(std::chrono::milliseconds interval, size_t backlog) {
+    async_log = true;
+    flush_interval = std::max(interval, std::chrono::milliseconds(1));
+    flush_backlog = std::max<size_t>(backlog, 1);
+}
+
+void Database::set_shared() {
+    shared = true;
+    feed_enabled = true;
+}
+
+void Database::enable_change_feed() {
+    feed_enabled = true;
+}
+
+// Next id of the form id_base + k * id_stride not below next_id.
+int Database::take_id() {
+    int id = std::max(next_id, id_base);
+    int offset = (id - id_base) % id_stride;
+    if (offset != 0) {
+        id += id_stride - offset;
+    }
+    next_id = id + 1;
+    return id;
+}
+
+Database::~Database() {
+    if (flusher.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(flush_mutex);
+            stopping = true;
+        }
+        flush_wake.notify_one();
+        flusher.join();
+    }
+    // Also takes in whatever async mode still has queued.
+    if (ready) {
+        checkpoint();
+    }
+}
+
+bool Database::load_from_file() {
+    MetricTimer timer(Metric::Load);
+    if (!load_snapshot()) {
+        return false;
+    }
+
+    // Bring the snapshot up to date with mutations made since the last
+    // checkpoint. Each logged record the snapshot does not already hold is
+    // one change after the snapshot's.
+    uint64_t snapshot_seq = change_seq;
+    std::vector<std::string> replayed;
+    bool ok = wal.replay(snapshot_seq, [this, &replayed](const std::string& record) {
+        apply_log_record(record);
+        change_seq++;
+        if (feed_enabled) replayed.push_back(record);
+    });
+    if (!ok || !feed_enabled) {
+        return ok;
+    }
+
+    // The feed is not synced, so after a crash it may be missing changes
+    // the log kept, or hold changes the log lost. The latter are cut off
+    // and the former written again. A feed older than the snapshot cannot
+    // be filled in and starts over from it.
+    if (!feed.open(change_seq)) {
+        return false;
+    }
+    if (feed.last_seq() < snapshot_seq && !feed.restart(snapshot_seq)) {
+        return false;
+    }
+    for (size_t i = feed.last_seq() - snapshot_seq; i < replayed.size(); i++) {
+        if (!feed.append(replayed[i] + "\n", 1, false)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Database::load_snapshot() {
+    if (is_packed_snapshot(db_path)) {
+        return load_packed();
+    }
+    if (!is_binary_snapshot(db_path)) {
+        // Missing, or a text-format file from an older version or an
+        // import; the next checkpoint converts it.
+        load_text(db_path);
+        return true;
+    }
+
+    if (lazy_budget > 0) {
+        base = std::make_unique<PagedSnapshot>(lazy_budget);
+        if (!base->open(db_path)) {
+            std::cerr << "Database file " << db_path << " is corrupt" << std::endl;
+            return false;
+        }
+        for (const auto& admin : base->admins()) {
+            admins[admin.first] = admin.second;
+        }
+        next_id = std::max(next_id, base->next_id());
+        change_seq = base->change_seq();
+        return true;
+    }
+
+    SnapshotReader reader;
+    if (!reader.open(db_path) || !reader.verify()) {
+        std::cerr << "Database file " << db_path << " is corrupt" << std::endl;
+        return false;
+    }
+
+    std::string username, password;
+    for (size_t i = 0; i < reader.admin_count(); i++) {
+        reader.read_admin(i, username, password);
+        admins[username] = password;
+    }
+
+    // Rows are copied from the mapping straight into the table's columns.
+    table.reserve(reader.student_count());
+    id_index.reserve(reader.student_count());
+    reg_index.reserve(reader.student_count());
+    for (size_t i = 0; i < reader.student_count(); i++) {
+        insert_row(reader.student_view(i));
+    }
+    next_id = std::max(next_id, reader.next_id());
+    change_seq = reader.change_seq();
+    return true;
+}
+
+// Blocks are decoded one at a time straight into the table, so only one
+// is ever held in memory.
+bool Database::load_packed() {
+    PackedSnapshotReader reader;
+    if (!reader.open(db_path)) {
+        std::cerr << "Database file " << db_path << " is corrupt" << std::endl;
+        return false;
+    }
+    for (const auto& admin : reader.admins()) {
+        admins[admin.first] = admin.second;
+    }
+    table.reserve(reader.student_count());
+    id_index.reserve(reader.student_count());
+    reg_index.reserve(reader.student_count());
+    if (!reader.read_rows([this](const StudentView& s) { insert_row(s); })) {
+        std::cerr << "Database file " << db_path << " is corrupt" << std::endl;
+        return false;
+    }
+    next_id = std::max(next_id, reader.next_id());
+    change_seq = reader.change_seq();
+    return true;
+}
+
+void Database::load_text(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        return; // File doesn't exist yet, will be created on save
+    }
+
+    std::string line, section;
+    while (std::getline(file, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+        
+        if (line == "[ADMINS]") {
+            section = "admins";
+        } else if (line == "[STUDENTS]") {
+            section = "students";
+        } else if (section == "admins") {
+            size_t pos = line.find(':');
+            if (pos != std::string::npos) {
+                std::string username = line.substr(0, pos);
+                std::string password = line.substr(pos + 1);
+                admins[username] = password;
+            }
+        } else if (section == "students") {
+            Student s;
+            size_t slot;
+            if (parse_student(line, s) && s.id > 0 && !find_slot(s.id, slot)) {
+                insert_row(view_of(s));
+                if (s.id >= next_id) {
+                    next_id = s.id + 1;
+                }
+            }
+        }
+    }
+    file.close();
+
+    // Hand-edited or imported files may list students out of id order;
+    // sorting once here keeps id-range lookups a binary search.
+    if (!table.id_ordered()) {
+        compact();
+    }
+}
+
+// Slots of live rows in ascending id order. Rows are appended with
+// increasing ids, so this only sorts after importing an out-of-order text
+// file.
+static std::vector<size_t> slots_by_id(const StudentTable& table) {
+    std::vector<size_t> slots;
+    slots.reserve(table.size());
+    for (size_t slot = 0; slot < table.slots(); slot++) {
+        if (table.live(slot)) {
+            slots.push_back(slot);
+        }
+    }
+    auto by_id = [&table](size_t a, size_t b) { return table.id(a) < table.id(b); };
+    if (!std::is_sorted(slots.begin(), slots.end(), by_id)) {
+        std::sort(slots.begin(), slots.end(), by_id);
+    }
+    return slots;
+}
+
+// Lazy mode: visits the rows with ids above after_id in ascending id
+// order until visit returns false, taking each row from the table if it is
+// there and from the snapshot otherwise. cache says whether snapshot pages
+// read on the way are kept.
+void Database::visit_rows(int after_id, bool cache, const std::function<bool(const StudentView&)>& visit) const {
+    std::vector<size_t> slots = slots_by_id(table);
+    auto next = std::upper_bound(slots.begin(), slots.end(), after_id,
+                                 [this](int id, size_t slot) { return id < table.id(slot); });
+    for (size_t p = base->page_of(after_id + 1); p < base->page_count(); p++) {
+        std::shared_ptr<const SnapshotPage> page = base->page(p, cache);
+        if (!page) continue;
+        for (size_t i = 0; i < page->records.size(); i++) {
+            int id = page->records[i].id;
+            if (id <= after_id || replaced.count(id)) continue;
+            for (; next != slots.end() && table.id(*next) < id; ++next) {
+                if (!visit(table.view(*next))) return;
+            }
+            if (!visit(page->view(i))) return;
+        }
+    }
+    for (; next != slots.end(); ++next) {
+        if (!visit(table.view(*next))) return;
+    }
+}
+
+bool Database::save_to_file() {
+    MetricTimer timer(Metric::Save);
+    if (compressed && lazy_budget == 0) {
+        return save_packed();
+    }
+    SnapshotWriter writer;
+    for (const auto& pair : admins) {
+        writer.add_admin(pair.first, pair.second);
+    }
+
+    bool ok;
+    if (base) {
+        ok = writer.write(db_path, next_id, change_seq, live_count(), [this](const SnapshotWriter::RowVisitor& emit) {
+            visit_rows(0, false, [&emit](const StudentView& s) {
+                emit(s);
+                return true;
+            });
+        });
+    } else {
+        std::vector<size_t> slots = slots_by_id(table);
+        ok = writer.write(db_path, next_id, change_seq, slots.size(), [this, &slots](const SnapshotWriter::RowVisitor& emit) {
+            for (size_t slot : slots) {
+                emit(table.view(slot));
+            }
+        });
+    }
+    if (!ok) {
+        std::cerr << "Cannot save database to file" << std::endl;
+    }
+    return ok;
+}
+
+bool Database::save_packed() {
+    PackedSnapshotWriter writer;
+    for (const auto& pair : admins) {
+        writer.add_admin(pair.first, pair.second);
+    }
+    std::vector<size_t> slots = slots_by_id(table);
+    bool ok = writer.write(db_path, next_id, change_seq, slots.size(), [this, &slots](const SnapshotWriter::RowVisitor& emit) {
+        for (size_t slot : slots) {
+            emit(table.view(slot));
+        }
+    });
+    if (!ok) {
+        std::cerr << "Cannot save database to file" << std::endl;
+    }
+    return ok;
+}
+
+bool Database::export_text(const std::string& path) const {
+    std::shared_lock<RwLock> lock(mutex);
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    file << "# Student Management System Database\n\n";
+    
+    file << "[ADMINS]\n";
+    for (const auto& pair : admins) {
+        file << pair.first << ":" << pair.second << "\n";
+    }
+
+    file << "\n[STUDENTS]\n";
+    if (base) {
+        visit_rows(0, false, [&file](const StudentView& s) {
+            file << format_student(s) << "\n";
+            return true;
+        });
+    } else {
+        for (size_t slot : slots_by_id(table)) {
+            file << format_student(table.view(slot)) << "\n";
+        }
+    }
+
+    file.close();
+    return static_cast<bool>(file);
+}
+
+void Database::apply_log_record(const std::string& record) {
+    if (record.size() < 2 || record[1] != '|') return;
+
+    // Replay may run over a snapshot that already contains some of these
+    // records (crash between checkpoint and log reset), so every op is
+    // applied as an idempotent put/delete by id.
+    Student s;
+    if (record[0] == 'D') {
+        erase_row(std::atoi(record.c_str() + 2));
+        return;
+    }
+    if ((record[0] != 'A' && record[0] != 'U') || !parse_student(record.substr(2), s) || s.id <= 0) {
+        return;
+    }
+
+    size_t slot;
+    if (claim_row(s.id, slot)) {
+        update_row(slot, view_of(s));
+    } else {
+        insert_row(view_of(s));
+    }
+    if (s.id >= next_id) {
+        next_id = s.id + 1;
+    }
+}
+
+// Called with the table locked, for a row that exists.
+uint64_t Database::row_version(int id) const {
+    auto it = row_versions.find(id);
+    return it == row_versions.end() ? 1 : it->second;
+}
+
+bool Database::find_slot(int id, size_t& slot) const {
+    auto it = id_index.find(id);
+    if (it == id_index.end()) {
+        return false;
+    }
+    slot = it->second;
+    return true;
+}
+
+// Copies out the row with this id, from the table or, in lazy mode, the
+// snapshot.
+bool Database::read_row(int id, Student& out) const {
+    size_t slot;
+    if (find_slot(id, slot)) {
+        table.materialize(slot, out);
+        return true;
+    }
+    return base && !replaced.count(id) && base->find(id, out);
+}
+
+// find_slot() for a row about to change. In lazy mode a row still in the
+// snapshot is first copied into the table, which from then on holds it.
+bool Database::claim_row(int id, size_t& slot) {
+    if (base && !id_index.count(id) && !replaced.count(id)) {
+        Student s;
+        if (base->find(id, s)) {
+            replaced.insert(id);
+            insert_row(view_of(s));
+        }
+    }
+    return find_slot(id, slot);
+}
+
+// Id of the student holding reg_no, or 0 if it is free.
+int Database::reg_owner(std::string_view reg_no) const {
+    auto it = reg_index.find(reg_no);
+    if (it != reg_index.end()) {
+        return it->second;
+    }
+    int id;
+    if (base && base->find_reg_no(reg_no, id) && !replaced.count(id)) {
+        return id;
+    }
+    return 0;
+}
+
+size_t Database::live_count() const {
+    size_t count = id_index.size();
+    if (base) {
+        count += base->student_count() - replaced.size();
+    }
+    return count;
+}
+
+void Database::insert_row(const StudentView& s) {
+    size_t slot = table.append(s);
+    StudentView stored = table.view(slot);
+    id_index[s.id] = slot;
+    reg_index[stored.reg_no] = s.id;
+    trigrams.add(stored);
+    if (fuzzy) fuzzy->add(stored);
+    if (search_cache.size() > 0) search_cache.update(s.id, nullptr, &stored);
+    age_index.add(s.age, s.id);
+    major_index.add(static_cast<int>(table.major_code(slot)), s.id);
+}
+
+void Database::update_row(size_t slot, const StudentView& s) {
+    row_versions.try_emplace(s.id, 1).first->second++;
+    // The old row's bytes stay in the arena until compaction, so before
+    // remains readable after assign().
+    StudentView before = table.view(slot);
+    int before_major = static_cast<int>(table.major_code(slot));
+    table.assign(slot, s);
+    StudentView after = table.view(slot);
+    int after_major = static_cast<int>(table.major_code(slot));
+
+    if (before.reg_no != after.reg_no) {
+        auto reg = reg_index.find(before.reg_no);
+        if (reg != reg_index.end() && reg->second == after.id) {
+            reg_index.erase(reg);
+        }
+        reg_index[after.reg_no] = after.id;
+    }
+    trigrams.update(before, after);
+    if (fuzzy) fuzzy->update(before, after);
+    if (search_cache.size() > 0) search_cache.update(after.id, &before, &after);
+    if (before.age != after.age) {
+        age_index.remove(before.age, after.id);
+        age_index.add(after.age, after.id);
+    }
+    if (before_major != after_major) {
+        major_index.remove(before_major, after.id);
+        major_index.add(after_major, after.id);
+    }
+    compact_if_needed();
+}
+
+bool Database::erase_row(int id) {
+    size_t slot;
+    if (!claim_row(id, slot)) {
+        return false;
+    }
+
+    StudentView s = table.view(slot);
+    auto reg = reg_index.find(s.reg_no);
+    if (reg != reg_index.end() && reg->second == id) {
+        reg_index.erase(reg);
+    }
+    trigrams.remove(s);
+    if (fuzzy) fuzzy->remove(s);
+    if (search_cache.size() > 0) search_cache.update(id, &s, nullptr);
+    age_index.remove(s.age, id);
+    major_index.remove(static_cast<int>(table.major_code(slot)), id);
+    table.erase(slot);
+    id_index.erase(id);
+    compact_if_needed();
+    return true;
+}
+
+// Triggered once dead slots or stale string bytes outweigh live data, which
+// keeps compaction amortized O(1) per delete or update.
+void Database::compact_if_needed() {
+    if (table.needs_compaction()) {
+        compact();
+    }
+}
+
+// Compaction moves every row and its strings, so both indexes are rebuilt.
+void Database::compact() {
+    reg_index.clear();
+    table.compact();
+    for (size_t slot = 0; slot < table.slots(); slot++) {
+        int id = table.id(slot);
+        id_index[id] = slot;
+        reg_index[table.view(slot).reg_no] = id;
+    }
+}
+
+// Called with the table exclusively locked, right after a mutation has been
+// applied. The record is written before the table lock is dropped, so log
+// order always matches apply order and a record that does not make it to
+// the log is refused before any reader has seen its change: false leaves
+// the table locked for the caller to undo it. Readers wait for the write,
+// and for the fsync when group commit makes this append run one, but are
+// let back in before the change is published.
+bool Database::log_mutation(std::unique_lock<RwLock>& lock, const std::string& record) {
+    if (async_log) {
+        enqueue(record + "\n", 1, false);
+        return true;
+    }
+    bool full;
+    {
+        std::lock_guard<std::mutex> log_lock(log_mutex);
+        if (!wal.append(record)) {
+            return false;
+        }
+        lock.unlock();
+        if (wal.pending() > 0) {
+            schedule_sync();
+        }
+        publish(record + "\n", 1, false);
+        full = wal.size() >= checkpoint_threshold;
+    }
+    if (full) {
+        checkpoint();
+    }
+    return true;
+}
+
+// Called with log_mutex held, after an append that left its fsync to the
+// next group commit. The flusher thread does it at the deadline unless a
+// later append gets there first.
+void Database::schedule_sync() {
+    if (!flusher.joinable()) {
+        flusher = std::thread(&Database::run_syncer, this);
+    }
+    std::lock_guard<std::mutex> lock(flush_mutex);
+    if (!sync_pending) {
+        sync_pending = true;
+        sync_deadline = wal.sync_due();
+        flush_wake.notify_one();
+    }
+}
+
+void Database::run_syncer() {
+    std::unique_lock<std::mutex> lock(flush_mutex);
+    while (!stopping) {
+        flush_wake.wait(lock, [this] { return stopping || sync_pending; });
+        flush_wake.wait_until(lock, sync_deadline, [this] { return stopping; });
+        if (stopping) {
+            break; // the destructor's checkpoint syncs what is left
+        }
+        sync_pending = false;
+        // As in run_flusher(), log_mutex is never taken under flush_mutex.
+        lock.unlock();
+        {
+            std::lock_guard<std::mutex> log_lock(log_mutex);
+            wal.sync();
+        }
+        lock.lock();
+    }
+}
+
+// Called with log_mutex held, once the records are in the log, so changes
+// are numbered in log order.
+void Database::publish(const std::string& records, size_t count, bool batch) {
+    change_seq += count;
+    if (feed_enabled) {
+        feed.append(records, count, batch);
+    }
+}
+
+// Called with the table exclusively locked. The lock keeps other writers
+// out until the push is done, so the queue is in apply order; the flusher
+// is only woken early once the backlog is reached, otherwise it comes
+// round on its interval.
+void Database::enqueue(std::string records, size_t count, bool batch) {
+    log_queue.push(LogItem{std::move(records), count, batch});
+    uint64_t before = queued.fetch_add(count, std::memory_order_acq_rel) - durable.load(std::memory_order_acquire);
+    if (before < flush_backlog && before + count >= flush_backlog) {
+        flush_wake.notify_one();
+    }
+}
+
+// Called with log_mutex held. Moves everything queued so far onto
+// unlogged and returns all of unlogged as log lines, with batches framed
+// as append_batch() frames them, and the number of changes they hold.
+size_t Database::drain_queue(std::string& lines) {
+    LogItem item;
+    // A push counts itself only after it is linked, so popping up to the
+    // count never waits on one that is half done.
+    uint64_t target = queued.load(std::memory_order_acquire);
+    while (taken < target) {
+        if (!log_queue.pop(item)) {
+            std::this_thread::yield();
+            continue;
+        }
+        taken += item.count;
+        unlogged_count += item.count;
+        unlogged.push_back(std::move(item));
+    }
+    for (const auto& logged : unlogged) {
+        if (logged.batch) {
+            lines += "T|" + std::to_string(logged.count) + "\n";
+        }
+        lines += logged.records;
+    }
+    return unlogged_count;
+}
+
+// Called with log_mutex held, once the drained changes are on disk.
+void Database::publish_unlogged() {
+    for (const auto& item : unlogged) {
+        publish(item.records, item.count, item.batch);
+    }
+    unlogged.clear();
+    unlogged_count = 0;
+}
+
+// Run on the flusher with log_mutex held. Returns true instead when the
+// queued records would fill the log, so they go into a checkpoint rather
+// than being written twice.
+bool Database::write_queued() {
+    uint64_t waiting = queued.load(std::memory_order_acquire) - taken + unlogged_count;
+    if (waiting == 0) {
+        return false;
+    }
+    if (wal.size() + waiting >= checkpoint_threshold) {
+        return true;
+    }
+    std::string lines;
+    size_t count = drain_queue(lines);
+    if (wal.append_raw(lines, count)) {
+        publish_unlogged();
+        mark_durable();
+    } else {
+        mark_failed();
+    }
+    return false;
+}
+
+// Called with log_mutex held, once everything taken is on disk.
+void Database::mark_durable() {
+    {
+        std::lock_guard<std::mutex> lock(flush_mutex);
+        durable.store(taken, std::memory_order_release);
+        log_failed = false;
+    }
+    flush_done.notify_all();
+}
+
+// Called with log_mutex held when drained changes could not be written.
+// They stay in unlogged for the next pass; flush() gives up now.
+void Database::mark_failed() {
+    {
+        std::lock_guard<std::mutex> lock(flush_mutex);
+        log_failed = true;
+    }
+    flush_done.notify_all();
+}
+
+void Database::run_flusher() {
+    std::unique_lock<std::mutex> lock(flush_mutex);
+    while (!stopping) {
+        flush_wake.wait_for(lock, flush_interval, [this] {
+            return stopping || flush_requested ||
+                   queued.load(std::memory_order_acquire) - durable.load(std::memory_order_acquire) >= flush_backlog;
+        });
+        if (stopping) {
+            break;
+        }
+        flush_requested = false;
+        // Never take log_mutex while holding flush_mutex: mark_durable()
+        // takes them the other way round.
+        lock.unlock();
+        bool full;
+        {
+            std::lock_guard<std::mutex> log_lock(log_mutex);
+            full = write_queued();
+        }
+        if (full) {
+            checkpoint();
+        }
+        lock.lock();
+    }
+}
+
+bool Database::flush() {
+    if (!async_log) {
+        std::lock_guard<std::mutex> log_lock(log_mutex);
+        return wal.sync();
+    }
+    uint64_t target = queued.load(std::memory_order_acquire);
+    std::unique_lock<std::mutex> lock(flush_mutex);
+    flush_requested = true;
+    log_failed = false;
+    flush_wake.notify_one();
+    // A failed write leaves durable where it was and the changes queued
+    // for another try, so this returns false rather than waiting on it.
+    flush_done.wait_for(lock, std::chrono::seconds(10), [this, target] {
+        return log_failed || durable.load(std::memory_order_acquire) >= target;
+    });
+    if (durable.load(std::memory_order_acquire) >= target) {
+        return true;
+    }
+    if (!log_failed) {
+        std::cerr << "Timed out waiting for the write-ahead log" << std::endl;
+    }
+    return false;
+}
+
+// Called with both locks held. Writes the snapshot, taking in whatever
+// async mode still has queued, which is counted into the snapshot and
+// published once it is in place. If that fails, the queued records go to
+// the log instead so they are not lost, or stay queued if they cannot.
+bool Database::save_locked() {
+    std::string lines;
+    size_t count = drain_queue(lines);
+    wal.sync();
+    change_seq += count;
+    bool saved = save_to_file();
+    change_seq -= count;
+    if (saved || count == 0 || wal.append_raw(lines, count)) {
+        publish_unlogged();
+        if (async_log) {
+            mark_durable();
+        }
+    } else {
+        std::cerr << "Cannot write " << count << " queued change(s) to the snapshot or the log" << std::endl;
+        mark_failed();
+    }
+    return saved;
+}
+
+// Shared mode: a write holds the lock from here until its change is
+// logged. Not shared, the lock is empty.
+std::unique_lock<FileLock> Database::lock_files() {
+    return shared ? std::unique_lock<FileLock>(files) : std::unique_lock<FileLock>();
+}
+
+// Shared mode, called with files and the table exclusively locked. The
+// feed also holds this process's own changes, which are skipped; the
+// others' are already in the log, so they are applied and counted but
+// not logged again.
+size_t Database::catch_up() {
+    if (!peers) {
+        return 0;
+    }
+    size_t applied = 0;
+    peers->poll([this, &applied](uint64_t first_seq, const std::vector<std::string>& records) {
+        std::lock_guard<std::mutex> log_lock(log_mutex);
+        if (first_seq + records.size() - 1 <= change_seq) {
+            return true;
+        }
+        if (first_seq != change_seq + 1) {
+            std::cerr << "Change feed skips from " << change_seq << " to " << first_seq << std::endl;
+            return false;
+        }
+        for (const auto& record : records) {
+            apply_log_record(record);
+        }
+        change_seq += records.size();
+        feed.skip_to(change_seq);
+        applied += records.size();
+        return true;
+    });
+    return applied;
+}
+
+size_t Database::refresh() {
+    if (!shared) {
+        return 0;
+    }
+    std::unique_lock<FileLock> files_lock = lock_files();
+    std::unique_lock<RwLock> lock(mutex);
+    return catch_up();
+}
+
+// Readers keep running while the snapshot is written; writers wait. In
+// shared mode the other processes' changes are applied first, so the
+// snapshot holds them too. Swapping files in lazy mode needs the readers
+// out, so there a checkpoint holds the lock exclusively.
+bool Database::checkpoint() {
+    std::unique_lock<FileLock> files_lock = lock_files();
+    if (shared) {
+        std::unique_lock<RwLock> lock(mutex);
+        catch_up();
+    }
+    if (base) {
+        std::unique_lock<RwLock> lock(mutex);
+        std::lock_guard<std::mutex> log_lock(log_mutex);
+        return checkpoint_locked();
+    }
+    std::shared_lock<RwLock> lock(mutex);
+    std::lock_guard<std::mutex> log_lock(log_mutex);
+    return checkpoint_locked();
+}
+
+// Called with the table locked, exclusively in lazy mode, and log_mutex
+// held. The log is only emptied once the snapshot is safely in place; true
+// means it is and the log was started over after it.
+bool Database::checkpoint_locked() {
+    return save_locked() && start_new_log();
+}
+
+// Called as checkpoint_locked() is, once the snapshot is in place. In lazy
+// mode the new snapshot holds every row, so afterwards the table is
+// emptied and reads go to the new file. If it cannot be opened, reads stay
+// on the old one, still open under its replaced name, with the table on
+// top, and false is returned; the next checkpoint tries again.
+bool Database::start_new_log() {
+    if (!wal.reset(change_seq)) {
+        return false;
+    }
+    if (!base) {
+        return true;
+    }
+    auto fresh = std::make_unique<PagedSnapshot>(lazy_budget);
+    if (!fresh->open(db_path)) {
+        std::cerr << "Cannot reopen database file " << db_path << std::endl;
+        return false;
+    }
+    base = std::move(fresh);
+    replaced.clear();
+    table = StudentTable();
+    id_index.clear();
+    reg_index.clear();
+    trigrams.clear();
+    age_index.clear();
+    major_index.clear();
+    return true;
+}
+
+// Called with files and the table exclusively locked and log_mutex held,
+// for a batch already applied that is too big for the log. The batch is
+// counted into the snapshot it is written to, and published only once that
+// snapshot is in place, so followers are never ahead of the disk. Readers
+// wait for the snapshot, unlike in checkpoint(), so that a batch it fails
+// to write can still be undone; they already waited while it was applied.
+bool Database::checkpoint_batch(const std::string& records, size_t count) {
+    change_seq += count;
+    if (!save_locked()) {
+        change_seq -= count;
+        return false;
+    }
+    if (feed_enabled) {
+        feed.append(records, count, true);
+    }
+    // The batch is in the snapshot now, even if the log cannot be started
+    // over; the log then refuses writes until a checkpoint resets it.
+    start_new_log();
+    return true;
+}
+
+bool Database::save() {
+    return checkpoint();
+}
+
+// Queued changes count: they are applied already and will be published
+// in order.
+uint64_t Database::last_change() const {
+    std::lock_guard<std::mutex> log_lock(log_mutex);
+    return change_seq + unlogged_count + (queued.load(std::memory_order_acquire) - taken);
+}
+
+// The records are applied as replay applies the log: as puts and deletes
+// by id, without the checks add and update make, since the database they
+// came from already made them. If they cannot be logged they are undone
+// and false is returned, as for a gap.
+bool Database::apply_changes(uint64_t first_seq, const std::vector<std::string>& records) {
+    if (records.empty()) {
+        return true;
+    }
+    std::unique_lock<RwLock> lock(mutex);
+    uint64_t last = last_change();
+    if (first_seq + records.size() - 1 <= last) {
+        return true;
+    }
+    if (first_seq != last + 1) {
+        return false;
+    }
+
+    std::string joined;
+    std::vector<Undo> undo;
+    int first_id = next_id;
+    for (const auto& record : records) {
+        // Every record starts with its op and the row's id.
+        int id = std::atoi(record.c_str() + std::min<size_t>(record.size(), 2));
+        undo.push_back({id, false, Student(), row_version(id)});
+        undo.back().existed = read_row(id, undo.back().before);
+        apply_log_record(record);
+        joined += record;
+        joined += '\n';
+    }
+    if (records.size() == 1) {
+        if (!log_mutation(lock, records[0])) {
+            undo_changes(undo);
+            next_id = first_id;
+            return false;
+        }
+        return true;
+    }
+    if (async_log) {
+        enqueue(std::move(joined), records.size(), true);
+        return true;
+    }
+
+    bool full;
+    {
+        std::lock_guard<std::mutex> log_lock(log_mutex);
+        if (!wal.append_batch(joined, records.size())) {
+            undo_changes(undo);
+            next_id = first_id;
+            return false;
+        }
+        lock.unlock();
+        publish(joined, records.size(), true);
+        full = wal.size() >= checkpoint_threshold;
+    }
+    if (full) {
+        checkpoint();
+    }
+    return true;
+}
+
+bool Database::init() {
+    std::unique_lock<FileLock> files_lock;
+    if (shared) {
+        async_log = false;
+        if (!files.open()) {
+            return false;
+        }
+        files_lock = lock_files();
+    }
+    if (!load_from_file() || !wal.open()) {
+        return false;
+    }
+    if (shared) {
+        peers = std::make_unique<ChangeFeedReader>(db_path + ".changes", change_seq);
+    }
+    ready = true;
+    if (async_log) {
+        flusher = std::thread(&Database::run_flusher, this);
+    }
+    
+    // Add default admin if none exists
+    if (admins.empty()) {
+        admins["admin"] = hash_password("admin123");
+        checkpoint();
+        std::cout << "Default admin created: username='admin', password='admin123'" << std::endl;
+    }
+
+    // Files from older versions keep plaintext passwords; hash them once
+    // and write them back.
+    bool upgraded = false;
+    for (auto& pair : admins) {
+        if (!is_password_hash(pair.second)) {
+            pair.second = hash_password(pair.second);
+            upgraded = true;
+        }
+    }
+    if (upgraded) {
+        checkpoint();
+    }
+
+    return true;
+}
+
+// The hash runs without the lock held, so a login never stalls queries or
+// writers. Unknown usernames share one limiter bucket and are checked
+// against a dummy hash, which keeps their timing the same as a wrong
+// password.
+AuthResult Database::verify_admin(const std::string& username, const std::string& password) {
+    MetricTimer timer(Metric::Login);
+    std::string stored;
+    bool known;
+    {
+        std::shared_lock<RwLock> lock(mutex);
+        auto it = admins.find(username);
+        known = it != admins.end();
+        if (known) {
+            stored = it->second;
+        }
+    }
+
+    if (!login_limiter.try_acquire(known ? username : std::string())) {
+        return AuthResult::Throttled;
+    }
+    if (!known) {
+        static const std::string dummy = hash_password("");
+        check_password(password, dummy);
+        return AuthResult::Denied;
+    }
+    return check_password(password, stored) ? AuthResult::Ok : AuthResult::Denied;
+}
+
+AuthResult Database::login(const std::string& username, const std::string& password, std::string& token) {
+    AuthResult result = verify_admin(username, password);
+    if (result == AuthResult::Ok) {
+        token = sessions.issue(username);
+    }
+    return result;
+}
+
+bool Database::resume_session(const std::string& token, std::string& username) {
+    return sessions.lookup(token, username);
+}
+
+int Database::add_student(const std::string& name, const std::string& reg_no, int age, const std::string& major) {
+    MetricTimer timer(Metric::Add);
+    std::unique_lock<FileLock> files_lock = lock_files();
+    std::unique_lock<RwLock> lock(mutex);
+    catch_up();
+
+    // Check if reg_no already exists
+    if (reg_owner(reg_no) != 0) {
+        return -1;
+    }
+
+    int first_id = next_id;
+    StudentView s{take_id(), name, reg_no, age, major};
+    insert_row(s);
+    if (!log_mutation(lock, "A|" + format_student(s))) {
+        undo_changes({{s.id, false, Student(), 0}});
+        next_id = first_id;
+        return 0;
+    }
+    
+    return s.id;
+}
+
+size_t Database::add_students(const std::vector<Student>& batch, std::vector<size_t>& rejected) {
+    MetricTimer timer(Metric::AddBatch);
+    std::unique_lock<FileLock> files_lock = lock_files();
+    std::unique_lock<RwLock> lock(mutex);
+    catch_up();
+
+    // A batch big enough to trigger a checkpoint anyway goes straight into
+    // the snapshot instead of through the log.
+    // In async mode the flusher makes that call.
+    bool via_log = async_log;
+    if (!async_log) {
+        std::lock_guard<std::mutex> log_lock(log_mutex);
+        via_log = wal.size() + batch.size() < checkpoint_threshold;
+    }
+    std::string records;
+    size_t added = 0;
+    int first_id = next_id;
+
+    for (size_t i = 0; i < batch.size(); i++) {
+        if (reg_owner(batch[i].reg_no) != 0) {
+            rejected.push_back(i);
+            continue;
+        }
+
+        StudentView s = view_of(batch[i]);
+        s.id = take_id();
+        insert_row(s);
+        added++;
+        if (via_log || feed_enabled) {
+            records += "A|" + format_student(s) + "\n";
+        }
+    }
+
+    if (added > 0) {
+        if (async_log) {
+            enqueue(std::move(records), added, true);
+        } else if (via_log) {
+            std::lock_guard<std::mutex> log_lock(log_mutex);
+            if (!wal.append_batch(records, added)) {
+                // The batch only added rows, all with ids from first_id up.
+                // So does the same undo below.
+                for (int id = first_id; id < next_id; id++) {
+                    erase_row(id);
+                }
+                next_id = first_id;
+                return 0;
+            }
+            lock.unlock();
+            publish(records, added, true);
+        } else {
+            std::lock_guard<std::mutex> log_lock(log_mutex);
+            if (!checkpoint_batch(records, added)) {
+                for (int id = first_id; id < next_id; id++) {
+                    erase_row(id);
+                }
+                next_id = first_id;
+                return 0;
+            }
+        }
+    }
+    return added;
+}
+
+// Called with the table exclusively locked. Rows go back newest change
+// first, at the versions they had, so a version read before the changes
+// still matches after them; an added row's id is handed out again, so its
+// version is dropped with it.
+void Database::undo_changes(const std::vector<Undo>& undo) {
+    for (auto it = undo.rbegin(); it != undo.rend(); ++it) {
+        size_t slot;
+        if (!it->existed) {
+            erase_row(it->id);
+            row_versions.erase(it->id);
+            continue;
+        }
+        if (find_slot(it->id, slot)) {
+            update_row(slot, view_of(it->before));
+        } else {
+            insert_row(view_of(it->before));
+        }
+        row_versions[it->id] = it->version;
+    }
+}
+
+Transaction::Transaction(Database& db) : db(&db), failed(0) {}
+
+void Transaction::add_student(const std::string& name, const std::string& reg_no, int age, const std::string& major) {
+    steps.push_back({Op::Add, Student{0, name, reg_no, age, major}});
+}
+
+void Transaction::update_student(int id, const std::string& name, const std::string& reg_no, int age,
+                                 const std::string& major) {
+    steps.push_back({Op::Update, Student{id, name, reg_no, age, major}});
+}
+
+void Transaction::delete_student(int id) {
+    steps.push_back({Op::Delete, Student{id, "", "", 0, ""}});
+}
+
+bool Transaction::commit() {
+    bool ok = db->commit(steps, ids, failed);
+    steps.clear();
+    return ok;
+}
+
+void Transaction::rollback() {
+    steps.clear();
+}
+
+Transaction Database::begin() {
+    return Transaction(*this);
+}
+
+bool Database::commit(const std::vector<Transaction::Step>& steps, std::vector<int>& ids, size_t& failed) {
+    using Op = Transaction::Op;
+    MetricTimer timer(Metric::Commit);
+    std::unique_lock<FileLock> files_lock = lock_files();
+    std::unique_lock<RwLock> lock(mutex);
+    catch_up();
+    ids.clear();
+    if (steps.empty()) {
+        return true;
+    }
+
+    // Each step that has been applied leaves the row as it was before, so a
+    // failure part way through can put everything back in reverse order.
+    std::vector<Undo> undo;
+    int first_id = next_id;
+    std::string records;
+    size_t i = 0;
+    for (; i < steps.size(); i++) {
+        const Student& s = steps[i].student;
+        size_t slot;
+        if (steps[i].op == Op::Add) {
+            if (reg_owner(s.reg_no) != 0) break;
+            StudentView row = view_of(s);
+            row.id = take_id();
+            insert_row(row);
+            ids.push_back(row.id);
+            undo.push_back({row.id, false, Student(), 0});
+            records += "A|" + format_student(row) + "\n";
+        } else if (steps[i].op == Op::Update) {
+            if (!claim_row(s.id, slot)) break;
+            int owner = reg_owner(s.reg_no);
+            if (owner != 0 && owner != s.id) break;
+            undo.push_back({s.id, true, Student(), row_version(s.id)});
+            table.materialize(slot, undo.back().before);
+            update_row(slot, view_of(s));
+            records += "U|" + format_student(view_of(s)) + "\n";
+        } else {
+            if (!claim_row(s.id, slot)) break;
+            undo.push_back({s.id, true, Student(), row_version(s.id)});
+            table.materialize(slot, undo.back().before);
+            erase_row(s.id);
+            records += "D|" + std::to_string(s.id) + "\n";
+        }
+    }
+
+    if (i < steps.size()) {
+        undo_changes(undo);
+        next_id = first_id;
+        ids.clear();
+        failed = i;
+        return false;
+    }
+
+    if (async_log) {
+        enqueue(std::move(records), steps.size(), true);
+        return true;
+    }
+
+    // As in add_students(), a batch that would fill the log goes straight
+    // into a checkpoint.
+    std::lock_guard<std::mutex> log_lock(log_mutex);
+    bool logged;
+    if (wal.size() + steps.size() < checkpoint_threshold) {
+        logged = wal.append_batch(records, steps.size());
+        if (logged) {
+            lock.unlock();
+            publish(records, steps.size(), true);
+        }
+    } else {
+        logged = checkpoint_batch(records, steps.size());
+    }
+    if (!logged) {
+        undo_changes(undo);
+        next_id = first_id;
+        ids.clear();
+        failed = steps.size();
+        return false;
+    }
+    return true;
+}
+
+std::optional<Student> Database::get_student(int id) const {
+    MetricTimer timer(Metric::Get);
+    std::shared_lock<RwLock> lock(mutex);
+    Student s;
+    if (read_row(id, s)) {
+        return s;
+    }
+    return std::nullopt;
+}
+
+std::optional<Student> Database::get_student(int id, uint64_t& version) const {
+    MetricTimer timer(Metric::Get);
+    std::shared_lock<RwLock> lock(mutex);
+    Student s;
+    if (read_row(id, s)) {
+        version = row_version(id);
+        return s;
+    }
+    return std::nullopt;
+}
+
+void Database::for_each_student(const std::function<void(const Student&)>& visit) const {
+    std::shared_lock<RwLock> lock(mutex);
+    Student s;
+    if (base) {
+        visit_rows(0, false, [&](const StudentView& row) {
+            materialize(row, s);
+            visit(s);
+            return true;
+        });
+        return;
+    }
+    for (size_t slot = 0; slot < table.slots(); slot++) {
+        if (table.live(slot)) {
+            table.materialize(slot, s);
+            visit(s);
+        }
+    }
+}
+
+void Database::for_each_student_in_major(const std::string& major,
+                                         const std::function<void(const Student&)>& visit) const {
+    std::shared_lock<RwLock> lock(mutex);
+    Student s;
+    if (base) {
+        visit_rows(0, false, [&](const StudentView& row) {
+            if (row.major == major) {
+                materialize(row, s);
+                visit(s);
+            }
+            return true;
+        });
+        return;
+    }
+
+    uint32_t code;
+    if (!table.find_major(major, code)) {
+        return;
+    }
+
+    for (size_t slot = 0; slot < table.slots(); slot++) {
+        if (table.major_code(slot) == code && table.live(slot)) {
+            table.materialize(slot, s);
+            visit(s);
+        }
+    }
+}
+
+std::vector<Student> Database::students_after(int after_id, size_t page_size) const {
+    StudentQuery query;
+    query.min_id = after_id + 1;
+    query.limit = page_size;
+
+    std::vector<Student> page;
+    page.reserve(page_size);
+    Student s;
+    StudentCursor cursor = this->query(query);
+    while (cursor.next(s)) {
+        page.push_back(s);
+    }
+    return page;
+}
+
+int Database::find_reg_no(const std::string& reg_no) const {
+    std::shared_lock<RwLock> lock(mutex);
+    return reg_owner(reg_no);
+}
+
+size_t Database::student_count() const {
+    std::shared_lock<RwLock> lock(mutex);
+    return live_count();
+}
+
+size_t Database::memory_usage() const {
+    std::shared_lock<RwLock> lock(mutex);
+    return table.memory_usage();
+}
+
+bool Database::update_student(int id, const std::string& name, const std::string& reg_no, int age, const std::string& major) {
+    bool stale;
+    return update_student(id, name, reg_no, age, major, 0, stale);
+}
+
+// version 0 skips the check.
+bool Database::update_student(int id, const std::string& name, const std::string& reg_no, int age,
+                              const std::string& major, uint64_t version, bool& stale) {
+    MetricTimer timer(Metric::Update);
+    std::unique_lock<FileLock> files_lock = lock_files();
+    std::unique_lock<RwLock> lock(mutex);
+    catch_up();
+    size_t slot;
+    stale = false;
+    if (!claim_row(id, slot)) {
+        stale = version != 0;
+        return false;
+    }
+    if (version != 0 && row_version(id) != version) {
+        stale = true;
+        return false;
+    }
+
+    // Check if new reg_no conflicts with another student
+    int owner = reg_owner(reg_no);
+    if (owner != 0 && owner != id) {
+        return false;
+    }
+
+    StudentView after{id, name, reg_no, age, major};
+    Undo undo{id, true, Student(), row_version(id)};
+    table.materialize(slot, undo.before);
+    update_row(slot, after);
+    if (!log_mutation(lock, "U|" + format_student(after))) {
+        undo_changes({undo});
+        return false;
+    }
+    return true;
+}
+
+bool Database::delete_student(int id) {
+    bool stale;
+    return delete_student(id, 0, stale);
+}
+
+bool Database::delete_student(int id, uint64_t version, bool& stale) {
+    MetricTimer timer(Metric::Delete);
+    std::unique_lock<FileLock> files_lock = lock_files();
+    std::unique_lock<RwLock> lock(mutex);
+    catch_up();
+    stale = false;
+    if (version != 0) {
+        Student s;
+        if (!read_row(id, s) || row_version(id) != version) {
+            stale = true;
+            return false;
+        }
+    }
+    Undo undo{id, true, Student(), row_version(id)};
+    if (!read_row(id, undo.before) || !erase_row(id)) {
+        return false;
+    }
+    if (!log_mutation(lock, "D|" + std::to_string(id))) {
+        undo_changes({undo});
+        return false;
+    }
+    return true;
+}
+
+std::vector<Student> Database::search_students(const std::string& query) const {
+    MetricTimer timer(Metric::Search);
+    std::shared_lock<RwLock> lock(mutex);
+    std::vector<Student> results;
+    std::string lower_query = query;
+    std::transform(lower_query.begin(), lower_query.end(), lower_query.begin(), fold_ascii);
+
+    // No writer can run while the shared lock is held, so a result cached
+    // here matches the rows it is stored against. Writers then keep it up
+    // to date.
+    if (!search_cache.enabled()) {
+        search_rows(lower_query, results);
+        return results;
+    }
+    std::vector<int> ids;
+    bool hit;
+    {
+        std::lock_guard<std::mutex> cache_lock(cache_mutex);
+        hit = search_cache.find(lower_query, ids);
+    }
+    metrics_query_cache_access(hit);
+    if (hit) {
+        results.resize(ids.size());
+        for (size_t i = 0; i < ids.size(); i++) {
+            read_row(ids[i], results[i]);
+        }
+        return results;
+    }
+
+    search_rows(lower_query, results);
+    ids.reserve(results.size());
+    for (const auto& s : results) {
+        ids.push_back(s.id);
+    }
+    std::lock_guard<std::mutex> cache_lock(cache_mutex);
+    search_cache.insert(lower_query, ids);
+    return results;
+}
+
+void Database::search_rows(const std::string& lower_query, std::vector<Student>& results) const {
+    // The trigram index only covers rows in the table, so in lazy mode
+    // every row is checked, straight from the pages.
+    if (base) {
+        visit_rows(0, false, [&](const StudentView& row) {
+            if (matches_query(row, lower_query)) {
+                results.emplace_back();
+                materialize(row, results.back());
+            }
+            return true;
+        });
+        return;
+    }
+
+    // Only the index's candidates need the substring check; queries too
+    // short to form a trigram fall back to checking every row.
+    std::vector<int> ids;
+    if (trigrams.candidates(lower_query, ids)) {
+        size_t slot;
+        for (int id : ids) {
+            if (find_slot(id, slot) && matches_query(table.view(slot), lower_query)) {
+                results.emplace_back();
+                table.materialize(slot, results.back());
+            }
+        }
+        return;
+    }
+
+    for (size_t slot = 0; slot < table.slots(); slot++) {
+        if (table.live(slot) && matches_query(table.view(slot), lower_query)) {
+            results.emplace_back();
+            table.materialize(slot, results.back());
+        }
+    }
+    // Slots are nearly in id order; rows put back by a rolled back delete
+    // land at the end.
+    auto by_id = [](const Student& a, const Student& b) { return a.id < b.id; };
+    if (!std::is_sorted(results.begin(), results.end(), by_id)) {
+        std::sort(results.begin(), results.end(), by_id);
+    }
+}
+
+std::vector<ScoredStudent> Database::search_ranked(const std::string& query, size_t k) const {
+    MetricTimer timer(Metric::SearchRanked);
+    std::shared_lock<RwLock> lock(mutex);
+    {
+        std::lock_guard<std::mutex> build_lock(fuzzy_mutex);
+        if (!fuzzy) {
+            auto index = std::make_unique<FuzzyIndex>();
+            if (base) {
+                visit_rows(0, false, [&index](const StudentView& s) {
+                    index->add(s);
+                    return true;
+                });
+            } else {
+                for (size_t slot = 0; slot < table.slots(); slot++) {
+                    if (table.live(slot)) index->add(table.view(slot));
+                }
+            }
+            fuzzy = std::move(index);
+        }
+    }
+
+    std::vector<ScoredStudent> results;
+    for (const SearchHit& hit : fuzzy->search(query, k)) {
+        results.emplace_back();
+        results.back().score = hit.score;
+        read_row(hit.id, results.back().student);
+    }
+    return results;
+}
+
+StudentCursor::StudentCursor(RwLock& mutex, const StudentTable& table, const StudentQuery& query)
+    : lock(mutex), table(&table),
+      min_id(query.min_id.value_or(std::numeric_limits<int>::min())),
+      max_id(query.max_id.value_or(std::numeric_limits<int>::max())),
+      min_age(query.min_age.value_or(std::numeric_limits<int>::min())),
+      max_age(query.max_age.value_or(std::numeric_limits<int>::max())),
+      by_major(query.major.has_value()), major_code(0), use_range(true), range_begin(0),
+      range_end(table.slots()), use_rows(false), descending(query.descending), pos(0), skip(query.offset),
+      remaining(query.limit > 0 ? query.limit : std::numeric_limits<size_t>::max()),
+      plan_name("scan") {}
+
+bool StudentCursor::accepts(size_t slot) const {
+    int id = table->id(slot);
+    int age = table->age(slot);
+    return table->live(slot) && id >= min_id && id <= max_id && age >= min_age && age <= max_age &&
+           (!by_major || table->major_code(slot) == major_code);
+}
+
+bool StudentCursor::next(Student& out) {
+    if (use_rows) {
+        while (remaining > 0 && pos < rows.size()) {
+            if (skip > 0) {
+                skip--;
+                pos++;
+                continue;
+            }
+            out = rows[pos++];
+            remaining--;
+            return true;
+        }
+        return false;
+    }
+
+    size_t count = use_range ? range_end - range_begin : slots.size();
+    while (remaining > 0 && pos < count) {
+        size_t slot;
+        if (use_range) {
+            slot = descending ? range_end - 1 - pos : range_begin + pos;
+        } else {
+            slot = slots[pos];
+        }
+        pos++;
+
+        if (!accepts(slot)) continue;
+        if (skip > 0) {
+            skip--;
+            continue;
+        }
+        table->materialize(slot, out);
+        remaining--;
+        return true;
+    }
+    return false;
+}
+
+// Lazy mode has no age or major index over the snapshot, so the matches
+// are gathered with one pass in id order. Paging forward by id stops as
+// soon as the page is full.
+void Database::query_lazy(const StudentQuery& query, StudentCursor& cursor) const {
+    cursor.use_rows = true;
+    cursor.plan_name = "lazy";
+    bool by_age_order = query.order == StudentQuery::Order::Age;
+    size_t wanted = std::numeric_limits<size_t>::max();
+    if (!by_age_order && !query.descending && query.limit > 0) {
+        wanted = query.offset + query.limit;
+    }
+
+    int after_id = cursor.min_id == std::numeric_limits<int>::min() ? 0 : cursor.min_id - 1;
+    std::vector<Student>& rows = cursor.rows;
+    visit_rows(std::max(after_id, 0), false, [&](const StudentView& s) {
+        if (s.id > cursor.max_id) return false;
+        if (s.age >= cursor.min_age && s.age <= cursor.max_age && (!query.major || s.major == *query.major)) {
+            rows.emplace_back();
+            materialize(s, rows.back());
+        }
+        return rows.size() < wanted;
+    });
+
+    if (by_age_order) {
+        std::stable_sort(rows.begin(), rows.end(),
+                         [](const Student& a, const Student& b) { return a.age < b.age; });
+    }
+    if (query.descending) {
+        std::reverse(rows.begin(), rows.end());
+    }
+}
+
+StudentCursor Database::query(const StudentQuery& query) const {
+    MetricTimer timer(Metric::Query);
+    StudentCursor cursor(mutex, table, query);
+    if (base) {
+        query_lazy(query, cursor);
+        return cursor;
+    }
+    if (cursor.by_major && !table.find_major(*query.major, cursor.major_code)) {
+        cursor.range_end = 0; // no student has that major
+        return cursor;
+    }
+
+    // Estimate how many rows each access path would visit and take the
+    // smallest. On a tie, an index that already yields the requested order
+    // wins, since its rows need no sorting.
+    enum class Path { Scan, Id, Age, Major };
+    Path path = Path::Scan;
+    size_t best = table.slots();
+    bool by_age_order = query.order == StudentQuery::Order::Age;
+
+    if ((query.min_id || query.max_id) && table.id_ordered()) {
+        size_t begin = table.lower_bound(cursor.min_id);
+        size_t end = cursor.max_id == std::numeric_limits<int>::max() ? table.slots()
+                                                                     : table.lower_bound(cursor.max_id + 1);
+        end = std::max(begin, end);
+        if (end - begin <= best) {
+            path = Path::Id;
+            best = end - begin;
+            cursor.range_begin = begin;
+            cursor.range_end = end;
+        }
+    }
+    if (query.min_age || query.max_age || by_age_order) {
+        size_t estimate = age_index.count(cursor.min_age, cursor.max_age);
+        if (estimate < best || (estimate == best && by_age_order)) {
+            path = Path::Age;
+            best = estimate;
+        }
+    }
+    if (cursor.by_major) {
+        size_t estimate = major_index.count(static_cast<int>(cursor.major_code),
+                                            static_cast<int>(cursor.major_code));
+        if (estimate < best || (estimate == best && !by_age_order)) {
+            path = Path::Major;
+            best = estimate;
+        }
+    }
+
+    // A slot range in id order can be streamed as is; every other path
+    // turns into a list of slots to put in order first.
+    if ((path == Path::Scan || path == Path::Id) && table.id_ordered() && !by_age_order) {
+        cursor.plan_name = path == Path::Id ? "id" : "scan";
+        return cursor;
+    }
+
+    cursor.use_range = false;
+    std::vector<size_t>& slots = cursor.slots;
+    if (path == Path::Age || path == Path::Major) {
+        std::vector<int> ids;
+        ids.reserve(best);
+        if (path == Path::Age) {
+            age_index.collect(cursor.min_age, cursor.max_age, ids);
+        } else {
+            major_index.collect(static_cast<int>(cursor.major_code), static_cast<int>(cursor.major_code), ids);
+        }
+        slots.reserve(ids.size());
+        size_t slot;
+        for (int id : ids) {
+            if (find_slot(id, slot) && cursor.accepts(slot)) {
+                slots.push_back(slot);
+            }
+        }
+        cursor.plan_name = path == Path::Age ? "age" : "major";
+    } else {
+        for (size_t slot = cursor.range_begin; slot < cursor.range_end; slot++) {
+            if (cursor.accepts(slot)) {
+                slots.push_back(slot);
+            }
+        }
+        cursor.plan_name = path == Path::Id ? "id" : "scan";
+    }
+
+    auto by_id = [this](size_t a, size_t b) { return table.id(a) < table.id(b); };
+    auto by_age = [this](size_t a, size_t b) {
+        return table.age(a) != table.age(b) ? table.age(a) < table.age(b) : table.id(a) < table.id(b);
+    };
+    if (by_age_order) {
+        if (!std::is_sorted(slots.begin(), slots.end(), by_age)) {
+            std::sort(slots.begin(), slots.end(), by_age);
+        }
+    } else if (!std::is_sorted(slots.begin(), slots.end(), by_id)) {
+        std::sort(slots.begin(), slots.end(), by_id);
+    }
+    if (query.descending) {
+        std::reverse(slots.begin(), slots.end());
+    }
+    return cursor;
+}
@@ -1,34 +1,407 @@
-#ifndef DATABASE_H
-#define DATABASE_H
-
-#include <string>
-#include <vector>
-#include <map>
-#include "student.h"
-
-class Database {
-private:
-    std::string db_path;
-    std::map<std::string, std::string> admins; // username -> password
-    std::vector<Student> students;
-    int next_id;
-
-    void load_from_file();
-    void save_to_file();
-
-public:
-    Database(const std::string& path);
-    ~Database();
-
-    bool init();
-    bool verify_admin(const std::string& username, const std::string& password);
-    
-    int add_student(const std::string& name, const std::string& reg_no, int age, const std::string& major);
-    std::vector<Student> get_all_students();
-    Student* get_student(int id);
-    bool update_student(int id, const std::string& name, const std::string& reg_no, int age, const std::string& major);
-    bool delete_student(int id);
-    std::vector<Student> search_students(const std::string& query);
-};
-
-#endif // DATABASE_H
+#ifndef DATABASE_H
+#define DATABASE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include "auth.h"
+#include "change_feed.h"
+#include "file_lock.h"
+#include "fuzzy_index.h"
+#include "mpsc_queue.h"
+#include "paged_snapshot.h"
+#include "query_cache.h"
+#include "rw_lock.h"
+#include "sorted_index.h"
+#include "student.h"
+#include "student_table.h"
+#include "trigram_index.h"
+#include "wal.h"
+
+// AND of equality and range predicates over the indexed fields. Bounds
+// are inclusive and unset fields do not filter. Results come back in id or
+// age order (age ties broken by id), skipping offset matches and returning
+// at most limit of them (0 for no limit).
+struct StudentQuery {
+    std::optional<int> min_id, max_id;
+    std::optional<int> min_age, max_age;
+    std::optional<std::string> major; // exact match
+
+    enum class Order { Id, Age };
+    Order order = Order::Id;
+    bool descending = false;
+    size_t offset = 0;
+    size_t limit = 0;
+};
+
+// Streams the rows matching a StudentQuery, materializing one per next().
+// The cursor holds a shared lock on the database until it is destroyed, so
+// the thread using it must not modify the database in the meantime.
+class StudentCursor {
+private:
+    friend class Database;
+
+    std::shared_lock<RwLock> lock;
+    const StudentTable* table;
+    int min_id, max_id, min_age, max_age;
+    bool by_major;
+    uint32_t major_code;
+    // Rows are visited either straight from the table's slot range
+    // [range_begin, range_end) or from slots, already in output order.
+    // In lazy mode they are copied out into rows instead, filtered and in
+    // output order.
+    bool use_range;
+    size_t range_begin, range_end;
+    std::vector<size_t> slots;
+    bool use_rows;
+    std::vector<Student> rows;
+    bool descending;
+    size_t pos;
+    size_t skip, remaining;
+    const char* plan_name;
+
+    StudentCursor(RwLock& mutex, const StudentTable& table, const StudentQuery& query);
+    bool accepts(size_t slot) const;
+
+public:
+    StudentCursor(StudentCursor&&) = default;
+
+    bool next(Student& out);
+    // Which access path the planner chose: "scan", "id", "age", "major",
+    // or "lazy" for a database opened with set_lazy().
+    const char* plan() const { return plan_name; }
+};
+
+class Database;
+
+// A search_ranked() result; see FuzzyIndex for how score is made up.
+struct ScoredStudent {
+    Student student;
+    float score;
+};
+
+enum class AuthResult { Ok, Denied, Throttled };
+
+// A batch of adds, updates and deletes that commit together: either all of
+// them are applied and logged with one write and one fsync, or none is.
+// Operations are only recorded until commit(), so the database does not
+// see them before then. A Transaction is not itself thread-safe.
+class Transaction {
+private:
+    friend class Database;
+
+    enum class Op { Add, Update, Delete };
+    struct Step {
+        Op op;
+        Student student;
+    };
+
+    Database* db;
+    std::vector<Step> steps;
+    std::vector<int> ids;
+    size_t failed;
+
+    explicit Transaction(Database& db);
+
+public:
+    void add_student(const std::string& name, const std::string& reg_no, int age, const std::string& major);
+    void update_student(int id, const std::string& name, const std::string& reg_no, int age, const std::string& major);
+    void delete_student(int id);
+    size_t size() const { return steps.size(); }
+
+    // Applies the operations in order under one exclusive lock. If any of
+    // them would fail on its own (duplicate reg_no, unknown id), the ones
+    // before it are undone, nothing is logged, and failed_index() says
+    // which one it was; if the log cannot be written, all of them are
+    // undone and failed_index() is the number of operations. Either way the transaction is empty afterwards and
+    // can be reused.
+    bool commit();
+    // Drops the operations recorded since begin() or the last commit.
+    void rollback();
+
+    // Ids given to the adds of the last successful commit, in order.
+    const std::vector<int>& added_ids() const { return ids; }
+    size_t failed_index() const { return failed; }
+};
+
+// Thread-safe: reads share a lock, writers take it exclusively only while
+// changing the in-memory table and do their log I/O after releasing it.
+class Database {
+private:
+    friend class Transaction;
+
+    std::string db_path;
+    mutable RwLock mutex; // guards the table, indexes and admins
+    mutable std::mutex log_mutex; // guards wal, feed, change_seq and taken; always taken after mutex
+    std::map<std::string, std::string> admins; // username -> password hash
+    StudentTable table;
+    std::unordered_map<int, size_t> id_index; // id -> slot in table
+    std::unordered_map<std::string_view, int> reg_index; // reg_no (viewed in table) -> id
+    TrigramIndex trigrams; // substring search over name, reg_no, major
+    SortedIndex age_index;
+    SortedIndex major_index; // keyed by the table's major code
+    int next_id;
+    WriteAheadLog wal;
+    ChangeFeed feed;
+    bool feed_enabled;
+    uint64_t change_seq; // changes published since the database was created
+    // Async mode: writers push their log records onto log_queue while they
+    // still hold the table lock, so queue order is apply order, and return.
+    // The flusher thread writes them out. Counts are in changes: queued
+    // ever pushed, taken ever popped (under log_mutex), durable ever
+    // synced to the log or checkpointed.
+    struct LogItem {
+        std::string records; // newline-terminated log records
+        size_t count;
+        bool batch;
+    };
+    MpscQueue<LogItem> log_queue;
+    bool async_log;
+    std::chrono::milliseconds flush_interval;
+    size_t flush_backlog;
+    std::atomic<uint64_t> queued;
+    uint64_t taken;
+    std::atomic<uint64_t> durable;
+    // Taken off the queue but not yet in the log, oldest first, with
+    // unlogged_count changes in all. Every pass writes them again, ahead of
+    // anything newer, and they are only published once they are on disk.
+    // log_failed (under flush_mutex) says the last attempt failed.
+    std::vector<LogItem> unlogged;
+    size_t unlogged_count;
+    bool log_failed;
+    std::mutex flush_mutex; // only for sleeping and waking
+    std::condition_variable flush_wake, flush_done;
+    bool flush_requested, stopping;
+    // Sync mode: the flusher only runs the fsyncs the log left for later,
+    // at sync_deadline. It is started by the first such append.
+    bool sync_pending;
+    std::chrono::steady_clock::time_point sync_deadline;
+    std::thread flusher;
+    // Shared mode: other processes use the same files. Every write holds
+    // files from applying their changes, read from the feed through peers,
+    // to logging its own; taken before mutex.
+    bool shared;
+    FileLock files;
+    std::unique_ptr<ChangeFeedReader> peers;
+    // Versions of rows updated since they were loaded; any other row is at
+    // version 1. Entries outlive deleted rows, whose ids are not handed out
+    // again; undo_changes() puts back the versions a failed change moved.
+    std::unordered_map<int, uint64_t> row_versions;
+    size_t checkpoint_threshold; // WAL records before compacting into db_path
+    bool ready; // loaded successfully; safe to checkpoint over db_path
+    LoginLimiter login_limiter;
+    SessionCache sessions;
+    // Lazy mode: rows not in the table are read from base on demand. A row
+    // that changes is first copied into the table and its id added to
+    // replaced, so base is only consulted for ids the table never had.
+    size_t lazy_budget; // page cache bytes; 0 loads the whole snapshot
+    std::unique_ptr<PagedSnapshot> base;
+    std::unordered_set<int> replaced;
+    int id_base, id_stride; // ids handed out are id_base + k * id_stride
+    bool compressed; // checkpoints write a PackedSnapshot
+    // Built by the first ranked search, which holds only a shared lock, so
+    // building is serialized by fuzzy_mutex. Kept up to date by writers.
+    mutable std::mutex fuzzy_mutex;
+    mutable std::unique_ptr<FuzzyIndex> fuzzy;
+    // Readers fill the cache under a shared lock, so they take cache_mutex;
+    // writers hold the lock exclusively and invalidate without it.
+    mutable std::mutex cache_mutex;
+    mutable QueryCache search_cache;
+
+    bool load_from_file();
+    bool load_snapshot();
+    bool load_packed();
+    bool save_packed();
+    void load_text(const std::string& path);
+    bool save_to_file();
+    void apply_log_record(const std::string& record);
+    bool log_mutation(std::unique_lock<RwLock>& lock, const std::string& record);
+    void publish(const std::string& records, size_t count, bool batch);
+    void enqueue(std::string records, size_t count, bool batch);
+    size_t drain_queue(std::string& lines);
+    void publish_unlogged();
+    bool write_queued();
+    void mark_durable();
+    void mark_failed();
+    void run_flusher();
+    void schedule_sync();
+    void run_syncer();
+    bool save_locked();
+    std::unique_lock<FileLock> lock_files();
+    size_t catch_up();
+    uint64_t row_version(int id) const;
+    bool checkpoint();
+    bool checkpoint_locked();
+    bool start_new_log();
+    bool checkpoint_batch(const std::string& records, size_t count);
+
+    // A row as it was before a change: missing (the change added it) or
+    // its old values and version.
+    struct Undo {
+        int id;
+        bool existed;
+        Student before;
+        uint64_t version;
+    };
+    void undo_changes(const std::vector<Undo>& undo);
+    bool commit(const std::vector<Transaction::Step>& steps, std::vector<int>& ids, size_t& failed);
+
+    int take_id();
+    bool find_slot(int id, size_t& slot) const;
+    bool read_row(int id, Student& out) const;
+    bool claim_row(int id, size_t& slot);
+    int reg_owner(std::string_view reg_no) const;
+    size_t live_count() const;
+    void visit_rows(int after_id, bool cache, const std::function<bool(const StudentView&)>& visit) const;
+    void query_lazy(const StudentQuery& query, StudentCursor& cursor) const;
+    void search_rows(const std::string& lower_query, std::vector<Student>& results) const;
+    void insert_row(const StudentView& s);
+    void update_row(size_t slot, const StudentView& s);
+    bool erase_row(int id);
+    void compact_if_needed();
+    void compact();
+
+public:
+    Database(const std::string& path);
+    ~Database();
+
+    // Call before init(): keeps the snapshot on disk and reads it a page at
+    // a time through a cache of at most page_cache_bytes, instead of
+    // loading every row. Startup then costs the header and admins only.
+    // Searches and scans read the file as they go, and the first add or
+    // update reads every reg_no once to check uniqueness.
+    void set_lazy(size_t page_cache_bytes);
+    // Call before init(): checkpoints write the compressed format of
+    // packed_snapshot.h, which is smaller but has to be decoded in full on
+    // load. Either format is read whatever the setting. Lazy mode pages
+    // through fixed-width records, so it loads a compressed file in full
+    // and keeps writing the plain format.
+    void set_compressed(bool on);
+    // Call before init(): new ids are taken only from base, base + stride,
+    // base + 2 * stride, ..., so several databases can share one id space.
+    void set_id_sequence(int base, int stride);
+    // Keeps the results of up to max_queries recent searches, holding at
+    // most max_ids ids in all; 0 turns the cache off. The default is 256
+    // queries and a million ids.
+    void set_search_cache(size_t max_queries, size_t max_ids = 1000000);
+    // Call before init(): writes return as soon as memory is updated and
+    // their log records are queued; a background thread writes the queue
+    // to the log with one write and one fsync at least every interval, or
+    // sooner once backlog changes are waiting, and runs the checkpoints.
+    // A crash loses at most what was still queued; flush() waits for it.
+    void set_async_log(std::chrono::milliseconds interval, size_t backlog);
+    // Call before init(): lets several processes open the database at
+    // once. Each write locks students.db.lock, applies the changes the
+    // others have made since this process last looked (read incrementally
+    // from the change feed, which this turns on), and only then checks and
+    // logs its own. Checkpoints do the same, so the snapshot never drops
+    // another process's changes. The log is written synchronously here;
+    // set_async_log() is ignored.
+    void set_shared();
+    // Shared mode: applies the changes other processes have made since the
+    // last write or refresh, so reads see them. Returns how many there were.
+    size_t refresh();
+    // Call before init(): appends every committed change to a ChangeFeed
+    // in <path>.changes, for followers in other processes.
+    void enable_change_feed();
+    bool init();
+    // Checks a password against its salted hash. Each username may only
+    // try a few times in a burst before being throttled.
+    AuthResult verify_admin(const std::string& username, const std::string& password);
+    // verify_admin() that also opens a session; the token lets later
+    // requests authenticate through resume_session() without hashing.
+    AuthResult login(const std::string& username, const std::string& password, std::string& token);
+    bool resume_session(const std::string& token, std::string& username);
+    // Writes a fresh snapshot and empties the log, as a checkpoint does.
+    // False if the snapshot could not be written, the log could not be
+    // started over after it, or, in lazy mode, it could not be reopened.
+    bool save();
+    // Returns once every change made before the call is on disk: queued
+    // changes are written and the log is synced. False on an I/O error.
+    bool flush();
+
+    // Sequence number of the last committed change; see ChangeFeed.
+    uint64_t last_change() const;
+    // Applies changes read from another database's feed, numbered from
+    // first_seq, and logs them as this database's own. Changes it already
+    // has are skipped. Returns false if first_seq leaves a gap after
+    // last_change(); the records are then not applied.
+    bool apply_changes(uint64_t first_seq, const std::vector<std::string>& records);
+
+    // students.db is stored as a binary snapshot; this writes the older
+    // human-readable text format, which init() still accepts on load.
+    bool export_text(const std::string& path) const;
+
+    // Returns the new id, -1 if reg_no is taken, or 0 if the change could
+    // not be logged, in which case it is undone. Updates and deletes that
+    // cannot be logged are undone too, and return false.
+    int add_student(const std::string& name, const std::string& reg_no, int age, const std::string& major);
+    // Adds every row of batch whose reg_no is not taken, by the table or by
+    // an earlier row of the batch, and commits them with a single write.
+    // The ids in batch are ignored. Positions of rows skipped as duplicates
+    // are appended to rejected. Returns the number of rows added, which is
+    // 0 with fewer rows rejected than the batch holds if the batch could
+    // not be logged.
+    size_t add_students(const std::vector<Student>& batch, std::vector<size_t>& rejected);
+    Transaction begin();
+
+    // get_student returns a copy, since another thread may change the row
+    // as soon as the lock is released. The scans hold a shared lock for
+    // their whole run and materialize each row into one reused Student, so
+    // the visitor must copy anything it keeps and must not call back into
+    // methods that modify the database.
+    std::optional<Student> get_student(int id) const;
+    // Also gives the row's version, which starts at 1 and goes up with
+    // every update this process makes or, in shared mode, applies from
+    // another. Versions are only comparable within one process.
+    std::optional<Student> get_student(int id, uint64_t& version) const;
+    void for_each_student(const std::function<void(const Student&)>& visit) const;
+    // Exact match on major; scans only the dictionary-coded major column.
+    void for_each_student_in_major(const std::string& major,
+                                   const std::function<void(const Student&)>& visit) const;
+    // Cursor-based paging in id order: up to page_size students with ids
+    // greater than after_id, copied out so the lock is not held while the
+    // caller works through the page. Pass 0 for the first page and the
+    // last id of a page for the next; an empty page means the end.
+    std::vector<Student> students_after(int after_id, size_t page_size) const;
+    size_t student_count() const;
+    // Approximate heap bytes held by the in-memory table (see
+    // StudentTable::memory_usage()), without the indexes or a lazy
+    // database's page cache.
+    size_t memory_usage() const;
+    // Id of the student with this reg_no, or 0 if there is none.
+    int find_reg_no(const std::string& reg_no) const;
+
+    bool update_student(int id, const std::string& name, const std::string& reg_no, int age, const std::string& major);
+    bool delete_student(int id);
+    // Optimistic variants: version is the one get_student() gave with the
+    // row. If the row has been changed or deleted since, by this process or
+    // another, nothing is written and stale is set.
+    bool update_student(int id, const std::string& name, const std::string& reg_no, int age, const std::string& major,
+                        uint64_t version, bool& stale);
+    bool delete_student(int id, uint64_t version, bool& stale);
+    // Results come back in id order. Repeated queries are answered from a
+    // cache of recent results, which writers keep up to date.
+    std::vector<Student> search_students(const std::string& query) const;
+    // Up to k students ranked by how well their name and major match the
+    // words of query, tolerating typos and partial words; best first. The
+    // first call builds the word index with one pass over the rows.
+    std::vector<ScoredStudent> search_ranked(const std::string& query, size_t k) const;
+
+    // Picks whichever of the id range, age index and major index narrows
+    // the query most and filters the other predicates row by row.
+    StudentCursor query(const StudentQuery& query) const;
+};
+
+#endif // DATABASE_H
@@ -0,0 +1,83 @@
+#include "file_lock.h"
+#include <cerrno>
+#include <iostream>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/file.h>
+    #include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+FileLock::FileLock(const std::string& path) : path(path), depth(0), handle(INVALID_HANDLE_VALUE) {}
+
+FileLock::~FileLock() {
+    if (handle != INVALID_HANDLE_VALUE) {
+        CloseHandle(handle);
+    }
+}
+
+bool FileLock::open() {
+    handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                         OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        std::cerr << "Cannot open lock file " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void FileLock::lock() {
+    mutex.lock();
+    if (depth++ == 0 && handle != INVALID_HANDLE_VALUE) {
+        OVERLAPPED whole = {};
+        LockFileEx(handle, LOCKFILE_EXCLUSIVE_LOCK, 0, MAXDWORD, MAXDWORD, &whole);
+    }
+}
+
+void FileLock::unlock() {
+    if (--depth == 0 && handle != INVALID_HANDLE_VALUE) {
+        OVERLAPPED whole = {};
+        UnlockFileEx(handle, 0, MAXDWORD, MAXDWORD, &whole);
+    }
+    mutex.unlock();
+}
+
+#else
+
+FileLock::FileLock(const std::string& path) : path(path), depth(0), fd(-1) {}
+
+FileLock::~FileLock() {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+bool FileLock::open() {
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "Cannot open lock file " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void FileLock::lock() {
+    mutex.lock();
+    if (depth++ == 0 && fd >= 0) {
+        while (flock(fd, LOCK_EX) != 0 && errno == EINTR) {
+        }
+    }
+}
+
+void FileLock::unlock() {
+    if (--depth == 0 && fd >= 0) {
+        flock(fd, LOCK_UN);
+    }
+    mutex.unlock();
+}
+
+#endif
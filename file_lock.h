@@ -0,0 +1,37 @@
+#ifndef FILE_LOCK_H
+#define FILE_LOCK_H
+
+#include <mutex>
+#include <string>
+
+// Exclusive lock shared between processes, held on a lock file next to the
+// database (flock on POSIX, LockFileEx on Windows). Threads of one process
+// also take it one at a time, and a thread that holds it may take it
+// again; the file lock is released when the outermost unlock() runs.
+//
+// Satisfies BasicLockable, so it works with std::unique_lock.
+class FileLock {
+private:
+    std::string path;
+    std::recursive_mutex mutex;
+    int depth; // nested lock() calls by the holding thread
+#ifdef _WIN32
+    void* handle;
+#else
+    int fd;
+#endif
+
+public:
+    explicit FileLock(const std::string& path);
+    ~FileLock();
+    FileLock(const FileLock&) = delete;
+    FileLock& operator=(const FileLock&) = delete;
+
+    // Creates the lock file if it is missing. Until it is open, lock()
+    // only excludes other threads.
+    bool open();
+    void lock();
+    void unlock();
+};
+
+#endif // FILE_LOCK_H
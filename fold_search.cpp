@@ -0,0 +1,212 @@
+#include "fold_search.h"
+#include <cstdint>
+#include <cstring>
+
+// SSE2 is part of the x86-64 baseline; AVX2 is detected at runtime.
+#if defined(__GNUC__) && defined(__x86_64__)
+    #define FOLD_SEARCH_X86 1
+    #include <immintrin.h>
+#endif
+
+// Bytes between the first and last of the query, which the vector filter
+// has not already compared.
+static bool middle_matches(const char* text, std::string_view lower_query) {
+    for (size_t j = 1; j + 1 < lower_query.size(); j++) {
+        if (fold_ascii(text[j]) != lower_query[j]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Fallback for targets without a vector kernel.
+static bool contains_scalar(std::string_view text, std::string_view lower_query) {
+    char first = lower_query.front();
+    char last = lower_query.back();
+    size_t k = lower_query.size();
+    for (size_t i = 0; i + k <= text.size(); i++) {
+        if (fold_ascii(text[i]) == first && fold_ascii(text[i + k - 1]) == last &&
+            middle_matches(text.data() + i, lower_query)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#ifdef FOLD_SEARCH_X86
+// Vector kernels: fold the block of text starting at i and the block
+// starting at i + k - 1 in registers, compare them against the query's
+// first and last byte, and only check the middle of the query at positions
+// where both ends matched. The last partial block is loaded so that it ends
+// at the end of the text, overlapping positions already scanned, which are
+// masked off. Text shorter than a single block is copied to the stack.
+//
+// Folding adds 0x80 - 'A' so that 'A'..'Z' land on the 26 smallest signed
+// bytes; one signed compare then selects exactly the upper-case letters.
+
+static inline const char* pad_block(const char* from, size_t n, char* out, size_t width) {
+    std::memcpy(out, from, n);
+    std::memset(out + n, 0, width - n);
+    return out;
+}
+
+// Checks the candidate positions in mask, bit j standing for text[base + j].
+static inline bool verify_candidates(uint32_t mask, const char* base, std::string_view lower_query) {
+    while (mask != 0) {
+        if (middle_matches(base + __builtin_ctz(mask), lower_query)) {
+            return true;
+        }
+        mask &= mask - 1;
+    }
+    return false;
+}
+
+static inline __m128i fold_sse2(__m128i bytes) {
+    __m128i shifted = _mm_add_epi8(bytes, _mm_set1_epi8(static_cast<char>(0x80 - 'A')));
+    __m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(static_cast<char>(-128 + 26)), shifted);
+    return _mm_or_si128(bytes, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+static inline uint32_t candidates_sse2(const char* a, const char* b, __m128i first, __m128i last) {
+    __m128i fa = fold_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a)));
+    __m128i fb = fold_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b)));
+    return static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(fa, first), _mm_cmpeq_epi8(fb, last))));
+}
+
+static bool contains_sse2(std::string_view text, std::string_view lower_query) {
+    const size_t width = 16;
+    const char* data = text.data();
+    size_t k = lower_query.size();
+    size_t starts = text.size() - k + 1; // positions a match can start at
+    const __m128i first = _mm_set1_epi8(lower_query.front());
+    const __m128i last = _mm_set1_epi8(lower_query.back());
+
+    if (starts < width) {
+        char block_a[width], block_b[width];
+        uint32_t mask = candidates_sse2(pad_block(data, starts, block_a, width),
+                                        pad_block(data + k - 1, starts, block_b, width), first, last);
+        return verify_candidates(mask & ((1u << starts) - 1), data, lower_query);
+    }
+
+    size_t i = 0;
+    for (; i + width <= starts; i += width) {
+        if (verify_candidates(candidates_sse2(data + i, data + i + k - 1, first, last), data + i, lower_query)) {
+            return true;
+        }
+    }
+    if (i == starts) {
+        return false;
+    }
+    size_t tail = starts - width;
+    uint32_t mask = candidates_sse2(data + tail, data + tail + k - 1, first, last);
+    return verify_candidates(mask & ~((1u << (i - tail)) - 1), data + tail, lower_query);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i fold_avx2(__m256i bytes) {
+    __m256i shifted = _mm256_add_epi8(bytes, _mm256_set1_epi8(static_cast<char>(0x80 - 'A')));
+    __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(-128 + 26)), shifted);
+    return _mm256_or_si256(bytes, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+
+__attribute__((target("avx2")))
+static inline uint32_t candidates_avx2(const char* a, const char* b, __m256i first, __m256i last) {
+    __m256i fa = fold_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a)));
+    __m256i fb = fold_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b)));
+    return static_cast<uint32_t>(
+        _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(fa, first), _mm256_cmpeq_epi8(fb, last))));
+}
+
+__attribute__((target("avx2")))
+static bool contains_avx2(std::string_view text, std::string_view lower_query) {
+    const size_t width = 32;
+    const char* data = text.data();
+    size_t k = lower_query.size();
+    size_t starts = text.size() - k + 1;
+
+    const __m256i first = _mm256_set1_epi8(lower_query.front());
+    const __m256i last = _mm256_set1_epi8(lower_query.back());
+    size_t i = 0;
+    for (; i + width <= starts; i += width) {
+        if (verify_candidates(candidates_avx2(data + i, data + i + k - 1, first, last), data + i, lower_query)) {
+            return true;
+        }
+    }
+    if (i == starts) {
+        return false;
+    }
+    size_t tail = starts - width;
+    uint32_t mask = candidates_avx2(data + tail, data + tail + k - 1, first, last);
+    return verify_candidates(mask & ~((1u << (i - tail)) - 1), data + tail, lower_query);
+}
+#endif
+
+static FoldSearchKernel choose_kernel() {
+#ifdef FOLD_SEARCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return {contains_avx2, "avx2"};
+    }
+    return {contains_sse2, "sse2"};
+#else
+    return {contains_scalar, "scalar"};
+#endif
+}
+
+static const FoldSearchKernel& active_kernel() {
+    static const FoldSearchKernel kernel = choose_kernel();
+    return kernel;
+}
+
+bool contains_folded(std::string_view text, std::string_view lower_query) {
+    if (lower_query.empty()) {
+        return true;
+    }
+    if (lower_query.size() > text.size()) {
+        return false;
+    }
+#ifdef FOLD_SEARCH_X86
+    // Most names and reg_nos fit in one 16-byte block. Those skip the
+    // dispatch and the wider kernel, whose single partial block would have
+    // to go through the stack copy.
+    if (text.size() - lower_query.size() + 1 < 32) {
+        return contains_sse2(text, lower_query);
+    }
+#endif
+    return active_kernel().contains(text, lower_query);
+}
+
+const char* fold_search_kernel() {
+    return active_kernel().name;
+}
+
+// The kernels assume a non-empty query no longer than the text, and the
+// AVX2 one at least a block of starting positions; these check first.
+template <bool (*Kernel)(std::string_view, std::string_view), size_t MinStarts>
+static bool checked(std::string_view text, std::string_view lower_query) {
+    if (lower_query.empty()) {
+        return true;
+    }
+    if (lower_query.size() > text.size()) {
+        return false;
+    }
+#ifdef FOLD_SEARCH_X86
+    if (text.size() - lower_query.size() + 1 < MinStarts) {
+        return contains_sse2(text, lower_query);
+    }
+#endif
+    return Kernel(text, lower_query);
+}
+
+std::vector<FoldSearchKernel> fold_search_kernels() {
+    std::vector<FoldSearchKernel> kernels = {{checked<contains_scalar, 0>, "scalar"}};
+#ifdef FOLD_SEARCH_X86
+    kernels.push_back({checked<contains_sse2, 0>, "sse2"});
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.push_back({checked<contains_avx2, 32>, "avx2"});
+    }
+#endif
+    return kernels;
+}
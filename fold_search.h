@@ -0,0 +1,35 @@
+#ifndef FOLD_SEARCH_H
+#define FOLD_SEARCH_H
+
+#include <string_view>
+#include <vector>
+
+// ASCII case folding, matching ::tolower in the "C" locale.
+inline char fold_ascii(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+// True if text contains lower_query, comparing case-insensitively. The
+// query must already be folded with fold_ascii; text is folded as it is
+// scanned, without copying. An empty query matches everything.
+//
+// On x86 the scan runs 16 or 32 bytes at a time with SSE2 or AVX2, picked
+// once at startup from what the CPU supports; elsewhere it is a scalar
+// loop.
+bool contains_folded(std::string_view text, std::string_view lower_query);
+
+// Name of the implementation contains_folded() dispatches to.
+const char* fold_search_kernel();
+
+struct FoldSearchKernel {
+    bool (*contains)(std::string_view text, std::string_view lower_query);
+    const char* name;
+};
+
+// Every implementation in this build that the CPU can run, each with the
+// same contract as contains_folded(), for benchmarks and differential
+// checks. Texts too short for one AVX2 block go to the SSE2 kernel, as in
+// contains_folded().
+std::vector<FoldSearchKernel> fold_search_kernels();
+
+#endif // FOLD_SEARCH_H
@@ -0,0 +1,273 @@
+#include "fuzzy_index.h"
+#include <algorithm>
+#include <cctype>
+
+static const float NAME_WEIGHT = 1.0f;
+static const float MAJOR_WEIGHT = 0.4f;
+// A short prefix can cover a large part of the dictionary; only this many
+// of its words, in alphabetical order, are expanded.
+static const size_t PREFIX_TERMS = 256;
+
+static bool has_digit(const std::string& word) {
+    return std::any_of(word.begin(), word.end(), [](char c) { return c >= '0' && c <= '9'; });
+}
+
+static size_t max_typos(const std::string& word) {
+    if (has_digit(word) || word.size() < 3) return 0;
+    return word.size() < 6 ? 1 : 2;
+}
+
+size_t bounded_edit_distance(std::string_view a, std::string_view b, size_t bound) {
+    if (a.size() > b.size()) std::swap(a, b);
+    if (b.size() - a.size() > bound) return bound + 1;
+
+    // Two rows of the DP table, indexed by position in a.
+    size_t row[64], next[64];
+    std::vector<size_t> big_row, big_next;
+    size_t* prev = row;
+    size_t* cur = next;
+    if (a.size() + 1 > 64) {
+        big_row.resize(a.size() + 1);
+        big_next.resize(a.size() + 1);
+        prev = big_row.data();
+        cur = big_next.data();
+    }
+    for (size_t i = 0; i <= a.size(); i++) {
+        prev[i] = i;
+    }
+    for (size_t j = 1; j <= b.size(); j++) {
+        cur[0] = j;
+        size_t lowest = cur[0];
+        for (size_t i = 1; i <= a.size(); i++) {
+            size_t cost = a[i - 1] == b[j - 1] ? 0 : 1;
+            cur[i] = std::min({prev[i] + 1, cur[i - 1] + 1, prev[i - 1] + cost});
+            lowest = std::min(lowest, cur[i]);
+        }
+        if (lowest > bound) return bound + 1;
+        std::swap(prev, cur);
+    }
+    return std::min(prev[a.size()], bound + 1);
+}
+
+void FuzzyIndex::tokenize(std::string_view text, std::vector<std::string>& out) {
+    out.clear();
+    std::string word;
+    for (char c : text) {
+        if (std::isalnum(static_cast<unsigned char>(c))) {
+            word += fold_ascii(c);
+        } else if (!word.empty()) {
+            out.push_back(std::move(word));
+            word.clear();
+        }
+    }
+    if (!word.empty()) {
+        out.push_back(std::move(word));
+    }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+void FuzzyIndex::insert_term(const std::string& term) {
+    if (has_digit(term)) {
+        return;
+    }
+    if (tree.empty()) {
+        tree.push_back(Node{term, {}});
+        return;
+    }
+    size_t node = 0;
+    while (true) {
+        size_t longest = std::max(term.size(), tree[node].term.size());
+        uint32_t d = static_cast<uint32_t>(bounded_edit_distance(term, tree[node].term, longest));
+        if (d == 0) return;
+        auto child = std::find_if(tree[node].children.begin(), tree[node].children.end(),
+                                  [d](const std::pair<uint32_t, uint32_t>& c) { return c.first == d; });
+        if (child == tree[node].children.end()) {
+            tree[node].children.emplace_back(d, static_cast<uint32_t>(tree.size()));
+            tree.push_back(Node{term, {}});
+            return;
+        }
+        node = child->second;
+    }
+}
+
+void FuzzyIndex::add_words(std::string_view text, int slot, bool major) {
+    std::vector<std::string> words;
+    tokenize(text, words);
+    for (const auto& word : words) {
+        auto it = terms.find(word);
+        if (it == terms.end()) {
+            it = terms.emplace(word, Postings()).first;
+            insert_term(word);
+        }
+        (major ? it->second.major_slots : it->second.name_slots).insert(slot);
+    }
+}
+
+void FuzzyIndex::remove_words(std::string_view text, int slot, bool major) {
+    std::vector<std::string> words;
+    tokenize(text, words);
+    for (const auto& word : words) {
+        auto it = terms.find(word);
+        if (it == terms.end()) continue;
+        (major ? it->second.major_slots : it->second.name_slots).erase(slot);
+        if (it->second.name_slots.empty() && it->second.major_slots.empty()) {
+            terms.erase(it);
+        }
+    }
+}
+
+void FuzzyIndex::add(const StudentView& s) {
+    auto [it, added] = slot_of.try_emplace(s.id, 0);
+    if (added) {
+        if (free_slots.empty()) {
+            it->second = static_cast<int>(slot_ids.size());
+            slot_ids.push_back(s.id);
+        } else {
+            it->second = free_slots.back();
+            free_slots.pop_back();
+            slot_ids[it->second] = s.id;
+        }
+    }
+    add_words(s.name, it->second, false);
+    add_words(s.major, it->second, true);
+}
+
+void FuzzyIndex::remove(const StudentView& s) {
+    auto it = slot_of.find(s.id);
+    if (it == slot_of.end()) {
+        return;
+    }
+    remove_words(s.name, it->second, false);
+    remove_words(s.major, it->second, true);
+    slot_ids[it->second] = 0;
+    free_slots.push_back(it->second);
+    slot_of.erase(it);
+}
+
+void FuzzyIndex::update(const StudentView& before, const StudentView& after) {
+    auto it = slot_of.find(after.id);
+    if (it == slot_of.end()) {
+        add(after);
+        return;
+    }
+    if (before.name != after.name) {
+        remove_words(before.name, it->second, false);
+        add_words(after.name, it->second, false);
+    }
+    if (before.major != after.major) {
+        remove_words(before.major, it->second, true);
+        add_words(after.major, it->second, true);
+    }
+}
+
+void FuzzyIndex::clear() {
+    terms.clear();
+    tree.clear();
+    slot_of.clear();
+    slot_ids.clear();
+    free_slots.clear();
+}
+
+void FuzzyIndex::match_term(const std::string& word, std::vector<std::pair<const Postings*, float>>& out) const {
+    out.clear();
+    auto exact = terms.find(word);
+    if (exact != terms.end()) {
+        out.emplace_back(&exact->second, 1.0f);
+    }
+
+    size_t expanded = 0;
+    for (auto it = terms.upper_bound(word); it != terms.end() && expanded < PREFIX_TERMS; ++it, expanded++) {
+        if (it->first.compare(0, word.size(), word) != 0) break;
+        float covered = static_cast<float>(word.size()) / static_cast<float>(it->first.size());
+        out.emplace_back(&it->second, 0.7f + 0.3f * covered);
+    }
+
+    size_t typos = max_typos(word);
+    if (typos == 0 || tree.empty()) {
+        return;
+    }
+    // Triangle inequality: with d the distance to a node, only children at
+    // distance d - typos to d + typos can be within typos of the word. A
+    // node's distance is only needed exactly up to its furthest child.
+    std::vector<uint32_t> stack = {0};
+    while (!stack.empty()) {
+        const Node& node = tree[stack.back()];
+        stack.pop_back();
+        size_t furthest = 0;
+        for (const auto& child : node.children) {
+            furthest = std::max<size_t>(furthest, child.first);
+        }
+        size_t d = bounded_edit_distance(word, node.term, typos + furthest);
+        if (d >= 1 && d <= typos) {
+            auto it = terms.find(node.term);
+            if (it != terms.end()) {
+                out.emplace_back(&it->second, 0.6f - 0.2f * static_cast<float>(d - 1));
+            }
+        }
+        for (const auto& child : node.children) {
+            if (child.first + typos >= d && child.first <= d + typos) {
+                stack.push_back(child.second);
+            }
+        }
+    }
+}
+
+static bool ranks_before(const SearchHit& a, const SearchHit& b) {
+    return a.score != b.score ? a.score > b.score : a.id < b.id;
+}
+
+std::vector<SearchHit> FuzzyIndex::search(const std::string& query, size_t k) const {
+    std::vector<SearchHit> hits;
+    std::vector<std::string> words;
+    tokenize(query, words);
+    if (words.empty() || k == 0) {
+        return hits;
+    }
+
+    // Scores live in arrays indexed by slot, reused between searches on the
+    // same thread; only the entries a search touched are reset afterwards.
+    thread_local std::vector<float> total, best;
+    if (total.size() < slot_ids.size()) {
+        total.resize(slot_ids.size(), 0.0f);
+        best.resize(slot_ids.size(), 0.0f);
+    }
+    std::vector<int> matched, word_matched;
+    std::vector<std::pair<const Postings*, float>> postings;
+
+    for (const auto& word : words) {
+        match_term(word, postings);
+        auto score = [&](const PostingList& slots, float value) {
+            slots.for_each([&](int slot) {
+                if (best[slot] == 0.0f) word_matched.push_back(slot);
+                best[slot] = std::max(best[slot], value);
+            });
+        };
+        for (const auto& p : postings) {
+            score(p.first->name_slots, p.second * NAME_WEIGHT);
+            score(p.first->major_slots, p.second * MAJOR_WEIGHT);
+        }
+        for (int slot : word_matched) {
+            if (total[slot] == 0.0f) matched.push_back(slot);
+            total[slot] += best[slot];
+            best[slot] = 0.0f;
+        }
+        word_matched.clear();
+    }
+
+    // Heap of the best k so far, with the weakest on top.
+    for (int slot : matched) {
+        SearchHit hit{slot_ids[slot], total[slot]};
+        total[slot] = 0.0f;
+        if (hits.size() < k) {
+            hits.push_back(hit);
+            std::push_heap(hits.begin(), hits.end(), ranks_before);
+        } else if (ranks_before(hit, hits.front())) {
+            std::pop_heap(hits.begin(), hits.end(), ranks_before);
+            hits.back() = hit;
+            std::push_heap(hits.begin(), hits.end(), ranks_before);
+        }
+    }
+    std::sort_heap(hits.begin(), hits.end(), ranks_before);
+    return hits;
+}
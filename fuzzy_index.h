@@ -0,0 +1,80 @@
+#ifndef FUZZY_INDEX_H
+#define FUZZY_INDEX_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "fold_search.h"
+#include "posting_list.h"
+#include "student.h"
+
+struct SearchHit {
+    int id;
+    float score;
+};
+
+// Ranked, typo-tolerant search over the words of name and major. Words are
+// split on anything that is not a letter or digit and case-folded. Each
+// query word is scored against each row by its best matching word there:
+//
+//   exact          1.0
+//   prefix         0.7 to 1.0, more as the query covers more of the word
+//   1 or 2 typos   0.6 or 0.4 (Levenshtein distance)
+//
+// times the field's weight (name 1.0, major 0.4). A row's score is the sum
+// over the query words, and search() keeps the best k in a heap.
+//
+// Typos are allowed once a word has 3 letters (one typo) or 6 (two), and
+// found through a BK-tree over the dictionary. Words containing digits
+// match exactly or by prefix only, so a million numbered names do not
+// swamp the tree.
+//
+// Posting lists hold row slots rather than ids: each row gets the lowest
+// free slot while it is in the index, so search() can score rows in arrays
+// as long as the rows indexed, however high or sparse the ids are.
+class FuzzyIndex {
+private:
+    struct Postings {
+        PostingList name_slots;
+        PostingList major_slots;
+    };
+    // BK-tree node: every child's term is at edit distance `first` from
+    // this node's term. Nodes of words no longer used stay in the tree and
+    // are skipped by search.
+    struct Node {
+        std::string term;
+        std::vector<std::pair<uint32_t, uint32_t>> children; // distance, node index
+    };
+
+    std::map<std::string, Postings> terms;
+    std::vector<Node> tree;
+    std::unordered_map<int, int> slot_of; // id -> slot
+    std::vector<int> slot_ids;            // slot -> id, 0 while free
+    std::vector<int> free_slots;
+
+    static void tokenize(std::string_view text, std::vector<std::string>& out);
+    void add_words(std::string_view text, int slot, bool major);
+    void remove_words(std::string_view text, int slot, bool major);
+    void insert_term(const std::string& term);
+    void match_term(const std::string& word, std::vector<std::pair<const Postings*, float>>& out) const;
+
+public:
+    void add(const StudentView& s);
+    void remove(const StudentView& s);
+    void update(const StudentView& before, const StudentView& after);
+    void clear();
+
+    // At most k hits, best first; equal scores go to the lower id.
+    std::vector<SearchHit> search(const std::string& query, size_t k) const;
+    size_t term_count() const { return terms.size(); }
+};
+
+// Levenshtein distance between a and b if it is at most bound, otherwise
+// bound + 1. Gives up as soon as a whole row of the table exceeds bound.
+size_t bounded_edit_distance(std::string_view a, std::string_view b, size_t bound);
+
+#endif // FUZZY_INDEX_H
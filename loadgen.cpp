@@ -0,0 +1,275 @@
+// Load generator for student_manager --serve.
+//
+//   student_loadgen [--addr=127.0.0.1:7878] [--connections=4] [--depth=16]
+//                   [--seconds=10] [--ids=1000] [--search-pct=10]
+//
+// Each connection keeps `depth` pipelined requests in flight: GET of a
+// random id in [1, ids], or SEARCH of a random 3-digit fragment for
+// search-pct percent of requests. Reports requests per second and latency
+// percentiles measured from send to the end of the response.
+//
+// Unless the server runs with --anonymous-reads, set STUDENT_PASSWORD (and
+// STUDENT_USER, default admin) so each connection logs in first.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+    #include <arpa/inet.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string addr = "127.0.0.1:7878";
+    int connections = 4;
+    int depth = 16;
+    int seconds = 10;
+    int ids = 1000;
+    int search_pct = 10;
+};
+
+struct Credentials {
+    std::string user;
+    std::string password; // Empty: do not log in
+};
+
+struct WorkerResult {
+    std::vector<double> latencies_us;
+    long errors = 0;
+    bool failed = false;
+};
+
+static bool parse_options(int argc, char* argv[], Options& opt) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) return false;
+        std::string key = arg.substr(2, eq - 2);
+        std::string value = arg.substr(eq + 1);
+        if (key == "addr") opt.addr = value;
+        else if (key == "connections") opt.connections = std::atoi(value.c_str());
+        else if (key == "depth") opt.depth = std::atoi(value.c_str());
+        else if (key == "seconds") opt.seconds = std::atoi(value.c_str());
+        else if (key == "ids") opt.ids = std::atoi(value.c_str());
+        else if (key == "search-pct") opt.search_pct = std::atoi(value.c_str());
+        else return false;
+    }
+    return opt.connections > 0 && opt.depth > 0 && opt.seconds > 0 && opt.ids > 0;
+}
+
+#ifdef __linux__
+
+static int connect_to(const std::string& addr) {
+    if (addr.compare(0, 5, "unix:") == 0) {
+        sockaddr_un sa = {};
+        sa.sun_family = AF_UNIX;
+        std::strncpy(sa.sun_path, addr.c_str() + 5, sizeof(sa.sun_path) - 1);
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) == 0) return fd;
+        if (fd >= 0) ::close(fd);
+        return -1;
+    }
+
+    size_t colon = addr.rfind(':');
+    if (colon == std::string::npos) return -1;
+    std::string host = addr.substr(0, colon);
+    if (host == "localhost") host = "127.0.0.1";
+    sockaddr_in sa = {};
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(static_cast<uint16_t>(std::atoi(addr.c_str() + colon + 1)));
+    if (::inet_pton(AF_INET, host.c_str(), &sa.sin_addr) != 1) return -1;
+
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) == 0) {
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return fd;
+    }
+    if (fd >= 0) ::close(fd);
+    return -1;
+}
+
+static bool send_all(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Sends LOGIN and reads its two-line answer before any timed request.
+static bool log_in(int fd, const Credentials& login) {
+    if (!send_all(fd, "LOGIN\t" + login.user + "\t" + login.password + "\n")) return false;
+    std::string in;
+    char buf[256];
+    // "OK 1" is followed by the token; anything else is one line.
+    auto complete = [&in]() {
+        size_t eol = in.find('\n');
+        return eol != std::string::npos && (in.compare(0, 5, "OK 1\n") != 0 || in.find('\n', eol + 1) != std::string::npos);
+    };
+    while (!complete()) {
+        ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) return false;
+        in.append(buf, static_cast<size_t>(n));
+    }
+    if (in.compare(0, 5, "OK 1\n") != 0) {
+        std::cerr << "Login failed: " << in.substr(0, in.find('\n')) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static void run_worker(const Options& opt, const Credentials& login, unsigned seed, Clock::time_point deadline,
+                       WorkerResult& result) {
+    int fd = connect_to(opt.addr);
+    if (fd < 0 || (!login.password.empty() && !log_in(fd, login))) {
+        if (fd >= 0) ::close(fd);
+        result.failed = true;
+        return;
+    }
+
+    std::mt19937 rng(seed);
+    auto next_request = [&]() {
+        if (static_cast<int>(rng() % 100) < opt.search_pct) {
+            return "SEARCH\t" + std::to_string(100 + rng() % 900) + "\n";
+        }
+        return "GET\t" + std::to_string(1 + rng() % opt.ids) + "\n";
+    };
+
+    std::deque<Clock::time_point> in_flight;
+    std::string out;
+    for (int i = 0; i < opt.depth; i++) {
+        out += next_request();
+        in_flight.push_back(Clock::now());
+    }
+
+    std::string in;
+    size_t pos = 0;        // Parse position in `in`
+    long rows_left = -1;   // Rows still expected for the current response
+    char buf[65536];
+    while (!in_flight.empty()) {
+        if (!out.empty()) {
+            if (!send_all(fd, out)) {
+                result.failed = true;
+                break;
+            }
+            out.clear();
+        }
+
+        ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            result.failed = true;
+            break;
+        }
+        in.append(buf, static_cast<size_t>(n));
+
+        size_t eol;
+        while ((eol = in.find('\n', pos)) != std::string::npos) {
+            if (rows_left < 0) {
+                if (in.compare(pos, 3, "OK ") == 0) {
+                    rows_left = std::atol(in.c_str() + pos + 3);
+                } else {
+                    rows_left = 0;
+                    result.errors++;
+                }
+            } else {
+                rows_left--;
+            }
+            pos = eol + 1;
+
+            if (rows_left == 0) {
+                auto now = Clock::now();
+                result.latencies_us.push_back(
+                    std::chrono::duration<double, std::micro>(now - in_flight.front()).count());
+                in_flight.pop_front();
+                rows_left = -1;
+                if (now < deadline) {
+                    out += next_request();
+                    in_flight.push_back(now);
+                }
+            }
+        }
+        in.erase(0, pos);
+        pos = 0;
+    }
+    ::close(fd);
+}
+
+int main(int argc, char* argv[]) {
+    Options opt;
+    if (!parse_options(argc, argv, opt)) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--addr=host:port|unix:/path] [--connections=N] [--depth=N] [--seconds=N]"
+                     " [--ids=N] [--search-pct=N]" << std::endl;
+        return 1;
+    }
+
+    Credentials login;
+    const char* user = std::getenv("STUDENT_USER");
+    const char* password = std::getenv("STUDENT_PASSWORD");
+    login.user = user ? user : "admin";
+    login.password = password ? password : "";
+
+    std::vector<WorkerResult> results(opt.connections);
+    std::vector<std::thread> workers;
+    auto start = Clock::now();
+    auto deadline = start + std::chrono::seconds(opt.seconds);
+    for (int i = 0; i < opt.connections; i++) {
+        workers.emplace_back(run_worker, std::cref(opt), std::cref(login), 1234u + i, deadline, std::ref(results[i]));
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<double> latencies;
+    long errors = 0;
+    int failed = 0;
+    for (const auto& r : results) {
+        latencies.insert(latencies.end(), r.latencies_us.begin(), r.latencies_us.end());
+        errors += r.errors;
+        failed += r.failed ? 1 : 0;
+    }
+    if (latencies.empty()) {
+        std::cerr << "No requests completed; is the server running on " << opt.addr << "?" << std::endl;
+        return 1;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        return latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))];
+    };
+
+    std::cout << "requests:   " << latencies.size() << " (" << errors << " ERR responses, "
+              << failed << " failed connections)\n"
+              << "throughput: " << static_cast<long>(latencies.size() / elapsed) << " req/s\n"
+              << "latency:    p50 " << percentile(0.50) << " us, p99 " << percentile(0.99)
+              << " us, p99.9 " << percentile(0.999) << " us, max " << latencies.back() << " us" << std::endl;
+    return failed > 0 ? 1 : 0;
+}
+
+#else
+
+int main(int argc, char* argv[]) {
+    (void)argc;
+    (void)argv;
+    std::cerr << "student_loadgen is only supported on Linux" << std::endl;
+    return 1;
+}
+
+#endif
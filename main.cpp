@@ -1,17 +1,29 @@
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <string>
 #include <limits>
+#include <optional>
+#include <thread>
 
 #ifdef _WIN32
     #include <windows.h>
     #include <conio.h>
+    #include <io.h>
 #else
     #include <termios.h>
     #include <unistd.h>
 #endif
 
+#include "bulk_io.h"
 #include "database.h"
+#include "metrics.h"
+#include "replica.h"
+#include "server.h"
 #include "student.h"
+#include "student_pager.h"
 
 // ANSI color codes
 #define RESET   "\033[0m"
@@ -97,29 +109,151 @@ int get_int_input() {
     return value;
 }
 
+// Rows per page: a screenful when a person is reading, large batches when
+// the output is redirected.
+const size_t TTY_PAGE_SIZE = 20;
+const size_t STREAM_PAGE_SIZE = 4096;
+
+bool stdout_is_tty() {
+#ifdef _WIN32
+    return _isatty(_fileno(stdout)) != 0;
+#else
+    return isatty(STDOUT_FILENO) != 0;
+#endif
+}
+
+void append_student_header(std::string& out) {
+    out += CYAN;
+    out += BOLD;
+    out += "  ID       Name                         Reg No         Age  Major\n";
+    out += "  -------- ---------------------------- -------------- ---- --------------------";
+    out += RESET;
+    out += '\n';
+}
+
 void view_all_students(Database& db) {
-    auto students = db.get_all_students();
-    
-    if (students.empty()) {
+    size_t total = db.student_count();
+    if (total == 0) {
         std::cout << "\n" << YELLOW << BOLD << "No students found in the database." << RESET << std::endl;
         return;
     }
 
-    std::cout << "\n" << CYAN << "+===========================================================================+" << RESET << std::endl;
-    std::cout << CYAN << "|                           All Students                                   |" << RESET << std::endl;
-    std::cout << CYAN << "+===========================================================================+" << RESET << std::endl;
+    // Each page is fetched from the database by id cursor, formatted into
+    // one buffer and written with a single flush.
+    bool interactive = stdout_is_tty();
+    size_t page_size = interactive ? TTY_PAGE_SIZE : STREAM_PAGE_SIZE;
+    std::string buffer = "\n";
+    buffer += CYAN;
+    buffer += BOLD;
+    buffer += "  All Students (" + std::to_string(total) + ")";
+    buffer += RESET;
+    buffer += "\n";
+    append_student_header(buffer);
+
+    StudentPager pager(db, page_size);
+    while (true) {
+        pager.next_page(buffer);
+        bool last = pager.done();
+        if (last) {
+            buffer += "\n";
+            buffer += WHITE;
+            buffer += BOLD;
+            buffer += "Total: " + std::to_string(pager.rows_shown()) + " student(s)";
+            buffer += RESET;
+            buffer += "\n";
+        }
+        std::cout.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        std::cout.flush();
+        buffer.clear();
+        if (last) {
+            return;
+        }
 
-    for (const auto& s : students) {
-        std::cout << CYAN << "|" << RESET << std::endl;
-        std::cout << CYAN << "|  " << RESET << BLUE << BOLD << "ID: " << RESET << WHITE << s.id << RESET << std::endl;
-        std::cout << CYAN << "|  " << RESET << GREEN << "Name: " << RESET << WHITE << s.name << RESET << std::endl;
-        std::cout << CYAN << "|  " << RESET << GREEN << "Reg No: " << RESET << WHITE << s.reg_no << RESET << std::endl;
-        std::cout << CYAN << "|  " << RESET << GREEN << "Age: " << RESET << WHITE << s.age << RESET << std::endl;
-        std::cout << CYAN << "|  " << RESET << GREEN << "Major: " << RESET << WHITE << s.major << RESET << std::endl;
-        std::cout << CYAN << "+-----------------------------------------------------------------------+" << RESET << std::endl;
+        if (interactive) {
+            std::cout << YELLOW << "  -- " << pager.rows_shown() << " of " << total
+                      << " -- [Enter] next page, [q] back: " << RESET << std::flush;
+            std::string reply;
+            if (!std::getline(std::cin, reply) || reply == "q" || reply == "Q") {
+                return;
+            }
+            append_student_header(buffer);
+        }
     }
+}
+
+// Reads a student id typed on its own line; false for anything else.
+bool parse_student_id(const std::string& text, int& id) {
+    char* end = nullptr;
+    long value = std::strtol(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || value <= 0 || value > std::numeric_limits<int>::max()) {
+        return false;
+    }
+    id = static_cast<int>(value);
+    return true;
+}
 
-    std::cout << "\n" << WHITE << BOLD << "Total: " << students.size() << " student(s)" << RESET << std::endl;
+// Asks which student to act on without listing the whole roster first:
+// the admin types the id, or a search to list the students it finds, or
+// nothing to browse the roster a screenful at a time. Returns 0 if they
+// go back instead.
+int choose_student_id(Database& db, const std::string& action) {
+    while (true) {
+        std::cout << "\nEnter Student ID to " << action << " (or text to search, Enter to browse, q to go back): ";
+        std::string reply;
+        if (!std::getline(std::cin, reply) || reply == "q" || reply == "Q") {
+            return 0;
+        }
+        int id;
+        if (parse_student_id(reply, id)) {
+            return id;
+        }
+
+        std::string buffer;
+        if (!reply.empty()) {
+            std::vector<Student> found = db.search_students(reply);
+            if (found.empty()) {
+                std::cout << YELLOW << "No students found matching '" << reply << "'" << RESET << std::endl;
+                continue;
+            }
+            buffer = "\n";
+            append_student_header(buffer);
+            for (size_t i = 0; i < found.size() && i < TTY_PAGE_SIZE; i++) {
+                append_student_row(buffer, found[i]);
+            }
+            if (found.size() > TTY_PAGE_SIZE) {
+                buffer += YELLOW;
+                buffer += "  ... and " + std::to_string(found.size() - TTY_PAGE_SIZE) + " more; narrow the search.";
+                buffer += RESET;
+                buffer += '\n';
+            }
+            std::cout.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            std::cout.flush();
+            continue;
+        }
+
+        size_t total = db.student_count();
+        StudentPager pager(db, TTY_PAGE_SIZE);
+        while (!pager.done()) {
+            buffer = "\n";
+            append_student_header(buffer);
+            pager.next_page(buffer);
+            std::cout.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            if (pager.done()) {
+                break;
+            }
+            std::cout << YELLOW << "  -- " << pager.rows_shown() << " of " << total
+                      << " -- ID to " << action << ", [Enter] next page, [q] stop: " << RESET << std::flush;
+            if (!std::getline(std::cin, reply)) {
+                return 0;
+            }
+            if (parse_student_id(reply, id)) {
+                return id;
+            }
+            if (!reply.empty()) {
+                break;
+            }
+        }
+    }
 }
 
 void add_student(Database& db) {
@@ -145,15 +279,15 @@ void add_student(Database& db) {
     int id = db.add_student(name, reg_no, age, major);
     if (id > 0) {
         std::cout << "\n" << GREEN << BOLD << "Student added successfully! (ID: " << id << ")" << RESET << std::endl;
+    } else if (id == 0) {
+        std::cout << "\n" << RED << BOLD << "Error saving student. Nothing was added." << RESET << std::endl;
     } else {
         std::cout << "\n" << RED << BOLD << "Error adding student. Registration number may already exist." << RESET << std::endl;
     }
 }
 
 void update_student(Database& db) {
-    auto students = db.get_all_students();
-    
-    if (students.empty()) {
+    if (db.student_count() == 0) {
         std::cout << "\n" << YELLOW << BOLD << "No students to update." << RESET << std::endl;
         return;
     }
@@ -162,15 +296,15 @@ void update_student(Database& db) {
     std::cout << YELLOW << "|          Update Student                |" << RESET << std::endl;
     std::cout << YELLOW << "+----------------------------------------+" << RESET << std::endl;
 
-    std::cout << "\nAvailable students:\n";
-    for (const auto& s : students) {
-        std::cout << "  [" << s.id << "] " << s.name << " - " << s.reg_no << std::endl;
+    int id = choose_student_id(db, "update");
+    if (id == 0) {
+        return;
     }
 
-    std::cout << "\nEnter Student ID to update: ";
-    int id = get_int_input();
-
-    Student* student = db.get_student(id);
+    // The version makes the update fail rather than overwrite the row if
+    // someone else changes it while this one is being typed in.
+    uint64_t version = 0;
+    std::optional<Student> student = db.get_student(id, version);
     if (!student) {
         std::cout << RED << BOLD << "Student not found!" << RESET << std::endl;
         return;
@@ -203,22 +337,22 @@ void update_student(Database& db) {
     std::getline(std::cin, confirm);
 
     if (confirm == "y" || confirm == "Y") {
-        if (db.update_student(id, name, reg_no, age, major)) {
+        bool stale = false;
+        if (db.update_student(id, name, reg_no, age, major, version, stale)) {
             std::cout << GREEN << BOLD << "Student updated successfully!" << RESET << std::endl;
+        } else if (stale) {
+            std::cout << RED << BOLD << "This student was changed by another session meanwhile. Nothing was saved; "
+                      << "open it again to see the new values." << RESET << std::endl;
         } else {
             std::cout << RED << BOLD << "Error updating student." << RESET << std::endl;
         }
     } else {
         std::cout << YELLOW << "Update cancelled." << RESET << std::endl;
     }
-
-    delete student;
 }
 
 void delete_student(Database& db) {
-    auto students = db.get_all_students();
-    
-    if (students.empty()) {
+    if (db.student_count() == 0) {
         std::cout << "\n" << YELLOW << BOLD << "No students to delete." << RESET << std::endl;
         return;
     }
@@ -227,15 +361,13 @@ void delete_student(Database& db) {
     std::cout << RED << "|          Delete Student                |" << RESET << std::endl;
     std::cout << RED << "+----------------------------------------+" << RESET << std::endl;
 
-    std::cout << "\nAvailable students:\n";
-    for (const auto& s : students) {
-        std::cout << "  [" << s.id << "] " << s.name << " - " << s.reg_no << std::endl;
+    int id = choose_student_id(db, "delete");
+    if (id == 0) {
+        return;
     }
 
-    std::cout << "\nEnter Student ID to delete: ";
-    int id = get_int_input();
-
-    Student* student = db.get_student(id);
+    uint64_t version = 0;
+    std::optional<Student> student = db.get_student(id, version);
     if (!student) {
         std::cout << RED << BOLD << "Student not found!" << RESET << std::endl;
         return;
@@ -248,16 +380,18 @@ void delete_student(Database& db) {
     std::getline(std::cin, confirm);
 
     if (confirm == "YES") {
-        if (db.delete_student(id)) {
+        bool stale = false;
+        if (db.delete_student(id, version, stale)) {
             std::cout << GREEN << BOLD << "Student deleted successfully!" << RESET << std::endl;
+        } else if (stale) {
+            std::cout << RED << BOLD << "This student was changed or deleted by another session meanwhile. "
+                      << "Nothing was deleted." << RESET << std::endl;
         } else {
             std::cout << RED << BOLD << "Error deleting student." << RESET << std::endl;
         }
     } else {
         std::cout << YELLOW << "Deletion cancelled." << RESET << std::endl;
     }
-
-    delete student;
 }
 
 void search_students(Database& db) {
@@ -273,6 +407,16 @@ void search_students(Database& db) {
 
     if (students.empty()) {
         std::cout << "\n" << YELLOW << BOLD << "No students found matching '" << query << "'" << RESET << std::endl;
+
+        // Nothing contains the text as typed; offer the closest names.
+        auto suggestions = db.search_ranked(query, 5);
+        if (!suggestions.empty()) {
+            std::cout << "\n" << WHITE << BOLD << "Did you mean:" << RESET << std::endl;
+            for (const auto& r : suggestions) {
+                std::cout << "  " << BLUE << BOLD << "ID " << r.student.id << RESET << "  " << r.student.name
+                          << "  (" << r.student.reg_no << ", " << r.student.major << ")" << std::endl;
+            }
+        }
         return;
     }
 
@@ -297,7 +441,7 @@ void view_student_by_id(Database& db) {
     std::cout << "  Enter Student ID: ";
     int id = get_int_input();
 
-    Student* student = db.get_student(id);
+    std::optional<Student> student = db.get_student(id);
     if (!student) {
         std::cout << "\n" << RED << BOLD << "No student found with ID " << id << RESET << std::endl;
         return;
@@ -312,8 +456,31 @@ void view_student_by_id(Database& db) {
     std::cout << CYAN << "|  " << RESET << GREEN << "Age: " << RESET << student->age << std::endl;
     std::cout << CYAN << "|  " << RESET << GREEN << "Major: " << RESET << student->major << std::endl;
     std::cout << CYAN << "+===========================================+" << RESET << std::endl;
+}
+
+void view_statistics() {
+    std::cout << "\n" << CYAN << "+===========================================+" << RESET << std::endl;
+    std::cout << CYAN << "|           Database Statistics           |" << RESET << std::endl;
+    std::cout << CYAN << "+===========================================+" << RESET << std::endl;
+    std::cout << metrics_summary();
 
-    delete student;
+    if (!metrics_enabled()) {
+        return;
+    }
+    std::cout << "\nWrite Prometheus metrics to file (blank to skip): ";
+    std::string path;
+    std::getline(std::cin, path);
+    if (path.empty()) {
+        return;
+    }
+    std::ofstream file(path);
+    file << metrics_prometheus();
+    file.close();
+    if (file) {
+        std::cout << GREEN << "Metrics written to " << path << RESET << std::endl;
+    } else {
+        std::cout << RED << "Cannot write " << path << RESET << std::endl;
+    }
 }
 
 void admin_menu(Database& db) {
@@ -331,10 +498,13 @@ void admin_menu(Database& db) {
         std::cout << RED << "  [4] Delete Student" << RESET << std::endl;
         std::cout << BLUE << "  [5] Search Students" << RESET << std::endl;
         std::cout << BLUE << "  [6] View Student by ID" << RESET << std::endl;
-        std::cout << MAGENTA << "  [7] Logout" << RESET << std::endl;
+        std::cout << CYAN << "  [7] Statistics" << RESET << std::endl;
+        std::cout << MAGENTA << "  [8] Logout" << RESET << std::endl;
 
         std::cout << "\nSelect an option: ";
         int choice = get_int_input();
+        // Picks up what other processes sharing the database have written.
+        db.refresh();
 
         switch (choice) {
             case 1: view_all_students(db); break;
@@ -343,7 +513,8 @@ void admin_menu(Database& db) {
             case 4: delete_student(db); break;
             case 5: search_students(db); break;
             case 6: view_student_by_id(db); break;
-            case 7:
+            case 7: view_statistics(); break;
+            case 8:
                 std::cout << "\n" << MAGENTA << BOLD << "Logged out successfully!" << RESET << std::endl;
                 return;
             default:
@@ -352,7 +523,7 @@ void admin_menu(Database& db) {
     }
 }
 
-bool admin_login(Database& db) {
+AuthResult admin_login(Database& db) {
     std::cout << "\n" << CYAN << "+----------------------------------------+" << RESET << std::endl;
     std::cout << CYAN << "|           Admin Login                  |" << RESET << std::endl;
     std::cout << CYAN << "+----------------------------------------+" << RESET << std::endl;
@@ -368,14 +539,105 @@ bool admin_login(Database& db) {
     return db.verify_admin(username, password);
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     Database db("students.db");
+    const char* program = argv[0];
+
+    // Options come before the command. --lazy[=MB] keeps students.db on
+    // disk and reads it in pages through a cache of that many megabytes (64
+    // by default). --feed publishes every change to students.db.changes.
+    // --follow=<path> makes this a read-only follower of the database at
+    // path, kept up to date from its change feed. --async[=ms] returns from
+    // writes before they reach the log and writes the log in the background
+    // every that many milliseconds (10 by default). --compress writes
+    // students.db in the compressed format from the next checkpoint on.
+    // --shared lets several processes, such as two admins' sessions, use
+    // students.db at the same time. --anonymous-reads lets --serve answer
+    // reads on connections that have not logged in.
+    std::string leader;
+    bool anonymous_reads = false;
+    while (argc > 1) {
+        std::string option = argv[1];
+        if (option == "--lazy" || option.rfind("--lazy=", 0) == 0) {
+            size_t megabytes = option.size() > 7 ? std::strtoul(option.c_str() + 7, nullptr, 10) : 64;
+            db.set_lazy(std::max<size_t>(megabytes, 1) << 20);
+        } else if (option == "--async" || option.rfind("--async=", 0) == 0) {
+            long ms = option.size() > 8 ? std::strtol(option.c_str() + 8, nullptr, 10) : 10;
+            db.set_async_log(std::chrono::milliseconds(ms), 1024);
+        } else if (option == "--shared") {
+            db.set_shared();
+        } else if (option == "--compress") {
+            db.set_compressed(true);
+        } else if (option == "--feed") {
+            db.enable_change_feed();
+        } else if (option == "--anonymous-reads") {
+            anonymous_reads = true;
+        } else if (option.rfind("--follow=", 0) == 0) {
+            leader = option.substr(9);
+        } else {
+            break;
+        }
+        argc--;
+        argv++;
+    }
+
+    if (!leader.empty()) {
+        std::error_code ec;
+        if (std::filesystem::equivalent(leader, "students.db", ec)) {
+            std::cerr << "A follower needs its own students.db; run it from another directory" << std::endl;
+            return 1;
+        }
+        if (!Replica::bootstrap(leader, "students.db")) {
+            return 1;
+        }
+    }
     
     if (!db.init()) {
         std::cerr << "Failed to initialize database!" << std::endl;
         return 1;
     }
 
+    if (!leader.empty()) {
+        if (argc > 3 || (argc > 1 && std::string(argv[1]) != "--serve")) {
+            std::cerr << "Usage: " << program << " [--anonymous-reads] --follow=<students.db> [--serve [host:port|unix:/path]]" << std::endl;
+            return 1;
+        }
+        Replica replica(db, leader);
+        replica.start();
+        std::cout << "Following " << leader << " from change " << db.last_change() << std::endl;
+        return run_server(db, argc == 3 ? argv[2] : "127.0.0.1:7879", std::thread::hardware_concurrency(), true,
+                          anonymous_reads);
+    }
+
+    if (argc > 1) {
+        std::string command = argv[1];
+        if (command == "import" && argc == 3) {
+            return import_csv(db, argv[2]);
+        }
+        if (command == "export" && argc == 3) {
+            return export_csv(db, argv[2]);
+        }
+        // Credentials come from the environment so that scripts can be
+        // read from stdin and passwords stay out of the command line.
+        std::string every = argc == 4 ? argv[3] : "--commit-every=0";
+        if (command == "batch" && argc <= 4 && every.rfind("--commit-every=", 0) == 0) {
+            const char* user = std::getenv("STUDENT_USER");
+            const char* password = std::getenv("STUDENT_PASSWORD");
+            if (!password) {
+                std::cerr << "Set STUDENT_PASSWORD (and STUDENT_USER, default admin) to run a batch" << std::endl;
+                return 1;
+            }
+            return run_batch(db, argc >= 3 ? argv[2] : "-", std::strtoul(every.c_str() + 15, nullptr, 10),
+                             user ? user : "admin", password);
+        }
+        if (command == "--serve" && argc <= 3) {
+            return run_server(db, argc == 3 ? argv[2] : "127.0.0.1:7878", std::thread::hardware_concurrency(), false,
+                              anonymous_reads);
+        }
+        std::cerr << "Usage: " << program << " [--lazy[=MB]] [--async[=ms]] [--compress] [--shared] [--feed] [--anonymous-reads] [import <file.csv> | export <file.csv|-> | batch [<script>|-] [--commit-every=N] | --serve [host:port|unix:/path]]" << std::endl;
+        return 1;
+    }
+
     clear_screen();
     print_banner();
 
@@ -393,10 +655,16 @@ int main() {
 
         switch (choice) {
             case 1:
-                if (admin_login(db)) {
-                    admin_menu(db);
-                } else {
-                    std::cout << "\n" << RED << BOLD << "Invalid credentials!" << RESET << std::endl;
+                switch (admin_login(db)) {
+                    case AuthResult::Ok:
+                        admin_menu(db);
+                        break;
+                    case AuthResult::Throttled:
+                        std::cout << "\n" << RED << BOLD << "Too many login attempts. Wait a moment and try again."
+                                  << RESET << std::endl;
+                        break;
+                    default:
+                        std::cout << "\n" << RED << BOLD << "Invalid credentials!" << RESET << std::endl;
                 }
                 break;
             case 2:
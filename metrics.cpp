@@ -0,0 +1,283 @@
+#include "metrics.h"
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifdef __linux__
+    #include <unistd.h>
+#endif
+
+static const size_t METRIC_COUNT = static_cast<size_t>(Metric::Count);
+
+static const char* METRIC_NAMES[METRIC_COUNT] = {
+    "load", "save", "get", "add", "add_batch", "update", "delete", "search", "search_ranked", "query", "commit", "login", "fsync"};
+
+// Upper bound of histogram bucket b, in seconds.
+static double bucket_bound(size_t b) {
+    return static_cast<double>(uint64_t(1) << b) * 1e-6;
+}
+
+#ifndef STUDENT_NO_METRICS
+
+struct alignas(64) MetricSlot {
+    std::atomic<uint64_t> count[METRIC_COUNT];
+    std::atomic<uint64_t> total_ns[METRIC_COUNT];
+    std::atomic<uint64_t> buckets[METRIC_COUNT][METRIC_BUCKETS];
+    std::atomic<uint64_t> bytes_written;
+    std::atomic<uint64_t> cache_hits;
+    std::atomic<uint64_t> cache_misses;
+    std::atomic<uint64_t> query_hits;
+    std::atomic<uint64_t> query_misses;
+
+    MetricSlot() : bytes_written(0), cache_hits(0), cache_misses(0), query_hits(0), query_misses(0) {
+        for (size_t m = 0; m < METRIC_COUNT; m++) {
+            count[m].store(0, std::memory_order_relaxed);
+            total_ns[m].store(0, std::memory_order_relaxed);
+            for (size_t b = 0; b < METRIC_BUCKETS; b++) {
+                buckets[m][b].store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+};
+
+// Slots are never freed, so a thread's counts survive it and totals never
+// go backwards. Threads are long-lived here (UI, pool workers), so the
+// registry stays small.
+static std::mutex& registry_mutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+static std::vector<std::unique_ptr<MetricSlot>>& registry() {
+    static std::vector<std::unique_ptr<MetricSlot>> slots;
+    return slots;
+}
+
+static MetricSlot& local_slot() {
+    thread_local MetricSlot* slot = [] {
+        std::lock_guard<std::mutex> lock(registry_mutex());
+        registry().push_back(std::make_unique<MetricSlot>());
+        return registry().back().get();
+    }();
+    return *slot;
+}
+
+// Only the owning thread writes a slot, so a load and a store replace the
+// locked read-modify-write of fetch_add.
+static inline void bump(std::atomic<uint64_t>& counter, uint64_t amount) {
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+void metrics_record(Metric metric, uint64_t nanoseconds) {
+    size_t m = static_cast<size_t>(metric);
+    uint64_t micros = nanoseconds / 1000;
+    size_t b = 0;
+    while (b < METRIC_BUCKETS - 1 && (micros >> b) != 0) {
+        b++;
+    }
+
+    MetricSlot& slot = local_slot();
+    bump(slot.count[m], 1);
+    bump(slot.total_ns[m], nanoseconds);
+    bump(slot.buckets[m][b], 1);
+}
+
+void metrics_add_bytes(uint64_t bytes) {
+    bump(local_slot().bytes_written, bytes);
+}
+
+static std::atomic<uint64_t> cache_resident(0);
+
+void metrics_cache_access(bool hit) {
+    MetricSlot& slot = local_slot();
+    bump(hit ? slot.cache_hits : slot.cache_misses, 1);
+}
+
+void metrics_set_cache_resident(uint64_t bytes) {
+    cache_resident.store(bytes, std::memory_order_relaxed);
+}
+
+void metrics_query_cache_access(bool hit) {
+    MetricSlot& slot = local_slot();
+    bump(hit ? slot.query_hits : slot.query_misses, 1);
+}
+
+bool metrics_enabled() {
+    return true;
+}
+
+MetricTotals metrics_totals() {
+    MetricTotals totals = {};
+    std::lock_guard<std::mutex> lock(registry_mutex());
+    for (const auto& slot : registry()) {
+        for (size_t m = 0; m < METRIC_COUNT; m++) {
+            totals.count[m] += slot->count[m].load(std::memory_order_relaxed);
+            totals.total_ns[m] += slot->total_ns[m].load(std::memory_order_relaxed);
+            for (size_t b = 0; b < METRIC_BUCKETS; b++) {
+                totals.buckets[m][b] += slot->buckets[m][b].load(std::memory_order_relaxed);
+            }
+        }
+        totals.bytes_written += slot->bytes_written.load(std::memory_order_relaxed);
+        totals.cache_hits += slot->cache_hits.load(std::memory_order_relaxed);
+        totals.cache_misses += slot->cache_misses.load(std::memory_order_relaxed);
+        totals.query_hits += slot->query_hits.load(std::memory_order_relaxed);
+        totals.query_misses += slot->query_misses.load(std::memory_order_relaxed);
+    }
+    totals.cache_resident = cache_resident.load(std::memory_order_relaxed);
+    return totals;
+}
+
+#else
+
+bool metrics_enabled() {
+    return false;
+}
+
+MetricTotals metrics_totals() {
+    return MetricTotals{};
+}
+
+#endif
+
+// Upper bound of the bucket holding the p-th fraction of samples.
+static double bucket_percentile(const MetricTotals& totals, size_t m, double p) {
+    uint64_t target = static_cast<uint64_t>(p * totals.count[m]);
+    uint64_t seen = 0;
+    for (size_t b = 0; b < METRIC_BUCKETS - 1; b++) {
+        seen += totals.buckets[m][b];
+        if (seen > target) {
+            return bucket_bound(b);
+        }
+    }
+    return bucket_bound(METRIC_BUCKETS - 1);
+}
+
+uint64_t process_resident_bytes() {
+#ifdef __linux__
+    FILE* file = std::fopen("/proc/self/statm", "r");
+    if (!file) return 0;
+    unsigned long long pages = 0, resident = 0;
+    int fields = std::fscanf(file, "%llu %llu", &pages, &resident);
+    std::fclose(file);
+    return fields == 2 ? resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE)) : 0;
+#else
+    return 0;
+#endif
+}
+
+static std::string format_seconds(double seconds) {
+    char text[32];
+    if (seconds < 1e-3) {
+        std::snprintf(text, sizeof(text), "%.1f us", seconds * 1e6);
+    } else if (seconds < 1) {
+        std::snprintf(text, sizeof(text), "%.2f ms", seconds * 1e3);
+    } else {
+        std::snprintf(text, sizeof(text), "%.2f s", seconds);
+    }
+    return text;
+}
+
+std::string metrics_summary() {
+    if (!metrics_enabled()) {
+        return "Metrics are disabled in this build (STUDENT_NO_METRICS).\n";
+    }
+
+    MetricTotals totals = metrics_totals();
+    std::string out = "  Operation     Count        Mean         p50 <=       p99 <=       Total\n";
+    char line[160];
+    for (size_t m = 0; m < METRIC_COUNT; m++) {
+        if (totals.count[m] == 0) continue;
+        double total = totals.total_ns[m] * 1e-9;
+        std::snprintf(line, sizeof(line), "  %-12s %7llu  %11s  %11s  %11s  %11s\n", METRIC_NAMES[m],
+                      static_cast<unsigned long long>(totals.count[m]),
+                      format_seconds(total / totals.count[m]).c_str(),
+                      format_seconds(bucket_percentile(totals, m, 0.50)).c_str(),
+                      format_seconds(bucket_percentile(totals, m, 0.99)).c_str(), format_seconds(total).c_str());
+        out += line;
+    }
+    std::snprintf(line, sizeof(line), "\n  Bytes written: %llu\n",
+                  static_cast<unsigned long long>(totals.bytes_written));
+    out += line;
+    uint64_t lookups = totals.cache_hits + totals.cache_misses;
+    if (lookups > 0) {
+        std::snprintf(line, sizeof(line), "  Page cache: %llu hits, %llu misses (%.1f%% hit ratio), %llu bytes held\n",
+                      static_cast<unsigned long long>(totals.cache_hits),
+                      static_cast<unsigned long long>(totals.cache_misses), 100.0 * totals.cache_hits / lookups,
+                      static_cast<unsigned long long>(totals.cache_resident));
+        out += line;
+    }
+    uint64_t searches = totals.query_hits + totals.query_misses;
+    if (searches > 0) {
+        std::snprintf(line, sizeof(line), "  Search cache: %llu hits, %llu misses (%.1f%% hit ratio)\n",
+                      static_cast<unsigned long long>(totals.query_hits),
+                      static_cast<unsigned long long>(totals.query_misses), 100.0 * totals.query_hits / searches);
+        out += line;
+    }
+    uint64_t rss = process_resident_bytes();
+    if (rss > 0) {
+        std::snprintf(line, sizeof(line), "  Process resident memory: %.1f MB\n", rss / 1048576.0);
+        out += line;
+    }
+    return out;
+}
+
+// labels is empty or a comma-free label list such as op="get".
+static void append_histogram(std::string& out, const std::string& family, const std::string& labels,
+                             const MetricTotals& totals, size_t m) {
+    std::string bucket_prefix = family + "_bucket{" + (labels.empty() ? "" : labels + ",") + "le=\"";
+    std::string suffix = labels.empty() ? "" : "{" + labels + "}";
+    char number[32];
+    uint64_t cumulative = 0;
+    for (size_t b = 0; b < METRIC_BUCKETS - 1; b++) {
+        cumulative += totals.buckets[m][b];
+        std::snprintf(number, sizeof(number), "%g", bucket_bound(b));
+        out += bucket_prefix + number + "\"} " + std::to_string(cumulative) + "\n";
+    }
+    out += bucket_prefix + "+Inf\"} " + std::to_string(totals.count[m]) + "\n";
+    std::snprintf(number, sizeof(number), "%.9f", totals.total_ns[m] * 1e-9);
+    out += family + "_sum" + suffix + " " + number + "\n";
+    out += family + "_count" + suffix + " " + std::to_string(totals.count[m]) + "\n";
+}
+
+std::string metrics_prometheus() {
+    if (!metrics_enabled()) {
+        return "# student_db metrics are disabled in this build\n";
+    }
+
+    MetricTotals totals = metrics_totals();
+    std::string out;
+    out += "# HELP student_db_operation_duration_seconds Time spent in Database operations.\n";
+    out += "# TYPE student_db_operation_duration_seconds histogram\n";
+    size_t fsync = static_cast<size_t>(Metric::Fsync);
+    for (size_t m = 0; m < METRIC_COUNT; m++) {
+        if (m == fsync) continue;
+        append_histogram(out, "student_db_operation_duration_seconds", std::string("op=\"") + METRIC_NAMES[m] + "\"",
+                         totals, m);
+    }
+
+    out += "# HELP student_db_fsync_duration_seconds Time spent flushing files to disk.\n";
+    out += "# TYPE student_db_fsync_duration_seconds histogram\n";
+    append_histogram(out, "student_db_fsync_duration_seconds", "", totals, fsync);
+
+    out += "# HELP student_db_bytes_written_total Bytes written to the snapshot and write-ahead log.\n";
+    out += "# TYPE student_db_bytes_written_total counter\n";
+    out += "student_db_bytes_written_total " + std::to_string(totals.bytes_written) + "\n";
+
+    out += "# HELP student_db_page_cache_lookups_total Page cache lookups in lazy mode, by result.\n";
+    out += "# TYPE student_db_page_cache_lookups_total counter\n";
+    out += "student_db_page_cache_lookups_total{result=\"hit\"} " + std::to_string(totals.cache_hits) + "\n";
+    out += "student_db_page_cache_lookups_total{result=\"miss\"} " + std::to_string(totals.cache_misses) + "\n";
+    out += "# HELP student_db_page_cache_bytes Bytes held by the page cache.\n";
+    out += "# TYPE student_db_page_cache_bytes gauge\n";
+    out += "student_db_page_cache_bytes " + std::to_string(totals.cache_resident) + "\n";
+    out += "# HELP student_db_search_cache_lookups_total Search result cache lookups, by result.\n";
+    out += "# TYPE student_db_search_cache_lookups_total counter\n";
+    out += "student_db_search_cache_lookups_total{result=\"hit\"} " + std::to_string(totals.query_hits) + "\n";
+    out += "student_db_search_cache_lookups_total{result=\"miss\"} " + std::to_string(totals.query_misses) + "\n";
+    out += "# HELP student_db_process_resident_bytes Resident set size of the process.\n";
+    out += "# TYPE student_db_process_resident_bytes gauge\n";
+    out += "student_db_process_resident_bytes " + std::to_string(process_resident_bytes()) + "\n";
+    return out;
+}
@@ -0,0 +1,103 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Counters and latency histograms for database operations, plus bytes
+// written, fsync time and page cache use. Every thread records into a slot
+// of its own with plain relaxed atomic stores: a slot has a single writer,
+// so the hot path takes no lock and does no read-modify-write. Reports sum
+// the slots.
+//
+// Compiling with -DSTUDENT_NO_METRICS turns MetricTimer and the other
+// hooks into empty inline code, so they cost nothing;
+// the reports then say that metrics are disabled.
+
+enum class Metric {
+    Load,
+    Save,
+    Get,
+    Add,
+    AddBatch,
+    Update,
+    Delete,
+    Search,
+    SearchRanked,
+    Query,
+    Commit,
+    Login,
+    Fsync,
+    Count
+};
+
+// Histogram bucket b counts durations under 2^b microseconds; the last
+// bucket takes everything slower.
+const size_t METRIC_BUCKETS = 24;
+
+struct MetricTotals {
+    uint64_t count[static_cast<size_t>(Metric::Count)];
+    uint64_t total_ns[static_cast<size_t>(Metric::Count)];
+    uint64_t buckets[static_cast<size_t>(Metric::Count)][METRIC_BUCKETS];
+    uint64_t bytes_written;
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+    uint64_t cache_resident;
+    uint64_t query_hits;
+    uint64_t query_misses;
+};
+
+#ifdef STUDENT_NO_METRICS
+
+class MetricTimer {
+public:
+    explicit MetricTimer(Metric) {}
+};
+
+inline void metrics_add_bytes(uint64_t) {}
+inline void metrics_cache_access(bool) {}
+inline void metrics_set_cache_resident(uint64_t) {}
+inline void metrics_query_cache_access(bool) {}
+
+#else
+
+void metrics_record(Metric metric, uint64_t nanoseconds);
+void metrics_add_bytes(uint64_t bytes);
+// Page cache of a lazily opened database: one call per page lookup, and
+// the bytes it holds after each change.
+void metrics_cache_access(bool hit);
+void metrics_set_cache_resident(uint64_t bytes);
+// Search result cache: one call per search_students().
+void metrics_query_cache_access(bool hit);
+
+// Records the time from construction to destruction under metric.
+class MetricTimer {
+private:
+    Metric metric;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit MetricTimer(Metric metric) : metric(metric), start(std::chrono::steady_clock::now()) {}
+    ~MetricTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        metrics_record(metric, static_cast<uint64_t>(
+                                   std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+    MetricTimer(const MetricTimer&) = delete;
+    MetricTimer& operator=(const MetricTimer&) = delete;
+};
+
+#endif
+
+bool metrics_enabled();
+MetricTotals metrics_totals();
+// Human-readable table for the admin menu.
+std::string metrics_summary();
+// Prometheus text exposition format.
+std::string metrics_prometheus();
+// Resident set size of the whole process, or 0 where it is not known.
+uint64_t process_resident_bytes();
+
+#endif // METRICS_H
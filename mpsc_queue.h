@@ -0,0 +1,63 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+#include <utility>
+
+// Unbounded lock-free queue for many producers and a single consumer
+// (Vyukov's linked-list MPSC queue). push() is one atomic exchange and one
+// store, so it never blocks and never waits for the consumer; it is safe
+// to call while holding locks the consumer also takes.
+//
+// The list always starts with a dummy node; pop() moves the value out of
+// the node after it, which then becomes the new dummy. A push that has
+// swapped the head but not yet linked its node is not visible yet, so
+// pop() can report empty for a moment while a push is in progress; the
+// consumer sees the value on its next pop().
+template <typename T>
+class MpscQueue {
+private:
+    struct Node {
+        std::atomic<Node*> next{nullptr};
+        T value;
+    };
+
+    alignas(64) std::atomic<Node*> head; // last node pushed
+    alignas(64) Node* tail;              // dummy; only the consumer touches it
+
+public:
+    MpscQueue() : head(new Node), tail(head.load(std::memory_order_relaxed)) {}
+
+    ~MpscQueue() {
+        while (tail) {
+            Node* next = tail->next.load(std::memory_order_relaxed);
+            delete tail;
+            tail = next;
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    void push(T value) {
+        Node* node = new Node;
+        node->value = std::move(value);
+        Node* prev = head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // Consumer only: callers with more than one consuming thread must let
+    // only one of them pop at a time.
+    bool pop(T& out) {
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (!next) {
+            return false;
+        }
+        out = std::move(next->value);
+        delete tail;
+        tail = next;
+        return true;
+    }
+};
+
+#endif // MPSC_QUEUE_H
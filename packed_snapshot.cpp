@@ -0,0 +1,383 @@
+#include "packed_snapshot.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <string_view>
+#include <unordered_map>
+#include "metrics.h"
+
+static const size_t BLOCK_TARGET = 64 * 1024; // raw bytes per block, give or take a row
+static const uint32_t MAX_RAW_SIZE = 1u << 28; // far above any real block
+static const size_t MIN_MATCH = 4;
+static const int HASH_BITS = 14;
+
+static void put_varint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>(value | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+// Reads a varint from [p, end) and advances p past it.
+static bool get_varint(const char*& p, const char* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(*p++);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void put_string(std::string& out, std::string_view s) {
+    put_varint(out, s.size());
+    out.append(s.data(), s.size());
+}
+
+static bool get_string(const char*& p, const char* end, std::string_view& s) {
+    uint64_t size;
+    if (!get_varint(p, end, size) || size > static_cast<uint64_t>(end - p)) {
+        return false;
+    }
+    s = std::string_view(p, size);
+    p += size;
+    return true;
+}
+
+static uint64_t zigzag(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+// Greedy LZ77 over one block. Each sequence is a varint count of
+// literals, the literals, then a varint distance back into the output and
+// a varint match length less MIN_MATCH; the last sequence ends after its
+// literals, where the output reaches the block's raw size. Candidates come
+// from a table of the last position seen for each hash of four bytes.
+static std::string lz_compress(const std::string& in) {
+    std::string out;
+    out.reserve(in.size() / 2);
+    std::vector<int32_t> table(size_t(1) << HASH_BITS, -1);
+    auto hash = [&in](size_t i) {
+        uint32_t v;
+        std::memcpy(&v, in.data() + i, sizeof(v));
+        return (v * 2654435761u) >> (32 - HASH_BITS);
+    };
+
+    size_t anchor = 0;
+    size_t i = 0;
+    while (i + MIN_MATCH <= in.size()) {
+        uint32_t h = hash(i);
+        int32_t candidate = table[h];
+        table[h] = static_cast<int32_t>(i);
+        if (candidate < 0 || std::memcmp(in.data() + candidate, in.data() + i, MIN_MATCH) != 0) {
+            i++;
+            continue;
+        }
+        size_t length = MIN_MATCH;
+        while (i + length < in.size() && in[candidate + length] == in[i + length]) {
+            length++;
+        }
+        put_varint(out, i - anchor);
+        out.append(in, anchor, i - anchor);
+        put_varint(out, i - static_cast<size_t>(candidate));
+        put_varint(out, length - MIN_MATCH);
+        i += length;
+        anchor = i;
+    }
+    if (anchor < in.size()) {
+        put_varint(out, in.size() - anchor);
+        out.append(in, anchor, in.size() - anchor);
+    }
+    return out;
+}
+
+static bool lz_decompress(const char* p, const char* end, size_t raw_size, std::string& out) {
+    out.clear();
+    out.reserve(raw_size);
+    while (out.size() < raw_size) {
+        uint64_t literals;
+        if (!get_varint(p, end, literals) || literals > static_cast<uint64_t>(end - p) ||
+            literals > raw_size - out.size()) {
+            return false;
+        }
+        out.append(p, literals);
+        p += literals;
+        if (out.size() == raw_size) {
+            break;
+        }
+
+        uint64_t distance, length;
+        if (!get_varint(p, end, distance) || !get_varint(p, end, length) || distance == 0 ||
+            distance > out.size() || raw_size - out.size() < MIN_MATCH ||
+            length > raw_size - out.size() - MIN_MATCH) {
+            return false;
+        }
+        length += MIN_MATCH;
+        // No reallocation after the reserve, so a source behind the end of
+        // the output can be appended from directly. An overlapping match
+        // repeats its own output and goes byte by byte.
+        size_t from = out.size() - distance;
+        if (distance >= length) {
+            out.append(out.data() + from, length);
+        } else {
+            for (uint64_t k = 0; k < length; k++) {
+                out += out[from + k];
+            }
+        }
+    }
+    return p == end;
+}
+
+// Decodes one block's rows, extending majors with the ones it adds. Ids
+// must keep rising from last_id, the last one in earlier blocks.
+static bool decode_block(const std::string& raw, uint32_t count, std::vector<std::string>& majors, int& last_id,
+                         const SnapshotWriter::RowVisitor& visit) {
+    const char* p = raw.data();
+    const char* end = p + raw.size();
+    uint64_t added;
+    if (!get_varint(p, end, added)) {
+        return false;
+    }
+    std::string_view text;
+    for (uint64_t k = 0; k < added; k++) {
+        if (!get_string(p, end, text)) {
+            return false;
+        }
+        majors.emplace_back(text);
+    }
+
+    int id = 0;
+    std::string reg_no;
+    for (uint32_t r = 0; r < count; r++) {
+        uint64_t delta, age, shared, major;
+        std::string_view name, suffix;
+        if (!get_varint(p, end, delta) || delta == 0 || delta > static_cast<uint64_t>(INT_MAX - id) ||
+            !get_varint(p, end, age) || !get_string(p, end, name) || !get_varint(p, end, shared) ||
+            shared > reg_no.size() || !get_string(p, end, suffix) || !get_varint(p, end, major) ||
+            major >= majors.size()) {
+            return false;
+        }
+        id += static_cast<int>(delta);
+        if (id <= last_id) {
+            return false;
+        }
+        last_id = id;
+        reg_no.resize(shared);
+        reg_no.append(suffix);
+        visit(StudentView{id, name, reg_no, static_cast<int>(unzigzag(age)), majors[major]});
+    }
+    return p == end;
+}
+
+static uint64_t header_checksum(PackedHeader header, const std::string& admin_bytes) {
+    header.checksum = 0;
+    std::string covered(reinterpret_cast<const char*>(&header), sizeof(header));
+    covered += admin_bytes;
+    return snapshot_checksum(covered.data(), covered.size());
+}
+
+void PackedSnapshotWriter::add_admin(const std::string& username, const std::string& password) {
+    admins.emplace_back(username, password);
+}
+
+bool PackedSnapshotWriter::write(const std::string& path, int next_id, uint64_t change_seq, size_t student_count,
+                                 const SnapshotWriter::RowSource& rows) {
+    PackedHeader header = {};
+    std::memcpy(header.magic, PACKED_MAGIC, sizeof(header.magic));
+    header.version = PACKED_VERSION;
+    header.next_id = next_id;
+    header.change_seq = change_seq;
+    header.admin_count = static_cast<uint32_t>(admins.size());
+    header.student_count = static_cast<uint32_t>(student_count);
+
+    std::string admin_bytes;
+    for (const auto& admin : admins) {
+        put_string(admin_bytes, admin.first);
+        put_string(admin_bytes, admin.second);
+    }
+    header.admin_size = static_cast<uint32_t>(admin_bytes.size());
+
+    std::string temp_path = path + ".tmp";
+    FILE* file = std::fopen(temp_path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    // The header is written again at the end, with the block count.
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+              std::fwrite(admin_bytes.data(), 1, admin_bytes.size(), file) == admin_bytes.size();
+    uint64_t written = sizeof(header) + admin_bytes.size();
+
+    // Keys point into names, which never moves its strings.
+    std::deque<std::string> names;
+    std::unordered_map<std::string_view, uint32_t> dictionary;
+    std::string added, body, reg_no;
+    size_t added_count = 0;
+    uint32_t block_rows = 0;
+    int previous_id = 0;
+    size_t records = 0;
+
+    auto finish_block = [&]() {
+        std::string raw;
+        raw.reserve(body.size() + added.size() + 8);
+        put_varint(raw, added_count);
+        raw += added;
+        raw += body;
+        std::string packed = lz_compress(raw);
+        bool compressed = packed.size() < raw.size();
+        const std::string& stored = compressed ? packed : raw;
+
+        PackedBlock block = {};
+        block.rows = block_rows;
+        block.raw_size = static_cast<uint32_t>(raw.size());
+        block.stored_size = static_cast<uint32_t>(stored.size());
+        block.compressed = compressed ? 1 : 0;
+        block.checksum = snapshot_checksum(stored.data(), stored.size());
+        ok = ok && raw.size() <= MAX_RAW_SIZE && std::fwrite(&block, sizeof(block), 1, file) == 1 &&
+             std::fwrite(stored.data(), 1, stored.size(), file) == stored.size();
+        written += sizeof(block) + stored.size();
+        header.block_count++;
+
+        added.clear();
+        body.clear();
+        reg_no.clear();
+        added_count = 0;
+        block_rows = 0;
+        previous_id = 0;
+    };
+
+    rows([&](const StudentView& s) {
+        auto found = dictionary.find(s.major);
+        if (found == dictionary.end()) {
+            names.emplace_back(s.major);
+            found = dictionary.emplace(names.back(), static_cast<uint32_t>(names.size() - 1)).first;
+            put_string(added, s.major);
+            added_count++;
+        }
+
+        ok = ok && s.id > previous_id;
+        put_varint(body, static_cast<uint64_t>(s.id - previous_id));
+        previous_id = s.id;
+        put_varint(body, zigzag(s.age));
+        put_string(body, s.name);
+        size_t shared = 0;
+        size_t limit = std::min(reg_no.size(), s.reg_no.size());
+        while (shared < limit && reg_no[shared] == s.reg_no[shared]) {
+            shared++;
+        }
+        put_varint(body, shared);
+        put_string(body, s.reg_no.substr(shared));
+        reg_no.assign(s.reg_no.data(), s.reg_no.size());
+        put_varint(body, found->second);
+
+        block_rows++;
+        records++;
+        if (body.size() + added.size() >= BLOCK_TARGET) {
+            finish_block();
+        }
+    });
+    if (block_rows > 0) {
+        finish_block();
+    }
+
+    header.checksum = header_checksum(header, admin_bytes);
+    ok = ok && records == student_count && std::fseek(file, 0, SEEK_SET) == 0 &&
+         std::fwrite(&header, sizeof(header), 1, file) == 1 && sync_file(file);
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok) {
+        std::remove(temp_path.c_str());
+        return false;
+    }
+    metrics_add_bytes(written);
+
+    std::error_code ec;
+    std::filesystem::rename(temp_path, path, ec);
+    if (ec) {
+        std::remove(temp_path.c_str());
+        return false;
+    }
+    return sync_parent_directory(path);
+}
+
+PackedSnapshotReader::PackedSnapshotReader() : file(nullptr), header() {}
+
+PackedSnapshotReader::~PackedSnapshotReader() {
+    if (file) {
+        std::fclose(file);
+    }
+}
+
+bool PackedSnapshotReader::open(const std::string& path) {
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(path, ec);
+    file = ec ? nullptr : std::fopen(path.c_str(), "rb");
+    if (!file || std::fread(&header, sizeof(header), 1, file) != 1 ||
+        std::memcmp(header.magic, PACKED_MAGIC, sizeof(header.magic)) != 0 || header.version != PACKED_VERSION ||
+        size < sizeof(header) + static_cast<uint64_t>(header.admin_size)) {
+        return false;
+    }
+
+    std::string bytes(header.admin_size, '\0');
+    if (std::fread(bytes.data(), 1, bytes.size(), file) != bytes.size() ||
+        header_checksum(header, bytes) != header.checksum) {
+        return false;
+    }
+    const char* p = bytes.data();
+    const char* end = p + bytes.size();
+    std::string_view username, password;
+    for (uint32_t i = 0; i < header.admin_count; i++) {
+        if (!get_string(p, end, username) || !get_string(p, end, password)) {
+            return false;
+        }
+        admin_list.emplace_back(username, password);
+    }
+    return p == end;
+}
+
+bool PackedSnapshotReader::read_rows(const SnapshotWriter::RowVisitor& visit) {
+    std::vector<std::string> majors;
+    std::string stored, raw;
+    uint64_t rows = 0;
+    int last_id = 0;
+    for (uint32_t b = 0; b < header.block_count; b++) {
+        PackedBlock block;
+        if (std::fread(&block, sizeof(block), 1, file) != 1 || block.raw_size > MAX_RAW_SIZE ||
+            block.stored_size > block.raw_size) {
+            return false;
+        }
+        stored.resize(block.stored_size);
+        if (std::fread(stored.data(), 1, stored.size(), file) != stored.size() ||
+            snapshot_checksum(stored.data(), stored.size()) != block.checksum) {
+            return false;
+        }
+        if (block.compressed) {
+            if (!lz_decompress(stored.data(), stored.data() + stored.size(), block.raw_size, raw)) {
+                return false;
+            }
+        } else if (block.stored_size == block.raw_size) {
+            raw.swap(stored);
+        } else {
+            return false;
+        }
+        if (!decode_block(raw, block.rows, majors, last_id, visit)) {
+            return false;
+        }
+        rows += block.rows;
+    }
+    return rows == header.student_count && std::fgetc(file) == EOF;
+}
+
+bool is_packed_snapshot(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    char magic[sizeof(PACKED_MAGIC)];
+    return in.read(magic, sizeof(magic)) && std::memcmp(magic, PACKED_MAGIC, sizeof(magic)) == 0;
+}
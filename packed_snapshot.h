@@ -0,0 +1,105 @@
+#ifndef PACKED_SNAPSHOT_H
+#define PACKED_SNAPSHOT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+#include "snapshot.h"
+#include "student.h"
+
+// Compressed snapshot layout (host byte order):
+//
+//   PackedHeader
+//   admins                          varint-prefixed username and password
+//   block[block_count]              PackedBlock, then stored_size bytes
+//
+// Rows are in ascending id order, cut into blocks of about 64 KB. Within a
+// block each row is
+//
+//   varint   id minus the previous id in the block (the first from 0)
+//   varint   age, zigzag-encoded
+//   varint   name length, name
+//   varint   bytes shared with the previous reg_no in the block,
+//   varint   then the length and bytes of the rest (front coding)
+//   varint   major, as an index into the major dictionary
+//
+// preceded by the majors first used in this block, which extend the
+// dictionary in order. A block is then LZ-compressed as a whole, or
+// stored as is if that does not make it smaller. Each block carries a
+// checksum of its stored bytes, so it is checked before it is decoded, and
+// the header one of itself (with the checksum zeroed) and the admins.
+//
+// Unlike SnapshotRecord tables, blocks cannot be read in place, so a packed
+// file is always loaded in full, one block at a time.
+
+const char PACKED_MAGIC[8] = {'S', 'R', 'M', 'P', 'A', 'C', 'K', '\0'};
+const uint32_t PACKED_VERSION = 1;
+
+struct PackedHeader {
+    char magic[8];
+    uint32_t version;
+    int32_t next_id;
+    uint32_t admin_count;
+    uint32_t student_count;
+    uint32_t block_count;
+    uint32_t admin_size;
+    uint64_t change_seq;
+    uint64_t checksum;
+};
+
+struct PackedBlock {
+    uint32_t rows;
+    uint32_t raw_size;
+    uint32_t stored_size; // equal to raw_size when stored uncompressed
+    uint32_t compressed;
+    uint64_t checksum;
+};
+
+// Streams a packed snapshot to disk, running the row source once. Holds
+// one block and the major dictionary in memory.
+class PackedSnapshotWriter {
+private:
+    std::vector<std::pair<std::string, std::string>> admins;
+
+public:
+    void add_admin(const std::string& username, const std::string& password);
+    // Replaces path atomically, as SnapshotWriter::write() does.
+    bool write(const std::string& path, int next_id, uint64_t change_seq, size_t student_count,
+               const SnapshotWriter::RowSource& rows);
+};
+
+class PackedSnapshotReader {
+private:
+    FILE* file;
+    PackedHeader header;
+    std::vector<std::pair<std::string, std::string>> admin_list;
+
+public:
+    PackedSnapshotReader();
+    ~PackedSnapshotReader();
+    PackedSnapshotReader(const PackedSnapshotReader&) = delete;
+    PackedSnapshotReader& operator=(const PackedSnapshotReader&) = delete;
+
+    // Reads the header and the admins. Returns false if path is missing,
+    // not a packed snapshot, or its admins are damaged.
+    bool open(const std::string& path);
+
+    int next_id() const { return header.next_id; }
+    uint64_t change_seq() const { return header.change_seq; }
+    size_t student_count() const { return header.student_count; }
+    const std::vector<std::pair<std::string, std::string>>& admins() const { return admin_list; }
+
+    // Decodes the blocks in order and passes each row to visit; its views
+    // last until visit returns. False on a damaged block or a row count
+    // that does not match the header, by which time the rows before it
+    // have been visited.
+    bool read_rows(const SnapshotWriter::RowVisitor& visit);
+};
+
+// True if path starts with the packed snapshot magic.
+bool is_packed_snapshot(const std::string& path);
+
+#endif // PACKED_SNAPSHOT_H
@@ -0,0 +1,260 @@
+#include "paged_snapshot.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include "metrics.h"
+
+#ifndef _WIN32
+    #include <unistd.h>
+#endif
+
+StudentView SnapshotPage::view(size_t i) const {
+    const SnapshotRecord& r = records[i];
+    auto field = [this](uint32_t off, uint32_t len) {
+        return std::string_view(strings.data() + (off - strings_begin), len);
+    };
+    return StudentView{r.id, field(r.name_off, r.name_len), field(r.reg_no_off, r.reg_no_len), r.age,
+                       field(r.major_off, r.major_len)};
+}
+
+size_t SnapshotPage::memory_usage() const {
+    return sizeof(SnapshotPage) + records.capacity() * sizeof(SnapshotRecord) + strings.capacity();
+}
+
+PagedSnapshot::PagedSnapshot(size_t budget)
+    : file(nullptr), header(), records_offset(0), heap_offset(0), budget(budget), resident(0),
+      reg_built(false) {}
+
+PagedSnapshot::~PagedSnapshot() {
+    if (file) {
+        std::fclose(file);
+    }
+}
+
+bool PagedSnapshot::read_at(uint64_t offset, void* out, size_t size) {
+#ifdef _WIN32
+    std::lock_guard<std::mutex> lock(file_mutex);
+    return _fseeki64(file, static_cast<long long>(offset), SEEK_SET) == 0 &&
+           std::fread(out, 1, size, file) == size;
+#else
+    char* bytes = static_cast<char*>(out);
+    while (size > 0) {
+        ssize_t n = pread(fileno(file), bytes, size, static_cast<off_t>(offset));
+        if (n <= 0) return false;
+        bytes += n;
+        offset += static_cast<uint64_t>(n);
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+#endif
+}
+
+bool PagedSnapshot::open(const std::string& path) {
+    file = std::fopen(path.c_str(), "rb");
+    uint32_t version = 0;
+    if (!file || !read_at(offsetof(SnapshotHeader, version), &version, sizeof(version))) {
+        return false;
+    }
+    size_t header_size = snapshot_header_size(version);
+    if (header_size == 0 || !read_at(0, &header, header_size) ||
+        std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+        return false;
+    }
+
+    uint64_t admin_offset = header_size;
+    records_offset = admin_offset + static_cast<uint64_t>(header.admin_count) * sizeof(SnapshotAdmin);
+    heap_offset = records_offset + static_cast<uint64_t>(header.student_count) * sizeof(SnapshotRecord);
+    std::error_code ec;
+    if (std::filesystem::file_size(path, ec) != heap_offset + header.heap_size || ec) {
+        return false;
+    }
+
+    std::vector<SnapshotAdmin> admin_table(header.admin_count);
+    if (!read_at(admin_offset, admin_table.data(), admin_table.size() * sizeof(SnapshotAdmin))) {
+        return false;
+    }
+    for (const auto& a : admin_table) {
+        std::string username(a.username_len, '\0');
+        std::string password(a.password_len, '\0');
+        if (static_cast<uint64_t>(a.username_off) + a.username_len > header.heap_size ||
+            static_cast<uint64_t>(a.password_off) + a.password_len > header.heap_size ||
+            !read_at(heap_offset + a.username_off, username.data(), username.size()) ||
+            !read_at(heap_offset + a.password_off, password.data(), password.size())) {
+            return false;
+        }
+        admin_list.emplace_back(std::move(username), std::move(password));
+    }
+
+    first_ids.reset(new std::atomic<int>[page_count()]);
+    for (size_t i = 0; i < page_count(); i++) {
+        first_ids[i].store(0, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+std::shared_ptr<const SnapshotPage> PagedSnapshot::load(size_t index) {
+    auto page = std::make_shared<SnapshotPage>();
+    page->first = index * PAGE_RECORDS;
+    page->records.resize(std::min(PAGE_RECORDS, header.student_count - page->first));
+    if (!read_at(records_offset + page->first * sizeof(SnapshotRecord), page->records.data(),
+                 page->records.size() * sizeof(SnapshotRecord))) {
+        std::cerr << "Cannot read page " << index << " of the database file" << std::endl;
+        return nullptr;
+    }
+
+    // A page's strings were written one after another, but the bounds are
+    // taken over every field so that a damaged record cannot point outside
+    // the slice that is read.
+    uint64_t begin = header.heap_size;
+    uint64_t end = 0;
+    int previous = 0;
+    bool valid = true;
+    for (const auto& r : page->records) {
+        const uint32_t fields[3][2] = {{r.name_off, r.name_len}, {r.reg_no_off, r.reg_no_len},
+                                       {r.major_off, r.major_len}};
+        for (const auto& f : fields) {
+            begin = std::min<uint64_t>(begin, f[0]);
+            end = std::max<uint64_t>(end, static_cast<uint64_t>(f[0]) + f[1]);
+        }
+        valid = valid && r.id > previous;
+        previous = r.id;
+    }
+    if (!valid || end > header.heap_size) {
+        std::cerr << "Page " << index << " of the database file is corrupt" << std::endl;
+        return nullptr;
+    }
+    page->strings_begin = begin;
+    page->strings.resize(end - begin);
+    if (!read_at(heap_offset + begin, page->strings.data(), page->strings.size())) {
+        std::cerr << "Cannot read page " << index << " of the database file" << std::endl;
+        return nullptr;
+    }
+    return page;
+}
+
+std::shared_ptr<const SnapshotPage> PagedSnapshot::page(size_t index, bool cache) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = cached.find(index);
+        if (it != cached.end()) {
+            lru.splice(lru.begin(), lru, it->second);
+            metrics_cache_access(true);
+            return *it->second;
+        }
+    }
+    metrics_cache_access(false);
+
+    // Read without the lock, so hits on other threads are not held up by
+    // this one's I/O. Two threads missing on the same page both read it and
+    // the second keeps the first one's copy.
+    std::shared_ptr<const SnapshotPage> page = load(index);
+    if (!page || !cache) {
+        return page;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = cached.find(index);
+    if (it != cached.end()) {
+        return *it->second;
+    }
+    lru.push_front(page);
+    cached[index] = lru.begin();
+    resident += page->memory_usage();
+    while (resident > budget && lru.size() > 1) {
+        resident -= lru.back()->memory_usage();
+        cached.erase(lru.back()->first / PAGE_RECORDS);
+        lru.pop_back();
+    }
+    metrics_set_cache_resident(resident);
+    return page;
+}
+
+int PagedSnapshot::first_id(size_t index) {
+    int id = first_ids[index].load(std::memory_order_relaxed);
+    if (id == 0) {
+        int32_t value = 0;
+        read_at(records_offset + index * PAGE_RECORDS * sizeof(SnapshotRecord), &value, sizeof(value));
+        id = value;
+        first_ids[index].store(id, std::memory_order_relaxed);
+    }
+    return id;
+}
+
+size_t PagedSnapshot::page_of(int id) {
+    // Last page whose first id is at most id.
+    size_t lo = 0;
+    size_t hi = page_count();
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (first_id(mid) <= id) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+bool PagedSnapshot::find(int id, Student& out) {
+    if (page_count() == 0) {
+        return false;
+    }
+    std::shared_ptr<const SnapshotPage> p = page(page_of(id));
+    if (!p) {
+        return false;
+    }
+    auto it = std::lower_bound(p->records.begin(), p->records.end(), id,
+                               [](const SnapshotRecord& r, int value) { return r.id < value; });
+    if (it == p->records.end() || it->id != id) {
+        return false;
+    }
+    materialize(p->view(static_cast<size_t>(it - p->records.begin())), out);
+    return true;
+}
+
+void PagedSnapshot::build_reg_index() {
+    std::hash<std::string_view> hash;
+    reg_hashes.reserve(header.student_count);
+    for (size_t i = 0; i < page_count(); i++) {
+        std::shared_ptr<const SnapshotPage> p = page(i, false);
+        if (!p) continue;
+        for (size_t j = 0; j < p->records.size(); j++) {
+            StudentView s = p->view(j);
+            reg_hashes.emplace_back(hash(s.reg_no), s.id);
+        }
+    }
+    std::sort(reg_hashes.begin(), reg_hashes.end());
+    reg_built = true;
+}
+
+bool PagedSnapshot::find_reg_no(std::string_view reg_no, int& id) {
+    std::lock_guard<std::mutex> lock(reg_mutex);
+    if (!reg_built) {
+        build_reg_index();
+    }
+
+    // Equal hashes are only candidates; the row itself settles it.
+    size_t h = std::hash<std::string_view>()(reg_no);
+    auto it = std::lower_bound(reg_hashes.begin(), reg_hashes.end(), std::make_pair(h, 0));
+    Student s;
+    for (; it != reg_hashes.end() && it->first == h; ++it) {
+        if (find(it->second, s) && s.reg_no == reg_no) {
+            id = it->second;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t PagedSnapshot::memory_usage() {
+    size_t bytes;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        bytes = resident;
+    }
+    std::lock_guard<std::mutex> lock(reg_mutex);
+    return bytes + reg_hashes.capacity() * sizeof(reg_hashes[0]) + page_count() * sizeof(int);
+}
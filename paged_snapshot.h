@@ -0,0 +1,97 @@
+#ifndef PAGED_SNAPSHOT_H
+#define PAGED_SNAPSHOT_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "snapshot.h"
+#include "student.h"
+
+// A run of consecutive records from a snapshot's record table, with the
+// slice of the heap that holds their strings.
+struct SnapshotPage {
+    size_t first; // position of records[0] in the record table
+    std::vector<SnapshotRecord> records;
+    uint64_t strings_begin; // heap offset of strings[0]
+    std::string strings;
+
+    StudentView view(size_t i) const;
+    size_t memory_usage() const;
+};
+
+// Reads a binary snapshot on demand instead of loading it. open() reads
+// only the header and the admins; the record table is fixed width and
+// sorted by id, so it already is the id index, searched page by page.
+// Pages are read with one call for their records and one for their
+// strings, and kept in an LRU cache that holds at most `budget` bytes.
+//
+// The whole-file checksum would mean reading the whole file, so it is not
+// checked; every page is bounds-checked as it is read instead. Safe to
+// use from several threads.
+class PagedSnapshot {
+private:
+    FILE* file;
+#ifdef _WIN32
+    std::mutex file_mutex; // no positional reads; seek and read as one
+#endif
+    SnapshotHeader header;
+    uint64_t records_offset;
+    uint64_t heap_offset;
+    std::vector<std::pair<std::string, std::string>> admin_list;
+    std::unique_ptr<std::atomic<int>[]> first_ids; // per page, 0 until read
+
+    std::mutex mutex; // guards the cache
+    std::list<std::shared_ptr<const SnapshotPage>> lru; // most recent first
+    std::unordered_map<size_t, std::list<std::shared_ptr<const SnapshotPage>>::iterator> cached;
+    size_t budget;
+    size_t resident;
+
+    std::mutex reg_mutex;
+    bool reg_built;
+    std::vector<std::pair<size_t, int>> reg_hashes; // hash of reg_no -> id, sorted
+
+    bool read_at(uint64_t offset, void* out, size_t size);
+    std::shared_ptr<const SnapshotPage> load(size_t index);
+    int first_id(size_t index);
+    void build_reg_index();
+
+public:
+    static const size_t PAGE_RECORDS = 256;
+
+    explicit PagedSnapshot(size_t budget);
+    ~PagedSnapshot();
+    PagedSnapshot(const PagedSnapshot&) = delete;
+    PagedSnapshot& operator=(const PagedSnapshot&) = delete;
+
+    // Returns false if path is missing or not a binary snapshot.
+    bool open(const std::string& path);
+
+    int next_id() const { return header.next_id; }
+    uint64_t change_seq() const { return header.change_seq; }
+    size_t student_count() const { return header.student_count; }
+    size_t page_count() const { return (header.student_count + PAGE_RECORDS - 1) / PAGE_RECORDS; }
+    const std::vector<std::pair<std::string, std::string>>& admins() const { return admin_list; }
+
+    // Null if the page is corrupt. Scans pass cache = false: a page that is
+    // not cached already is then read without being kept, so one pass over
+    // the file does not push out the pages point lookups are using.
+    std::shared_ptr<const SnapshotPage> page(size_t index, bool cache = true);
+    // The page holding id, or the page it would be on.
+    size_t page_of(int id);
+    bool find(int id, Student& out);
+    // Built on first use with one pass over the file, at 16 bytes per row.
+    bool find_reg_no(std::string_view reg_no, int& id);
+
+    // Bytes of cached pages and the reg_no index.
+    size_t memory_usage();
+};
+
+#endif // PAGED_SNAPSHOT_H
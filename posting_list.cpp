@@ -0,0 +1,113 @@
+#include "posting_list.h"
+#include <algorithm>
+
+// The chunk that holds id, or would hold it: the first whose last id is
+// not below it, or last for an id above them all.
+size_t PostingList::chunk_for(int id) const {
+    auto it = std::lower_bound(head.begin(), head.end(), id,
+                               [](const std::vector<int>& chunk, int id) { return chunk.back() < id; });
+    return static_cast<size_t>(it - head.begin());
+}
+
+void PostingList::drop_chunk(size_t c) {
+    if (c < head.size()) {
+        head.erase(head.begin() + c);
+    } else if (!head.empty()) {
+        last = std::move(head.back());
+        head.pop_back();
+    }
+}
+
+bool PostingList::insert(int id) {
+    // New students get the highest id so far, making this an append. A
+    // full last chunk is left full rather than split, since appends never
+    // come back to it. The chunk after it is allocated at full size: a
+    // list that long will fill it, and growing it step by step would leave
+    // the heap strewn with the smaller buffers it outgrew.
+    if (count == 0 || last.back() < id) {
+        if (last.size() >= MAX_CHUNK) {
+            head.push_back(std::move(last));
+            last = std::vector<int>();
+            last.reserve(MAX_CHUNK);
+        }
+        last.push_back(id);
+        count++;
+        return true;
+    }
+
+    size_t c = chunk_for(id);
+    std::vector<int>& ids = chunk(c);
+    auto it = std::lower_bound(ids.begin(), ids.end(), id);
+    if (it != ids.end() && *it == id) {
+        return false;
+    }
+    ids.insert(it, id);
+    count++;
+    if (ids.size() > MAX_CHUNK) {
+        // The lower half moves out into a chunk of its own before this one.
+        std::vector<int> lower(ids.begin(), ids.begin() + ids.size() / 2);
+        ids.erase(ids.begin(), ids.begin() + lower.size());
+        head.insert(head.begin() + c, std::move(lower));
+    }
+    return true;
+}
+
+bool PostingList::erase(int id) {
+    if (count == 0) {
+        return false;
+    }
+    size_t c = chunk_for(id);
+    std::vector<int>& ids = chunk(c);
+    auto it = std::lower_bound(ids.begin(), ids.end(), id);
+    if (it == ids.end() || *it != id) {
+        return false;
+    }
+    ids.erase(it);
+    count--;
+
+    // Chunks emptied by deletes go, and nearly empty ones are merged into
+    // a neighbour, so scans do not walk a long tail of tiny chunks.
+    if (ids.empty()) {
+        drop_chunk(c);
+    } else if (ids.size() < MAX_CHUNK / 4 && !head.empty()) {
+        size_t into = c > 0 ? c - 1 : c;
+        std::vector<int>& low = chunk(into);
+        const std::vector<int>& high = chunk(into + 1);
+        if (low.size() + high.size() <= MAX_CHUNK) {
+            low.insert(low.end(), high.begin(), high.end());
+            drop_chunk(into + 1);
+        }
+    }
+    return true;
+}
+
+void PostingList::append_to(std::vector<int>& out) const {
+    out.reserve(out.size() + count);
+    for (const auto& ids : head) {
+        out.insert(out.end(), ids.begin(), ids.end());
+    }
+    out.insert(out.end(), last.begin(), last.end());
+}
+
+void PostingList::intersect(std::vector<int>& ids) const {
+    size_t kept = 0;
+    size_t c = 0;
+    size_t from = 0; // position in chunk(c) below which every id is smaller
+    size_t chunks = count == 0 ? 0 : head.size() + 1;
+    for (int id : ids) {
+        while (c < chunks && chunk(c).back() < id) {
+            c++;
+            from = 0;
+        }
+        if (c == chunks) {
+            break;
+        }
+        const std::vector<int>& in = chunk(c);
+        auto it = std::lower_bound(in.begin() + from, in.end(), id);
+        from = static_cast<size_t>(it - in.begin());
+        if (*it == id) {
+            ids[kept++] = id;
+        }
+    }
+    ids.resize(kept);
+}
@@ -0,0 +1,58 @@
+#ifndef POSTING_LIST_H
+#define POSTING_LIST_H
+
+#include <cstddef>
+#include <vector>
+
+// Sorted set of student ids, the posting list of one index key. The ids
+// are kept in chunks of at most MAX_CHUNK, in ascending order, so adding
+// or removing an id only shifts the rest of its own chunk: O(log n + chunk)
+// however long the list. A single sorted vector would shift everything
+// after the id, which for a common trigram or a popular major is a large
+// share of the table. Appending an id above the rest, as every add does,
+// is still a push_back: the last chunk is held inline, so a list of one
+// chunk costs no more than a plain vector.
+class PostingList {
+private:
+    static const size_t MAX_CHUNK = 1024;
+
+    std::vector<std::vector<int>> head; // chunks before last, none empty
+    std::vector<int> last; // empty only if the whole list is
+    size_t count;
+
+    // Chunk c counts head first, then last at head.size().
+    std::vector<int>& chunk(size_t c) { return c < head.size() ? head[c] : last; }
+    const std::vector<int>& chunk(size_t c) const { return c < head.size() ? head[c] : last; }
+    size_t chunk_for(int id) const;
+    void drop_chunk(size_t c);
+
+public:
+    PostingList() : count(0) {}
+
+    // Return false if id was already in the list, or was not in it.
+    bool insert(int id);
+    bool erase(int id);
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    // Appends the ids to out in ascending order.
+    void append_to(std::vector<int>& out) const;
+    // Drops from ids, which must be sorted, every id not in the list. One
+    // pass over both, moving forward through the chunks.
+    void intersect(std::vector<int>& ids) const;
+
+    template <typename Visit>
+    void for_each(Visit visit) const {
+        for (const auto& chunk : head) {
+            for (int id : chunk) {
+                visit(id);
+            }
+        }
+        for (int id : last) {
+            visit(id);
+        }
+    }
+};
+
+#endif // POSTING_LIST_H
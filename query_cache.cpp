@@ -0,0 +1,78 @@
+#include "query_cache.h"
+#include <algorithm>
+#include "fold_search.h"
+
+static bool matches(const StudentView& s, const std::string& lower_query) {
+    return contains_folded(s.name, lower_query) || contains_folded(s.reg_no, lower_query) ||
+           contains_folded(s.major, lower_query);
+}
+
+QueryCache::QueryCache(size_t max_entries, size_t max_ids)
+    : max_entries(max_entries), max_ids(max_ids), held_ids(0) {}
+
+void QueryCache::resize(size_t entries_limit, size_t ids_limit) {
+    max_entries = entries_limit;
+    max_ids = ids_limit;
+    shrink();
+}
+
+void QueryCache::erase(std::list<Entry>::iterator it) {
+    held_ids -= it->ids.size();
+    entries.erase(it->query);
+    lru.erase(it);
+}
+
+void QueryCache::shrink() {
+    while (!lru.empty() && (lru.size() > max_entries || held_ids > max_ids)) {
+        erase(std::prev(lru.end()));
+    }
+}
+
+bool QueryCache::find(const std::string& lower_query, std::vector<int>& ids) {
+    auto it = entries.find(lower_query);
+    if (it == entries.end()) {
+        return false;
+    }
+    lru.splice(lru.begin(), lru, it->second);
+    ids = it->second->ids;
+    return true;
+}
+
+void QueryCache::insert(const std::string& lower_query, const std::vector<int>& ids) {
+    if (max_entries == 0 || ids.size() > max_ids) {
+        return;
+    }
+    auto it = entries.find(lower_query);
+    if (it != entries.end()) {
+        erase(it->second);
+    }
+    lru.push_front(Entry{lower_query, ids});
+    entries[lru.front().query] = lru.begin();
+    held_ids += ids.size();
+    shrink();
+}
+
+void QueryCache::update(int id, const StudentView* before, const StudentView* after) {
+    for (auto& entry : lru) {
+        bool was = before && matches(*before, entry.query);
+        bool now = after && matches(*after, entry.query);
+        if (was == now) continue;
+
+        auto pos = std::lower_bound(entry.ids.begin(), entry.ids.end(), id);
+        bool present = pos != entry.ids.end() && *pos == id;
+        if (now && !present) {
+            entry.ids.insert(pos, id);
+            held_ids++;
+        } else if (!now && present) {
+            entry.ids.erase(pos);
+            held_ids--;
+        }
+    }
+    shrink();
+}
+
+void QueryCache::clear() {
+    lru.clear();
+    entries.clear();
+    held_ids = 0;
+}
@@ -0,0 +1,55 @@
+#ifndef QUERY_CACHE_H
+#define QUERY_CACHE_H
+
+#include <cstddef>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "student.h"
+
+// Bounded LRU cache from a folded search query to the sorted ids of the
+// students it matched. Holds at most max_entries queries and max_ids ids
+// in total; a result bigger than max_ids is not kept.
+//
+// Only ids are kept, so a changed row only matters to the queries it
+// matches before the change but not after, or the other way round. Those
+// entries have the id taken out or put in; nothing is dropped, and popular
+// queries stay cached however often rows change. Not thread-safe.
+class QueryCache {
+private:
+    struct Entry {
+        std::string query;
+        std::vector<int> ids;
+    };
+
+    std::list<Entry> lru; // most recent first
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> entries; // views Entry::query
+    size_t max_entries;
+    size_t max_ids;
+    size_t held_ids;
+
+    void erase(std::list<Entry>::iterator it);
+    void shrink();
+
+public:
+    QueryCache(size_t max_entries, size_t max_ids);
+
+    void resize(size_t max_entries, size_t max_ids);
+    bool enabled() const { return max_entries > 0; }
+
+    // Copies out the ids cached for lower_query, if any.
+    bool find(const std::string& lower_query, std::vector<int>& ids);
+    void insert(const std::string& lower_query, const std::vector<int>& ids);
+
+    // Brings the entries up to date with a changed row. before is the row
+    // as it was, or null for an add; after is the row as it is now, or null
+    // for a delete.
+    void update(int id, const StudentView* before, const StudentView* after);
+    void clear();
+
+    size_t size() const { return lru.size(); }
+};
+
+#endif // QUERY_CACHE_H
@@ -0,0 +1,66 @@
+#include "replica.h"
+#include <filesystem>
+#include <iostream>
+#include "change_feed.h"
+
+Replica::Replica(Database& db, const std::string& leader_path, std::chrono::microseconds interval)
+    : db(db), feed_path(leader_path + ".changes"), interval(interval), stopping(false) {}
+
+Replica::~Replica() {
+    stop();
+}
+
+void Replica::start() {
+    stopping = false;
+    thread = std::thread(&Replica::run, this);
+}
+
+void Replica::stop() {
+    stopping = true;
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void Replica::run() {
+    ChangeFeedReader reader(feed_path, db.last_change());
+    bool stalled = false;
+    while (!stopping) {
+        size_t applied = reader.poll([this, &stalled](uint64_t first_seq, const std::vector<std::string>& records) {
+            if (db.apply_changes(first_seq, records)) {
+                stalled = false;
+                return true;
+            }
+            if (!stalled && first_seq <= db.last_change() + 1) {
+                std::cerr << "Cannot log changes from " << feed_path << "; retrying" << std::endl;
+            } else if (!stalled) {
+                std::cerr << "Change feed " << feed_path << " skips from change " << db.last_change() << " to "
+                          << first_seq << "; copy the leader's database again to catch up" << std::endl;
+            }
+            stalled = true;
+            return false;
+        });
+        if (stalled) {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+        } else if (applied == 0) {
+            std::this_thread::sleep_for(interval);
+        }
+    }
+}
+
+// The leader replaces its snapshot by renaming a new file over it, so the
+// copy is always of one whole snapshot.
+bool Replica::bootstrap(const std::string& leader_path, const std::string& path) {
+    std::error_code ec;
+    if (std::filesystem::exists(path, ec)) {
+        return true;
+    }
+    if (!std::filesystem::exists(leader_path, ec)) {
+        return true; // Nothing checkpointed yet; follow from the first change
+    }
+    if (!std::filesystem::copy_file(leader_path, path, ec)) {
+        std::cerr << "Cannot copy " << leader_path << " to " << path << ": " << ec.message() << std::endl;
+        return false;
+    }
+    return true;
+}
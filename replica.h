@@ -0,0 +1,43 @@
+#ifndef REPLICA_H
+#define REPLICA_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include "database.h"
+
+// Keeps a database in step with another database's change feed, which
+// may belong to another process. A thread polls the feed and applies
+// each change or batch as it arrives, so the follower serves reads that
+// lag the leader by about one poll interval plus the apply.
+class Replica {
+private:
+    Database& db;
+    std::string feed_path;
+    std::chrono::microseconds interval;
+    std::atomic<bool> stopping;
+    std::thread thread;
+
+    void run();
+
+public:
+    // leader_path is the leader's students.db; its feed is read from
+    // leader_path + ".changes".
+    Replica(Database& db, const std::string& leader_path,
+            std::chrono::microseconds interval = std::chrono::milliseconds(1));
+    ~Replica(); // Stops following
+    Replica(const Replica&) = delete;
+    Replica& operator=(const Replica&) = delete;
+
+    // Call once db.init() has succeeded; follows from db.last_change().
+    void start();
+    void stop();
+
+    // Copies the leader's snapshot to path if path does not exist yet, so
+    // a new follower starts from the leader's last checkpoint rather than
+    // from the first change. Call before init().
+    static bool bootstrap(const std::string& leader_path, const std::string& path);
+};
+
+#endif // REPLICA_H
@@ -0,0 +1,48 @@
+#ifndef RW_LOCK_H
+#define RW_LOCK_H
+
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+
+// Reader/writer lock that does not let readers starve writers.
+// std::shared_mutex on glibc prefers readers, so a steady stream of
+// lookups keeps a writer waiting indefinitely. Here a waiting writer
+// closes a gate that new readers queue behind, while readers already
+// inside finish normally. Uncontended readers only pay an atomic load on
+// top of the shared_mutex.
+//
+// Satisfies SharedMutex, so it works with std::unique_lock and
+// std::shared_lock.
+class RwLock {
+private:
+    std::shared_mutex rw;
+    std::mutex writer_gate;
+    std::atomic<int> writers_waiting{0};
+
+public:
+    void lock() {
+        writers_waiting.fetch_add(1, std::memory_order_acq_rel);
+        writer_gate.lock();
+        rw.lock();
+    }
+
+    void unlock() {
+        rw.unlock();
+        writer_gate.unlock();
+        writers_waiting.fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    void lock_shared() {
+        if (writers_waiting.load(std::memory_order_acquire) > 0) {
+            std::lock_guard<std::mutex> wait_for_writers(writer_gate);
+        }
+        rw.lock_shared();
+    }
+
+    void unlock_shared() {
+        rw.unlock_shared();
+    }
+};
+
+#endif // RW_LOCK_H
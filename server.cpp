@@ -0,0 +1,598 @@
+#include "server.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include "metrics.h"
+
+#ifdef __linux__
+    #include <arpa/inet.h>
+    #include <cerrno>
+    #include <csignal>
+    #include <cstring>
+    #include <fcntl.h>
+    #include <memory>
+    #include <mutex>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <sys/epoll.h>
+    #include <sys/eventfd.h>
+    #include <sys/signalfd.h>
+    #include <sys/socket.h>
+    #include <sys/stat.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+    #include <unordered_map>
+    #include "thread_pool.h"
+#endif
+
+static void split_fields(const std::string& line, std::vector<std::string>& fields) {
+    fields.clear();
+    size_t start = 0;
+    while (true) {
+        size_t tab = line.find('\t', start);
+        fields.push_back(line.substr(start, tab == std::string::npos ? std::string::npos : tab - start));
+        if (tab == std::string::npos) return;
+        start = tab + 1;
+    }
+}
+
+static bool parse_int(const std::string& text, int& value) {
+    if (text.empty()) return false;
+    char* end = nullptr;
+    long parsed = std::strtol(text.c_str(), &end, 10);
+    if (*end != '\0' || parsed < 0 || parsed > 2147483647L) return false;
+    value = static_cast<int>(parsed);
+    return true;
+}
+
+static void append_row(std::string& out, const Student& s) {
+    out += std::to_string(s.id);
+    out += '\t';
+    out += s.name;
+    out += '\t';
+    out += s.reg_no;
+    out += '\t';
+    out += std::to_string(s.age);
+    out += '\t';
+    out += s.major;
+    out += '\n';
+}
+
+const int LIST_PAGE = 100;      // Rows LIST answers with by default...
+const int MAX_LIST_PAGE = 1000; // ...and at most
+
+// '|' would corrupt the log and text formats.
+static bool valid_fields(const std::vector<std::string>& fields, size_t first) {
+    for (size_t i = first; i < fields.size(); i++) {
+        if (fields[i].find('|') != std::string::npos) return false;
+    }
+    return true;
+}
+
+// user is the admin the connection has logged in as, or empty; LOGIN and
+// SESSION set it, and every other request requires it, or with
+// anonymous_reads only ADD, UPDATE and DELETE do.
+static void handle_request(Database& db, bool read_only, bool anonymous_reads, const std::string& line,
+                           std::string& user, std::string& out) {
+    std::vector<std::string> f;
+    split_fields(line, f);
+    const std::string& command = f[0];
+    int id, age;
+    int after = 0, limit = LIST_PAGE;
+
+    bool write = command == "ADD" || command == "UPDATE" || command == "DELETE";
+    if (write && read_only) {
+        out += "ERR read-only replica\n";
+        return;
+    }
+    bool login = command == "LOGIN" || command == "SESSION";
+    if (user.empty() && (write || (!login && !anonymous_reads))) {
+        out += "ERR login required\n";
+        return;
+    }
+
+    if (command == "LOGIN" && f.size() == 3) {
+        std::string token;
+        AuthResult result = db.login(f[1], f[2], token);
+        if (result == AuthResult::Ok) {
+            user = f[1];
+            out += "OK 1\n" + token + "\n";
+        } else {
+            out += result == AuthResult::Throttled ? "ERR too many attempts\n" : "ERR invalid credentials\n";
+        }
+    } else if (command == "SESSION" && f.size() == 2) {
+        std::string name;
+        if (db.resume_session(f[1], name)) {
+            user = name;
+            out += "OK 0\n";
+        } else {
+            out += "ERR invalid session\n";
+        }
+    } else if (command == "GET" && f.size() == 2 && parse_int(f[1], id)) {
+        std::optional<Student> s = db.get_student(id);
+        if (!s) {
+            out += "ERR not found\n";
+            return;
+        }
+        out += "OK 1\n";
+        append_row(out, *s);
+    } else if (command == "SEARCH" && f.size() <= 2) {
+        std::vector<Student> results = db.search_students(f.size() == 2 ? f[1] : "");
+        out += "OK " + std::to_string(results.size()) + "\n";
+        for (const auto& s : results) {
+            append_row(out, s);
+        }
+    } else if (command == "RANK" && (f.size() == 2 || (f.size() == 3 && parse_int(f[2], id) && id > 0))) {
+        std::vector<ScoredStudent> results = db.search_ranked(f[1], f.size() == 3 ? static_cast<size_t>(id) : 10);
+        out += "OK " + std::to_string(results.size()) + "\n";
+        for (const auto& r : results) {
+            append_row(out, r.student);
+        }
+    } else if (command == "LIST" && f.size() <= 3 && (f.size() < 2 || parse_int(f[1], after)) &&
+               (f.size() < 3 || (parse_int(f[2], limit) && limit > 0))) {
+        // One page at a time, so a large roster is neither copied under
+        // the lock nor buffered whole; the client passes the last id back.
+        std::vector<Student> page;
+        if (after < 2147483647) {
+            page = db.students_after(after, static_cast<size_t>(std::min(limit, MAX_LIST_PAGE)));
+        }
+        out += "OK " + std::to_string(page.size()) + "\n";
+        for (const auto& s : page) {
+            append_row(out, s);
+        }
+    } else if (command == "ADD" && f.size() == 5 && parse_int(f[3], age)) {
+        if (!valid_fields(f, 1)) {
+            out += "ERR fields may not contain '|'\n";
+            return;
+        }
+        Student s;
+        s.id = db.add_student(f[1], f[2], age, f[4]);
+        if (s.id < 0) {
+            out += "ERR duplicate reg_no\n";
+            return;
+        }
+        if (s.id == 0) {
+            out += "ERR cannot write log\n";
+            return;
+        }
+        s.name = f[1];
+        s.reg_no = f[2];
+        s.age = age;
+        s.major = f[4];
+        out += "OK 1\n";
+        append_row(out, s);
+    } else if (command == "UPDATE" && f.size() == 6 && parse_int(f[1], id) && parse_int(f[4], age)) {
+        if (!valid_fields(f, 2)) {
+            out += "ERR fields may not contain '|'\n";
+            return;
+        }
+        if (!db.update_student(id, f[2], f[3], age, f[5])) {
+            out += "ERR not found or duplicate reg_no\n";
+            return;
+        }
+        Student s;
+        s.id = id;
+        s.name = f[2];
+        s.reg_no = f[3];
+        s.age = age;
+        s.major = f[5];
+        out += "OK 1\n";
+        append_row(out, s);
+    } else if (command == "DELETE" && f.size() == 2 && parse_int(f[1], id)) {
+        out += db.delete_student(id) ? "OK 0\n" : "ERR not found\n";
+    } else if (command == "CHANGE" && f.size() == 1) {
+        out += "OK 1\n" + std::to_string(db.last_change()) + "\n";
+    } else if (command == "SYNC" && f.size() == 1) {
+        out += db.flush() ? "OK 0\n" : "ERR sync failed\n";
+    } else if (command == "METRICS" && f.size() == 1) {
+        std::string text = metrics_prometheus();
+        size_t lines = 0;
+        for (char c : text) {
+            if (c == '\n') lines++;
+        }
+        out += "OK " + std::to_string(lines) + "\n";
+        out += text;
+    } else {
+        out += "ERR bad request\n";
+    }
+}
+
+#ifdef __linux__
+
+namespace {
+
+const size_t MAX_LINE = 64 * 1024;      // Longest request accepted
+const size_t MAX_PENDING_IN = 4 << 20;  // Stop reading past this much queued input...
+const size_t MAX_PENDING_OUT = 4 << 20; // ...or this much unsent output
+
+// Fixed epoll tags; connections are numbered after these.
+const uint64_t TAG_LISTEN = 0;
+const uint64_t TAG_WAKE = 1;
+const uint64_t TAG_SIGNAL = 2;
+
+struct Connection {
+    int fd;
+    std::string in;     // Received bytes not yet handed to a worker
+    std::string out;    // Responses not yet sent
+    size_t out_sent = 0;
+    bool busy = false;  // A batch of requests is running on the pool
+    bool eof = false;   // Peer finished sending
+    bool broken = false;
+    std::string user;   // Logged-in admin; only the batch in flight changes it
+    uint32_t events = EPOLLIN | EPOLLRDHUP; // Currently registered with epoll
+};
+
+struct Completion {
+    uint64_t conn;
+    std::string response;
+    std::string user;
+};
+
+// Single-threaded epoll loop owning every socket. Complete request lines
+// read from a connection are handed to the pool as one batch; the batch's
+// responses come back through an eventfd. A connection has at most one
+// batch in flight, which keeps its responses in request order while
+// different connections run in parallel.
+class Server {
+private:
+    Database& db;
+    bool read_only;
+    bool anonymous_reads;
+    int epfd = -1;
+    int listen_fd = -1;
+    int wake_fd = -1;
+    int signal_fd = -1;
+    std::string unix_path;
+    uint64_t next_conn = 3;
+    std::unordered_map<uint64_t, Connection> conns;
+    std::mutex done_mutex;
+    std::vector<Completion> done;
+    std::unique_ptr<ThreadPool> pool; // Last: joined before the rest is torn down
+
+    bool listen_on(const std::string& address);
+    void accept_all();
+    void on_readable(uint64_t id, Connection& c);
+    void on_completions();
+    void dispatch(uint64_t id, Connection& c);
+    void flush(Connection& c);
+    void update_interest(uint64_t id, Connection& c);
+    void close_if_done(uint64_t id);
+
+public:
+    Server(Database& db, bool read_only, bool anonymous_reads)
+        : db(db), read_only(read_only), anonymous_reads(anonymous_reads) {}
+    ~Server();
+    int run(const std::string& address, size_t workers);
+};
+
+Server::~Server() {
+    pool.reset();
+    for (auto& entry : conns) {
+        ::close(entry.second.fd);
+    }
+    if (listen_fd >= 0) ::close(listen_fd);
+    if (wake_fd >= 0) ::close(wake_fd);
+    if (signal_fd >= 0) ::close(signal_fd);
+    if (epfd >= 0) ::close(epfd);
+    if (!unix_path.empty()) ::unlink(unix_path.c_str());
+}
+
+bool Server::listen_on(const std::string& address) {
+    if (address.compare(0, 5, "unix:") == 0) {
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        std::string path = address.substr(5);
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+            std::cerr << "Invalid socket path '" << path << "'" << std::endl;
+            return false;
+        }
+        std::strcpy(addr.sun_path, path.c_str());
+        // A socket left behind by a previous run is replaced; anything else
+        // at the path is not ours to remove.
+        struct stat st;
+        if (::lstat(path.c_str(), &st) == 0) {
+            if (!S_ISSOCK(st.st_mode)) {
+                std::cerr << "Cannot bind " << path << ": exists and is not a socket" << std::endl;
+                return false;
+            }
+            ::unlink(path.c_str());
+        }
+
+        listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd < 0 || ::bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            std::cerr << "Cannot bind " << path << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        unix_path = path;
+    } else {
+        size_t colon = address.rfind(':');
+        int port;
+        if (colon == std::string::npos || !parse_int(address.substr(colon + 1), port) || port > 65535) {
+            std::cerr << "Invalid address '" << address << "', expected host:port or unix:/path" << std::endl;
+            return false;
+        }
+        std::string host = address.substr(0, colon);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        if (host == "localhost") host = "127.0.0.1";
+        if (::inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+            std::cerr << "Invalid IPv4 address '" << host << "'" << std::endl;
+            return false;
+        }
+
+        listen_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int one = 1;
+        if (listen_fd >= 0) {
+            ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        }
+        if (listen_fd < 0 || ::bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            std::cerr << "Cannot bind " << address << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+    }
+
+    if (::listen(listen_fd, SOMAXCONN) != 0) {
+        std::cerr << "Cannot listen on " << address << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void Server::accept_all() {
+    while (true) {
+        int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                std::cerr << "accept: " << std::strerror(errno) << std::endl;
+            }
+            return;
+        }
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // Fails harmlessly on Unix sockets
+
+        uint64_t id = next_conn++;
+        epoll_event ev = {};
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.u64 = id;
+        if (::epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            ::close(fd);
+            continue;
+        }
+        Connection& c = conns[id];
+        c.fd = fd;
+    }
+}
+
+void Server::on_readable(uint64_t id, Connection& c) {
+    char buf[16384];
+    while (c.in.size() < MAX_PENDING_IN) {
+        ssize_t n = ::recv(c.fd, buf, sizeof(buf), 0);
+        if (n > 0) {
+            c.in.append(buf, static_cast<size_t>(n));
+            continue;
+        }
+        if (n == 0) {
+            c.eof = true;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            c.broken = true;
+        }
+        break;
+    }
+    dispatch(id, c);
+}
+
+void Server::dispatch(uint64_t id, Connection& c) {
+    if (c.busy || c.broken || c.out.size() - c.out_sent > MAX_PENDING_OUT) {
+        return;
+    }
+
+    size_t end = c.in.rfind('\n');
+    if (end == std::string::npos) {
+        if (c.in.size() > MAX_LINE) {
+            c.out += "ERR request too long\n";
+            c.in.clear();
+            c.eof = true;
+            flush(c);
+        }
+        return;
+    }
+
+    std::string batch = c.in.substr(0, end + 1);
+    c.in.erase(0, end + 1);
+    c.busy = true;
+
+    pool->submit([this, id, batch = std::move(batch), user = c.user]() mutable {
+        std::string response;
+        size_t start = 0;
+        while (start < batch.size()) {
+            size_t eol = batch.find('\n', start);
+            std::string line = batch.substr(start, eol - start);
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            handle_request(db, read_only, anonymous_reads, line, user, response);
+            start = eol + 1;
+        }
+        {
+            std::lock_guard<std::mutex> lock(done_mutex);
+            done.push_back({id, std::move(response), std::move(user)});
+        }
+        uint64_t one = 1;
+        ssize_t ignored = ::write(wake_fd, &one, sizeof(one));
+        (void)ignored;
+    });
+}
+
+void Server::on_completions() {
+    uint64_t count;
+    ssize_t ignored = ::read(wake_fd, &count, sizeof(count));
+    (void)ignored;
+
+    std::vector<Completion> batch;
+    {
+        std::lock_guard<std::mutex> lock(done_mutex);
+        batch.swap(done);
+    }
+    for (auto& completion : batch) {
+        auto it = conns.find(completion.conn);
+        if (it == conns.end()) continue;
+
+        Connection& c = it->second;
+        c.busy = false;
+        c.user = std::move(completion.user);
+        if (!c.broken) {
+            c.out += completion.response;
+            flush(c);
+            dispatch(completion.conn, c);
+        }
+        close_if_done(completion.conn);
+    }
+}
+
+void Server::flush(Connection& c) {
+    while (c.out_sent < c.out.size() && !c.broken) {
+        ssize_t n = ::send(c.fd, c.out.data() + c.out_sent, c.out.size() - c.out_sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            c.out_sent += static_cast<size_t>(n);
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            c.broken = true;
+        }
+    }
+    if (c.out_sent == c.out.size()) {
+        c.out.clear();
+        c.out_sent = 0;
+    }
+}
+
+// Reads pause while a client has too much queued in either direction, so
+// one that pipelines without reading its responses cannot grow the
+// buffers without bound.
+void Server::update_interest(uint64_t id, Connection& c) {
+    size_t unsent = c.out.size() - c.out_sent;
+    uint32_t events = 0;
+    if (!c.eof && !c.broken && c.in.size() < MAX_PENDING_IN && unsent <= MAX_PENDING_OUT) {
+        events |= EPOLLIN | EPOLLRDHUP;
+    }
+    if (unsent > 0 && !c.broken) {
+        events |= EPOLLOUT;
+    }
+    if (events == c.events) return;
+
+    c.events = events;
+    epoll_event ev = {};
+    ev.events = events;
+    ev.data.u64 = id;
+    ::epoll_ctl(epfd, EPOLL_CTL_MOD, c.fd, &ev);
+}
+
+void Server::close_if_done(uint64_t id) {
+    auto it = conns.find(id);
+    if (it == conns.end()) return;
+
+    Connection& c = it->second;
+    bool drained = c.out.empty() && c.in.find('\n') == std::string::npos;
+    if (c.busy || !(c.broken || (c.eof && drained))) {
+        update_interest(id, c);
+        return;
+    }
+    ::epoll_ctl(epfd, EPOLL_CTL_DEL, c.fd, nullptr);
+    ::close(c.fd);
+    conns.erase(it);
+}
+
+int Server::run(const std::string& address, size_t workers) {
+    // Block the shutdown signals before starting threads so that every
+    // thread inherits the mask and they arrive only through signal_fd.
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+    ::signal(SIGPIPE, SIG_IGN);
+
+    epfd = ::epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    signal_fd = ::signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (epfd < 0 || wake_fd < 0 || signal_fd < 0) {
+        std::cerr << "Cannot set up event loop: " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    if (!listen_on(address)) {
+        return 1;
+    }
+
+    const std::pair<int, uint64_t> fixed[] = {{listen_fd, TAG_LISTEN}, {wake_fd, TAG_WAKE}, {signal_fd, TAG_SIGNAL}};
+    for (const auto& entry : fixed) {
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u64 = entry.second;
+        ::epoll_ctl(epfd, EPOLL_CTL_ADD, entry.first, &ev);
+    }
+
+    pool.reset(new ThreadPool(workers));
+    std::cout << "Serving on " << address << " with " << pool->size() << " worker(s)" << std::endl;
+
+    epoll_event events[128];
+    bool running = true;
+    while (running) {
+        int n = ::epoll_wait(epfd, events, 128, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "epoll_wait: " << std::strerror(errno) << std::endl;
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            uint64_t tag = events[i].data.u64;
+            if (tag == TAG_LISTEN) {
+                accept_all();
+            } else if (tag == TAG_WAKE) {
+                on_completions();
+            } else if (tag == TAG_SIGNAL) {
+                running = false;
+            } else {
+                auto it = conns.find(tag);
+                if (it == conns.end()) continue;
+
+                Connection& c = it->second;
+                if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                    on_readable(tag, c);
+                }
+                if (events[i].events & EPOLLOUT) {
+                    flush(c);
+                    dispatch(tag, c);
+                }
+                close_if_done(tag);
+            }
+        }
+    }
+
+    std::cout << "Shutting down" << std::endl;
+    return 0;
+}
+
+} // namespace
+
+int run_server(Database& db, const std::string& address, size_t workers, bool read_only, bool anonymous_reads) {
+    Server server(db, read_only, anonymous_reads);
+    return server.run(address, workers);
+}
+
+#else
+
+int run_server(Database& db, const std::string& address, size_t workers, bool read_only, bool anonymous_reads) {
+    (void)db;
+    (void)address;
+    (void)workers;
+    (void)read_only;
+    (void)anonymous_reads;
+    (void)handle_request;
+    std::cerr << "--serve is only supported on Linux" << std::endl;
+    return 1;
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <string>
+#include "database.h"
+
+// Serves db over a local socket until SIGINT or SIGTERM, then returns a
+// process exit code. address is "host:port" for TCP or "unix:/path" for a
+// Unix domain socket. Requests run on a pool of `workers` threads.
+//
+// Protocol: one request per line, fields separated by tabs.
+//
+//   LOGIN <username> <password>
+//   SESSION <token>
+//   GET <id>
+//   SEARCH <query>
+//   RANK <query> [<k>]
+//   LIST [<after_id> [<limit>]]
+//   ADD <name> <reg_no> <age> <major>
+//   UPDATE <id> <name> <reg_no> <age> <major>
+//   DELETE <id>
+//   CHANGE
+//   SYNC
+//   METRICS
+//
+// Each request gets exactly one response, in request order, so clients may
+// pipeline. A response is "OK <n>" followed by n student rows
+// (id, name, reg_no, age, major, tab-separated), or "ERR <message>". ADD
+// and UPDATE answer with the stored row. RANK answers with the best k
+// (default 10) fuzzy matches, best first. LIST answers with a page of
+// students in id order, those with ids above after_id (default 0), at most
+// limit of them (default 100, capped at 1000); pass the last id of a page
+// to get the next, until a page comes back short. CHANGE answers with one
+// line, the sequence number of the last change applied (see ChangeFeed).
+// SYNC answers "OK 0" once every earlier write is on disk (see
+// Database::flush()). METRICS answers with n lines of Prometheus text
+// exposition instead of rows.
+//
+// Every request but LOGIN and SESSION needs a logged-in connection; with
+// anonymous_reads, only ADD, UPDATE and DELETE do. LOGIN answers
+// "OK 1" and a session token; SESSION logs another connection in with that
+// token without checking the password again. Repeated failed logins are
+// throttled with "ERR too many attempts".
+//
+// A read_only server, such as a follower's, refuses ADD, UPDATE and DELETE
+// with "ERR read-only replica".
+int run_server(Database& db, const std::string& address, size_t workers, bool read_only = false,
+               bool anonymous_reads = false);
+
+#endif // SERVER_H
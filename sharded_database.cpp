@@ -0,0 +1,238 @@
+#include "sharded_database.h"
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <queue>
+#include <tuple>
+#include <unordered_set>
+
+// Merges runs that are each already sorted by less into one sorted run.
+template <typename Less>
+static std::vector<Student> merge_runs(std::vector<std::vector<Student>>& runs, Less less) {
+    size_t total = 0;
+    for (const auto& run : runs) {
+        total += run.size();
+    }
+    std::vector<Student> merged;
+    merged.reserve(total);
+
+    // Heap of (run, position), smallest head on top.
+    using Head = std::pair<size_t, size_t>;
+    auto later = [&](const Head& a, const Head& b) {
+        return less(runs[b.first][b.second], runs[a.first][a.second]);
+    };
+    std::priority_queue<Head, std::vector<Head>, decltype(later)> heads(later);
+    for (size_t r = 0; r < runs.size(); r++) {
+        if (!runs[r].empty()) heads.emplace(r, 0);
+    }
+    while (!heads.empty()) {
+        Head head = heads.top();
+        heads.pop();
+        merged.push_back(std::move(runs[head.first][head.second]));
+        if (++head.second < runs[head.first].size()) {
+            heads.push(head);
+        }
+    }
+    return merged;
+}
+
+static bool by_id(const Student& a, const Student& b) {
+    return a.id < b.id;
+}
+
+ShardedDatabase::ShardedDatabase(const std::string& path, size_t shard_count, ThreadPool& pool)
+    : pool(pool), next_shard(0) {
+    if (shard_count == 0) shard_count = 1;
+    int n = static_cast<int>(shard_count);
+    for (int k = 0; k < n; k++) {
+        shards.push_back(std::make_unique<Database>(shard_path(path, k, shard_count)));
+        shards.back()->set_id_sequence(k == 0 ? n : k, n);
+    }
+}
+
+std::string ShardedDatabase::shard_path(const std::string& path, size_t shard, size_t shard_count) {
+    return path + "." + std::to_string(shard) + "-of-" + std::to_string(shard_count);
+}
+
+size_t ShardedDatabase::home_of(int id) const {
+    return static_cast<size_t>(id < 0 ? -static_cast<long long>(id) : id) % shards.size();
+}
+
+std::mutex& ShardedDatabase::reg_lock(const std::string& reg_no) {
+    return reg_locks[std::hash<std::string>()(reg_no) % REG_LOCKS];
+}
+
+bool ShardedDatabase::reg_taken_elsewhere(const std::string& reg_no, size_t home) const {
+    for (size_t k = 0; k < shards.size(); k++) {
+        if (k != home && shards[k]->find_reg_no(reg_no) != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ShardedDatabase::init() {
+    // Shards are independent files, so they load in parallel.
+    std::vector<char> ok(shards.size(), 0);
+    pool.parallel_for(shards.size(), [&](size_t k) { ok[k] = shards[k]->init(); });
+    return std::all_of(ok.begin(), ok.end(), [](char loaded) { return loaded != 0; });
+}
+
+AuthResult ShardedDatabase::verify_admin(const std::string& username, const std::string& password) {
+    return shards[0]->verify_admin(username, password);
+}
+
+AuthResult ShardedDatabase::login(const std::string& username, const std::string& password, std::string& token) {
+    return shards[0]->login(username, password, token);
+}
+
+bool ShardedDatabase::resume_session(const std::string& token, std::string& username) {
+    return shards[0]->resume_session(token, username);
+}
+
+bool ShardedDatabase::save() {
+    std::atomic<bool> saved(true);
+    pool.parallel_for(shards.size(), [this, &saved](size_t k) {
+        if (!shards[k]->save()) saved = false;
+    });
+    return saved;
+}
+
+int ShardedDatabase::add_student(const std::string& name, const std::string& reg_no, int age,
+                                 const std::string& major) {
+    size_t home = next_shard.fetch_add(1) % shards.size();
+    std::lock_guard<std::mutex> lock(reg_lock(reg_no));
+    if (reg_taken_elsewhere(reg_no, home)) {
+        return -1;
+    }
+    return shards[home]->add_student(name, reg_no, age, major);
+}
+
+size_t ShardedDatabase::add_students(const std::vector<Student>& batch, std::vector<size_t>& rejected) {
+    std::vector<std::unique_lock<std::mutex>> locks;
+    for (auto& stripe : reg_locks) {
+        locks.emplace_back(stripe);
+    }
+
+    // Duplicates against the stored rows are found on all shards at once;
+    // duplicates within the batch keep their first occurrence.
+    std::vector<char> taken(batch.size(), 0);
+    pool.parallel_for(shards.size(), [&](size_t k) {
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (shards[k]->find_reg_no(batch[i].reg_no) != 0) taken[i] = 1;
+        }
+    });
+
+    size_t n = shards.size();
+    std::vector<std::vector<Student>> parts(n);
+    std::unordered_set<std::string> seen;
+    for (size_t i = 0; i < batch.size(); i++) {
+        if (taken[i] || !seen.insert(batch[i].reg_no).second) {
+            rejected.push_back(i);
+            continue;
+        }
+        parts[next_shard.fetch_add(1) % n].push_back(batch[i]);
+    }
+
+    std::vector<size_t> added(n, 0);
+    pool.parallel_for(n, [&](size_t k) {
+        std::vector<size_t> unused;
+        added[k] = shards[k]->add_students(parts[k], unused);
+    });
+    size_t total = 0;
+    for (size_t count : added) {
+        total += count;
+    }
+    return total;
+}
+
+bool ShardedDatabase::update_student(int id, const std::string& name, const std::string& reg_no, int age,
+                                     const std::string& major) {
+    size_t home = home_of(id);
+    std::lock_guard<std::mutex> lock(reg_lock(reg_no));
+    if (reg_taken_elsewhere(reg_no, home)) {
+        return false;
+    }
+    return shards[home]->update_student(id, name, reg_no, age, major);
+}
+
+bool ShardedDatabase::delete_student(int id) {
+    return shards[home_of(id)]->delete_student(id);
+}
+
+std::optional<Student> ShardedDatabase::get_student(int id) const {
+    return shards[home_of(id)]->get_student(id);
+}
+
+std::vector<Student> ShardedDatabase::search_students(const std::string& query) const {
+    std::vector<std::vector<Student>> runs(shards.size());
+    pool.parallel_for(shards.size(), [&](size_t k) {
+        runs[k] = shards[k]->search_students(query);
+        if (!std::is_sorted(runs[k].begin(), runs[k].end(), by_id)) {
+            std::sort(runs[k].begin(), runs[k].end(), by_id);
+        }
+    });
+    return merge_runs(runs, by_id);
+}
+
+std::vector<ScoredStudent> ShardedDatabase::search_ranked(const std::string& query, size_t k) const {
+    std::vector<std::vector<ScoredStudent>> runs(shards.size());
+    pool.parallel_for(shards.size(), [&](size_t s) { runs[s] = shards[s]->search_ranked(query, k); });
+
+    std::vector<ScoredStudent> merged;
+    for (auto& run : runs) {
+        std::move(run.begin(), run.end(), std::back_inserter(merged));
+    }
+    auto ranks_before = [](const ScoredStudent& a, const ScoredStudent& b) {
+        return a.score != b.score ? a.score > b.score : a.student.id < b.student.id;
+    };
+    size_t keep = std::min(k, merged.size());
+    std::partial_sort(merged.begin(), merged.begin() + static_cast<std::ptrdiff_t>(keep), merged.end(), ranks_before);
+    merged.resize(keep);
+    return merged;
+}
+
+std::vector<Student> ShardedDatabase::students_after(int after_id, size_t page_size) const {
+    StudentQuery page;
+    page.min_id = after_id + 1;
+    page.limit = page_size;
+    return query(page);
+}
+
+std::vector<Student> ShardedDatabase::query(const StudentQuery& query) const {
+    StudentQuery part = query;
+    part.offset = 0;
+    part.limit = query.limit > 0 ? query.offset + query.limit : 0;
+
+    std::vector<std::vector<Student>> runs(shards.size());
+    pool.parallel_for(shards.size(), [&](size_t k) {
+        Student s;
+        StudentCursor cursor = shards[k]->query(part);
+        while (cursor.next(s)) {
+            runs[k].push_back(s);
+        }
+    });
+
+    bool by_age = query.order == StudentQuery::Order::Age;
+    bool descending = query.descending;
+    std::vector<Student> rows = merge_runs(runs, [by_age, descending](const Student& a, const Student& b) {
+        auto key_a = by_age ? std::make_tuple(a.age, a.id) : std::make_tuple(a.id, 0);
+        auto key_b = by_age ? std::make_tuple(b.age, b.id) : std::make_tuple(b.id, 0);
+        return descending ? key_b < key_a : key_a < key_b;
+    });
+
+    size_t skip = std::min(query.offset, rows.size());
+    rows.erase(rows.begin(), rows.begin() + static_cast<std::ptrdiff_t>(skip));
+    if (query.limit > 0 && rows.size() > query.limit) {
+        rows.resize(query.limit);
+    }
+    return rows;
+}
+
+size_t ShardedDatabase::student_count() const {
+    size_t total = 0;
+    for (const auto& shard : shards) {
+        total += shard->student_count();
+    }
+    return total;
+}
@@ -0,0 +1,76 @@
+#ifndef SHARDED_DATABASE_H
+#define SHARDED_DATABASE_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+#include "database.h"
+#include "student.h"
+#include "thread_pool.h"
+
+// Students split over several Database shards, each with its own snapshot,
+// log and indexes in <path>.<k>-of-<n>. A student lives on shard id % n,
+// and shard k only hands out ids that leave remainder k, so ids are unique
+// without the shards talking to each other. A lookup by id touches one
+// shard; searches and queries run on all of them at once on the pool and
+// are merged back into order.
+//
+// reg_no stays unique across shards: any write that gives a row a reg_no
+// first takes one of REG_LOCKS stripe locks picked by hashing that reg_no,
+// then checks the other shards. Two writers can only race for a reg_no
+// under the same stripe, so the check cannot be overtaken. Admins and
+// sessions live in shard 0. Transactions do not span shards.
+//
+// Only the benchmark uses it so far; the menu and server run on a single
+// Database.
+class ShardedDatabase {
+private:
+    static const size_t REG_LOCKS = 64;
+
+    std::vector<std::unique_ptr<Database>> shards;
+    ThreadPool& pool;
+    std::atomic<size_t> next_shard; // where the next add goes, round-robin
+    std::mutex reg_locks[REG_LOCKS];
+
+    size_t home_of(int id) const;
+    std::mutex& reg_lock(const std::string& reg_no);
+    bool reg_taken_elsewhere(const std::string& reg_no, size_t home) const;
+
+public:
+    // The pool is only borrowed and must outlive the database.
+    ShardedDatabase(const std::string& path, size_t shard_count, ThreadPool& pool);
+    static std::string shard_path(const std::string& path, size_t shard, size_t shard_count);
+
+    bool init();
+    AuthResult verify_admin(const std::string& username, const std::string& password);
+    AuthResult login(const std::string& username, const std::string& password, std::string& token);
+    bool resume_session(const std::string& token, std::string& username);
+    // False if any shard's checkpoint failed.
+    bool save();
+
+    int add_student(const std::string& name, const std::string& reg_no, int age, const std::string& major);
+    // Database::add_students() across the shards: rows are dealt out
+    // round-robin and each shard commits its share with one write. Holds
+    // every stripe lock while it runs.
+    size_t add_students(const std::vector<Student>& batch, std::vector<size_t>& rejected);
+    bool update_student(int id, const std::string& name, const std::string& reg_no, int age, const std::string& major);
+    bool delete_student(int id);
+
+    std::optional<Student> get_student(int id) const;
+    // Results in id order, as from a single Database.
+    std::vector<Student> search_students(const std::string& query) const;
+    // The best k over all shards' best k.
+    std::vector<ScoredStudent> search_ranked(const std::string& query, size_t k) const;
+    std::vector<Student> students_after(int after_id, size_t page_size) const;
+    // Each shard runs the query with the offset folded into its limit; the
+    // merged rows are then cut to offset and limit. Copies the rows out
+    // rather than returning a cursor, since a cursor would pin every shard.
+    std::vector<Student> query(const StudentQuery& query) const;
+    size_t student_count() const;
+    size_t shard_count() const { return shards.size(); }
+};
+
+#endif // SHARDED_DATABASE_H
@@ -0,0 +1,350 @@
+#include "snapshot.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include "metrics.h"
+
+#ifdef _WIN32
+    #include <io.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+static const uint64_t CHECKSUM_SEED = 14695981039346656037ull;
+static const uint64_t CHECKSUM_PRIME = 1099511628211ull;
+
+// FNV-1a over 8-byte words; the tables ahead of the heap are multiples of
+// 8 bytes, so checksumming them one after another equals checksumming the
+// concatenation.
+static uint64_t checksum_update(uint64_t h, const char* data, size_t size) {
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        h = (h ^ word) * CHECKSUM_PRIME;
+    }
+    for (; i < size; i++) {
+        h = (h ^ static_cast<unsigned char>(data[i])) * CHECKSUM_PRIME;
+    }
+    return h;
+}
+
+uint64_t snapshot_checksum(const char* data, size_t size) {
+    return checksum_update(CHECKSUM_SEED, data, size);
+}
+
+bool sync_file(FILE* file) {
+    MetricTimer timer(Metric::Fsync);
+    if (std::fflush(file) != 0) {
+        return false;
+    }
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+// Windows cannot open a directory for syncing, so there the rename is left
+// to the file system.
+bool sync_parent_directory(const std::string& path) {
+#ifdef _WIN32
+    (void)path;
+    return true;
+#else
+    std::string dir = std::filesystem::path(path).parent_path().string();
+    int fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
+
+bool is_binary_snapshot(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    char magic[sizeof(SNAPSHOT_MAGIC)];
+    return in.read(magic, sizeof(magic)) && std::memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) == 0;
+}
+
+// Buffers output and checksums it on the way out. Every full buffer is a
+// multiple of 8 bytes, so the result equals checksum_update() over all the
+// bytes written, in one piece.
+class ChecksumWriter {
+private:
+    FILE* file;
+    std::vector<char> buffer;
+    size_t used;
+    uint64_t sum;
+    uint64_t total;
+    bool ok;
+
+    void drain() {
+        sum = checksum_update(sum, buffer.data(), used);
+        ok = ok && std::fwrite(buffer.data(), 1, used, file) == used;
+        total += used;
+        used = 0;
+    }
+
+public:
+    explicit ChecksumWriter(FILE* file)
+        : file(file), buffer(1 << 20), used(0), sum(CHECKSUM_SEED), total(0), ok(true) {}
+
+    void write(const void* data, size_t size) {
+        const char* bytes = static_cast<const char*>(data);
+        while (size > 0) {
+            size_t n = std::min(size, buffer.size() - used);
+            std::memcpy(buffer.data() + used, bytes, n);
+            used += n;
+            bytes += n;
+            size -= n;
+            if (used == buffer.size()) {
+                drain();
+            }
+        }
+    }
+
+    bool finish() {
+        drain();
+        return ok;
+    }
+
+    uint64_t checksum() const { return sum; }
+    uint64_t bytes() const { return total; }
+};
+
+void SnapshotWriter::add_admin(const std::string& username, const std::string& password) {
+    admins.emplace_back(username, password);
+}
+
+size_t snapshot_header_size(uint32_t version) {
+    switch (version) {
+        case 1: return offsetof(SnapshotHeader, change_seq);
+        case 2: return sizeof(SnapshotHeader);
+        default: return 0;
+    }
+}
+
+bool SnapshotWriter::write(const std::string& path, int next_id, uint64_t change_seq, size_t student_count,
+                           const RowSource& rows) {
+    SnapshotHeader header = {};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.next_id = next_id;
+    header.change_seq = change_seq;
+    header.admin_count = static_cast<uint32_t>(admins.size());
+    header.student_count = static_cast<uint32_t>(student_count);
+
+    // The new snapshot is written and synced under a temporary name and
+    // then renamed over path, so path always holds either the old snapshot
+    // or the complete new one, whenever the process or machine stops.
+    std::string temp_path = path + ".tmp";
+    FILE* file = std::fopen(temp_path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    // The header goes in last, once the heap size and checksum are known.
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+    ChecksumWriter out(file);
+
+    // Heap offsets are 32-bit; a heap that outgrows them fails the write.
+    uint64_t heap_size = 0;
+    auto put_string = [&heap_size](std::string_view value, uint32_t& off, uint32_t& len) {
+        off = static_cast<uint32_t>(heap_size);
+        len = static_cast<uint32_t>(value.size());
+        heap_size += value.size();
+    };
+    for (const auto& admin : admins) {
+        SnapshotAdmin a;
+        put_string(admin.first, a.username_off, a.username_len);
+        put_string(admin.second, a.password_off, a.password_len);
+        out.write(&a, sizeof(a));
+    }
+    size_t records = 0;
+    rows([&](const StudentView& s) {
+        SnapshotRecord r;
+        r.id = s.id;
+        r.age = s.age;
+        put_string(s.name, r.name_off, r.name_len);
+        put_string(s.reg_no, r.reg_no_off, r.reg_no_len);
+        put_string(s.major, r.major_off, r.major_len);
+        out.write(&r, sizeof(r));
+        records++;
+    });
+
+    for (const auto& admin : admins) {
+        out.write(admin.first.data(), admin.first.size());
+        out.write(admin.second.data(), admin.second.size());
+    }
+    size_t strings = 0;
+    rows([&](const StudentView& s) {
+        out.write(s.name.data(), s.name.size());
+        out.write(s.reg_no.data(), s.reg_no.size());
+        out.write(s.major.data(), s.major.size());
+        strings++;
+    });
+
+    ok = out.finish() && ok;
+    header.heap_size = heap_size;
+    header.checksum = out.checksum();
+    ok = ok && records == student_count && strings == student_count &&
+         heap_size <= std::numeric_limits<uint32_t>::max() && std::fseek(file, 0, SEEK_SET) == 0 &&
+         std::fwrite(&header, sizeof(header), 1, file) == 1 && sync_file(file);
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok) {
+        std::remove(temp_path.c_str());
+        return false;
+    }
+    metrics_add_bytes(sizeof(header) + out.bytes());
+
+    std::error_code ec;
+    std::filesystem::rename(temp_path, path, ec);
+    if (ec) {
+        std::remove(temp_path.c_str());
+        return false;
+    }
+    return sync_parent_directory(path);
+}
+
+SnapshotReader::SnapshotReader()
+    : data(nullptr), size(0), header(), header_size(0), admin_table(nullptr), record_table(nullptr), heap(nullptr) {}
+
+SnapshotReader::~SnapshotReader() {
+    close();
+}
+
+bool SnapshotReader::map(const std::string& path) {
+#ifdef _WIN32
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in.is_open()) return false;
+    buffer.resize(static_cast<size_t>(in.tellg()));
+    in.seekg(0);
+    if (!in.read(buffer.data(), buffer.size())) return false;
+    data = buffer.data();
+    size = buffer.size();
+    return true;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void* mapped = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // The mapping keeps the file alive
+    if (mapped == MAP_FAILED) return false;
+
+    data = static_cast<const char*>(mapped);
+    size = static_cast<size_t>(st.st_size);
+    return true;
+#endif
+}
+
+void SnapshotReader::unmap() {
+#ifdef _WIN32
+    buffer.clear();
+    buffer.shrink_to_fit();
+#else
+    if (data) {
+        munmap(const_cast<char*>(data), size);
+    }
+#endif
+    data = nullptr;
+    size = 0;
+}
+
+bool SnapshotReader::open(const std::string& path) {
+    close();
+    if (!map(path)) {
+        return false;
+    }
+
+    // The version decides how much of the header there is.
+    uint32_t version = 0;
+    if (size >= offsetof(SnapshotHeader, version) + sizeof(version)) {
+        std::memcpy(&version, data + offsetof(SnapshotHeader, version), sizeof(version));
+    }
+    header_size = snapshot_header_size(version);
+    if (header_size == 0 || size < header_size) {
+        close();
+        return false;
+    }
+    std::memcpy(&header, data, header_size);
+
+    uint64_t expected = header_size +
+                        static_cast<uint64_t>(header.admin_count) * sizeof(SnapshotAdmin) +
+                        static_cast<uint64_t>(header.student_count) * sizeof(SnapshotRecord) +
+                        header.heap_size;
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+        expected != size) {
+        close();
+        return false;
+    }
+
+    admin_table = reinterpret_cast<const SnapshotAdmin*>(data + header_size);
+    record_table = reinterpret_cast<const SnapshotRecord*>(admin_table + header.admin_count);
+    heap = reinterpret_cast<const char*>(record_table + header.student_count);
+    return true;
+}
+
+void SnapshotReader::close() {
+    unmap();
+    header = SnapshotHeader();
+    header_size = 0;
+    admin_table = nullptr;
+    record_table = nullptr;
+    heap = nullptr;
+}
+
+bool SnapshotReader::verify() const {
+    if (!data) return false;
+    if (snapshot_checksum(data + header_size, size - header_size) != header.checksum) {
+        return false;
+    }
+
+    // Every string must lie inside the heap.
+    auto in_heap = [this](uint32_t off, uint32_t len) {
+        return static_cast<uint64_t>(off) + len <= header.heap_size;
+    };
+    for (size_t i = 0; i < header.admin_count; i++) {
+        const SnapshotAdmin& a = admin_table[i];
+        if (!in_heap(a.username_off, a.username_len) || !in_heap(a.password_off, a.password_len)) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < header.student_count; i++) {
+        const SnapshotRecord& r = record_table[i];
+        if (!in_heap(r.name_off, r.name_len) || !in_heap(r.reg_no_off, r.reg_no_len) ||
+            !in_heap(r.major_off, r.major_len)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SnapshotReader::read_admin(size_t index, std::string& username, std::string& password) const {
+    const SnapshotAdmin& a = admin_table[index];
+    username.assign(heap + a.username_off, a.username_len);
+    password.assign(heap + a.password_off, a.password_len);
+}
+
+StudentView SnapshotReader::student_view(size_t index) const {
+    const SnapshotRecord& r = record_table[index];
+    return StudentView{r.id,
+                       std::string_view(heap + r.name_off, r.name_len),
+                       std::string_view(heap + r.reg_no_off, r.reg_no_len),
+                       r.age,
+                       std::string_view(heap + r.major_off, r.major_len)};
+}
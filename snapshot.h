@@ -0,0 +1,126 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+#include "student.h"
+
+// Binary snapshot layout (host byte order):
+//
+//   SnapshotHeader
+//   SnapshotAdmin[admin_count]
+//   SnapshotRecord[student_count]   fixed width, ascending id
+//   string heap                     name, reg_no, major, admin credentials
+//
+// The checksum covers everything after the header. change_seq is the
+// sequence number of the last change the snapshot includes (see
+// ChangeFeed); version 1 files lack it and load as 0. Records are fixed
+// width and sorted by id, so a single record can be read straight out of
+// the mapping without touching the rest of the file.
+
+const char SNAPSHOT_MAGIC[8] = {'S', 'R', 'M', 'S', 'N', 'A', 'P', '\0'};
+const uint32_t SNAPSHOT_VERSION = 2;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    int32_t next_id;
+    uint32_t admin_count;
+    uint32_t student_count;
+    uint64_t heap_size;
+    uint64_t checksum;
+    uint64_t change_seq; // since version 2
+};
+
+// Bytes of header written by a snapshot of the given version, or 0 if the
+// version is unknown.
+size_t snapshot_header_size(uint32_t version);
+
+struct SnapshotAdmin {
+    uint32_t username_off, username_len;
+    uint32_t password_off, password_len;
+};
+
+struct SnapshotRecord {
+    int32_t id;
+    int32_t age;
+    uint32_t name_off, name_len;
+    uint32_t reg_no_off, reg_no_len;
+    uint32_t major_off, major_len;
+};
+
+// Streams a snapshot to disk. The rows come from a callback that write()
+// runs twice, in ascending id order both times: once for the record table
+// and once for the string heap. Nothing is held in memory but the admins
+// and a write buffer, however large the roster.
+class SnapshotWriter {
+private:
+    std::vector<std::pair<std::string, std::string>> admins;
+
+public:
+    using RowVisitor = std::function<void(const StudentView&)>;
+    using RowSource = std::function<void(const RowVisitor&)>;
+
+    void add_admin(const std::string& username, const std::string& password);
+    // Replaces path atomically: writes path.tmp, syncs it, then renames it
+    // over path. rows must produce exactly student_count rows each time.
+    bool write(const std::string& path, int next_id, uint64_t change_seq, size_t student_count,
+               const RowSource& rows);
+};
+
+// Read-only view over a memory-mapped snapshot. Nothing is decoded until a
+// record is asked for.
+class SnapshotReader {
+private:
+    const char* data;
+    size_t size;
+    SnapshotHeader header;
+    size_t header_size;
+    const SnapshotAdmin* admin_table;
+    const SnapshotRecord* record_table;
+    const char* heap;
+#ifdef _WIN32
+    std::vector<char> buffer;
+#endif
+
+    bool map(const std::string& path);
+    void unmap();
+
+public:
+    SnapshotReader();
+    ~SnapshotReader();
+    SnapshotReader(const SnapshotReader&) = delete;
+    SnapshotReader& operator=(const SnapshotReader&) = delete;
+
+    // Returns false if the file is missing, is not a binary snapshot (such
+    // as a text-format students.db), or its tables do not fit the file.
+    bool open(const std::string& path);
+    void close();
+    bool verify() const;
+
+    int next_id() const { return header.next_id; }
+    uint64_t change_seq() const { return header.change_seq; }
+    size_t admin_count() const { return header.admin_count; }
+    size_t student_count() const { return header.student_count; }
+
+    void read_admin(size_t index, std::string& username, std::string& password) const;
+    // Views point into the mapping and stay valid until close().
+    StudentView student_view(size_t index) const;
+    int student_id(size_t index) const { return record_table[index].id; }
+};
+
+// True if path starts with the binary snapshot magic.
+bool is_binary_snapshot(const std::string& path);
+
+uint64_t snapshot_checksum(const char* data, size_t size);
+
+// Flushes file and syncs it to disk.
+bool sync_file(FILE* file);
+// Makes a rename into path's directory durable.
+bool sync_parent_directory(const std::string& path);
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,33 @@
+#include "sorted_index.h"
+
+void SortedIndex::add(int key, int id) {
+    postings[key].insert(id);
+}
+
+void SortedIndex::remove(int key, int id) {
+    auto list = postings.find(key);
+    if (list == postings.end()) return;
+
+    list->second.erase(id);
+    if (list->second.empty()) {
+        postings.erase(list);
+    }
+}
+
+void SortedIndex::clear() {
+    postings.clear();
+}
+
+size_t SortedIndex::count(int lo, int hi) const {
+    size_t total = 0;
+    for (auto it = postings.lower_bound(lo); it != postings.end() && it->first <= hi; ++it) {
+        total += it->second.size();
+    }
+    return total;
+}
+
+void SortedIndex::collect(int lo, int hi, std::vector<int>& out) const {
+    for (auto it = postings.lower_bound(lo); it != postings.end() && it->first <= hi; ++it) {
+        it->second.append_to(out);
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef SORTED_INDEX_H
+#define SORTED_INDEX_H
+
+#include <cstddef>
+#include <map>
+#include <vector>
+#include "posting_list.h"
+
+// Ordered secondary index from a small integer key (an age, a major's
+// dictionary code) to the ids of the students holding it. Keys are
+// kept in ascending order, so a key range is read as consecutive posting
+// lists.
+class SortedIndex {
+private:
+    std::map<int, PostingList> postings; // key -> ids
+
+public:
+    void add(int key, int id);
+    void remove(int key, int id);
+    void clear();
+
+    // Number of ids under keys in [lo, hi]; used to estimate selectivity.
+    size_t count(int lo, int hi) const;
+    // Appends the ids under keys in [lo, hi] to out, in ascending key order
+    // and ascending id order within each key.
+    void collect(int lo, int hi, std::vector<int>& out) const;
+};
+
+#endif // SORTED_INDEX_H
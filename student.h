@@ -2,6 +2,7 @@
 #define STUDENT_H
 
 #include <string>
+#include <string_view>
 
 struct Student {
     int id;
@@ -11,4 +12,26 @@ struct Student {
     std::string major;
 };
 
+// Non-owning view of a student's fields, wherever they are stored.
+struct StudentView {
+    int id;
+    std::string_view name;
+    std::string_view reg_no;
+    int age;
+    std::string_view major;
+};
+
+inline StudentView view_of(const Student& s) {
+    return StudentView{s.id, s.name, s.reg_no, s.age, s.major};
+}
+
+// Copies a view's fields into out, reusing out's string buffers.
+inline void materialize(const StudentView& s, Student& out) {
+    out.id = s.id;
+    out.name.assign(s.name);
+    out.reg_no.assign(s.reg_no);
+    out.age = s.age;
+    out.major.assign(s.major);
+}
+
 #endif // STUDENT_H
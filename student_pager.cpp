@@ -0,0 +1,46 @@
+#include "student_pager.h"
+#include <vector>
+
+// Appends text cut or padded to exactly width bytes; cut text ends in '~'.
+static void append_cell(std::string& out, const std::string& text, size_t width) {
+    if (text.size() > width) {
+        out.append(text, 0, width - 1);
+        out += '~';
+    } else {
+        out += text;
+        out.append(width - text.size(), ' ');
+    }
+}
+
+void append_student_row(std::string& out, const Student& s) {
+    out += "  ";
+    append_cell(out, std::to_string(s.id), 8);
+    out += ' ';
+    append_cell(out, s.name, 28);
+    out += ' ';
+    append_cell(out, s.reg_no, 14);
+    out += ' ';
+    append_cell(out, std::to_string(s.age), 4);
+    out += ' ';
+    out += s.major;
+    out += '\n';
+}
+
+StudentPager::StudentPager(const Database& db, size_t page_size)
+    : db(db), page_size(page_size), after_id(0), shown(0), finished(false) {}
+
+size_t StudentPager::next_page(std::string& out) {
+    if (finished) {
+        return 0;
+    }
+    std::vector<Student> page = db.students_after(after_id, page_size);
+    for (const auto& s : page) {
+        append_student_row(out, s);
+    }
+    shown += page.size();
+    finished = page.size() < page_size;
+    if (!page.empty()) {
+        after_id = page.back().id;
+    }
+    return page.size();
+}
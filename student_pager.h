@@ -0,0 +1,33 @@
+#ifndef STUDENT_PAGER_H
+#define STUDENT_PAGER_H
+
+#include <string>
+#include "database.h"
+
+// Appends s as one row of the admin menu's student table: id, name, reg_no
+// and age cut or padded to fixed widths, then the major.
+void append_student_row(std::string& out, const Student& s);
+
+// Walks the roster in id order a page at a time with students_after(),
+// formatting each page into one buffer for the caller to write with a
+// single call. No lock is held between pages, so the roster may change
+// underneath; a page starts after the last id of the one before.
+class StudentPager {
+private:
+    const Database& db;
+    size_t page_size;
+    int after_id;
+    size_t shown;
+    bool finished;
+
+public:
+    StudentPager(const Database& db, size_t page_size);
+
+    // Appends the next page's rows to out and returns how many there were.
+    size_t next_page(std::string& out);
+    // True once a page has come back short.
+    bool done() const { return finished; }
+    size_t rows_shown() const { return shown; }
+};
+
+#endif // STUDENT_PAGER_H
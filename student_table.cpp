@@ -0,0 +1,185 @@
+#include "student_table.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+static const size_t ARENA_BLOCK_SIZE = 64 * 1024;
+
+StringArena::StringArena() : block_used(0), stored(0), released(0), reserved(0) {}
+
+std::string_view StringArena::store(std::string_view text) {
+    if (text.empty()) {
+        return std::string_view();
+    }
+
+    char* dest;
+    if (text.size() > ARENA_BLOCK_SIZE / 4) {
+        // Oversized strings get a block of their own, slotted in behind the
+        // current block so that block keeps filling up.
+        auto block = std::make_unique<char[]>(text.size());
+        dest = block.get();
+        blocks.insert(blocks.empty() ? blocks.end() : blocks.end() - 1, std::move(block));
+        reserved += text.size();
+    } else {
+        if (blocks.empty() || block_used + text.size() > ARENA_BLOCK_SIZE) {
+            blocks.push_back(std::make_unique<char[]>(ARENA_BLOCK_SIZE));
+            block_used = 0;
+            reserved += ARENA_BLOCK_SIZE;
+        }
+        dest = blocks.back().get() + block_used;
+        block_used += text.size();
+    }
+
+    std::memcpy(dest, text.data(), text.size());
+    stored += text.size();
+    return std::string_view(dest, text.size());
+}
+
+void StringArena::clear() {
+    blocks.clear();
+    block_used = 0;
+    stored = 0;
+    released = 0;
+    reserved = 0;
+}
+
+StudentTable::StudentTable() : dead(0), ordered(true) {}
+
+uint32_t StudentTable::intern_major(std::string_view major) {
+    std::string key(major);
+    auto it = major_codes.find(key);
+    if (it != major_codes.end()) {
+        return it->second;
+    }
+    uint32_t code = static_cast<uint32_t>(major_names.size());
+    major_names.push_back(key);
+    major_codes.emplace(std::move(key), code);
+    return code;
+}
+
+StudentView StudentTable::view(size_t slot) const {
+    return StudentView{ids[slot], names[slot], reg_nos[slot], ages[slot], major_names[majors[slot]]};
+}
+
+void StudentTable::materialize(size_t slot, Student& out) const {
+    out.id = ids[slot];
+    out.name.assign(names[slot].data(), names[slot].size());
+    out.reg_no.assign(reg_nos[slot].data(), reg_nos[slot].size());
+    out.age = ages[slot];
+    out.major = major_names[majors[slot]];
+}
+
+void StudentTable::reserve(size_t rows) {
+    ids.reserve(rows);
+    ages.reserve(rows);
+    majors.reserve(rows);
+    names.reserve(rows);
+    reg_nos.reserve(rows);
+}
+
+size_t StudentTable::lower_bound(int id) const {
+    auto it = std::lower_bound(ids.begin(), ids.end(), id,
+                               [](int slot_id, int key) { return std::abs(slot_id) < key; });
+    return static_cast<size_t>(it - ids.begin());
+}
+
+size_t StudentTable::append(const StudentView& s) {
+    if (!ids.empty() && std::abs(ids.back()) >= s.id) {
+        ordered = false;
+    }
+    ids.push_back(s.id);
+    ages.push_back(s.age);
+    majors.push_back(intern_major(s.major));
+    names.push_back(arena.store(s.name));
+    reg_nos.push_back(arena.store(s.reg_no));
+    return ids.size() - 1;
+}
+
+void StudentTable::assign(size_t slot, const StudentView& s) {
+    // Unchanged strings keep their bytes; changed ones are re-stored and the
+    // old bytes left for compact() to reclaim.
+    if (names[slot] != s.name) {
+        arena.release(names[slot]);
+        names[slot] = arena.store(s.name);
+    }
+    if (reg_nos[slot] != s.reg_no) {
+        arena.release(reg_nos[slot]);
+        reg_nos[slot] = arena.store(s.reg_no);
+    }
+    ids[slot] = s.id;
+    ages[slot] = s.age;
+    majors[slot] = intern_major(s.major);
+}
+
+void StudentTable::erase(size_t slot) {
+    arena.release(names[slot]);
+    arena.release(reg_nos[slot]);
+    ids[slot] = -ids[slot];
+    names[slot] = std::string_view();
+    reg_nos[slot] = std::string_view();
+    dead++;
+}
+
+bool StudentTable::find_major(const std::string& major, uint32_t& code) const {
+    auto it = major_codes.find(major);
+    if (it == major_codes.end()) {
+        return false;
+    }
+    code = it->second;
+    return true;
+}
+
+bool StudentTable::needs_compaction() const {
+    return dead > size() || arena.garbage_bytes() > arena.live_bytes();
+}
+
+void StudentTable::compact() {
+    std::vector<size_t> order;
+    order.reserve(size());
+    for (size_t slot = 0; slot < ids.size(); slot++) {
+        if (live(slot)) {
+            order.push_back(slot);
+        }
+    }
+    // Rows that arrived out of id order (an unsorted text import) are put
+    // back in order while they are being moved anyway.
+    if (!ordered) {
+        std::sort(order.begin(), order.end(), [this](size_t a, size_t b) { return ids[a] < ids[b]; });
+    }
+
+    std::vector<int> new_ids, new_ages;
+    std::vector<uint32_t> new_majors;
+    std::vector<std::string_view> new_names, new_reg_nos;
+    new_ids.reserve(order.size());
+    new_ages.reserve(order.size());
+    new_majors.reserve(order.size());
+    new_names.reserve(order.size());
+    new_reg_nos.reserve(order.size());
+    StringArena fresh;
+    for (size_t slot : order) {
+        new_ids.push_back(ids[slot]);
+        new_ages.push_back(ages[slot]);
+        new_majors.push_back(majors[slot]);
+        new_names.push_back(fresh.store(names[slot]));
+        new_reg_nos.push_back(fresh.store(reg_nos[slot]));
+    }
+    ids.swap(new_ids);
+    ages.swap(new_ages);
+    majors.swap(new_majors);
+    names.swap(new_names);
+    reg_nos.swap(new_reg_nos);
+    arena = std::move(fresh);
+    dead = 0;
+    ordered = true;
+}
+
+size_t StudentTable::memory_usage() const {
+    size_t bytes = ids.capacity() * sizeof(int) + ages.capacity() * sizeof(int) +
+                   majors.capacity() * sizeof(uint32_t) +
+                   (names.capacity() + reg_nos.capacity()) * sizeof(std::string_view) +
+                   arena.reserved_bytes();
+    for (const auto& major : major_names) {
+        bytes += sizeof(std::string) + major.capacity();
+    }
+    return bytes;
+}
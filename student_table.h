@@ -0,0 +1,101 @@
+#ifndef STUDENT_TABLE_H
+#define STUDENT_TABLE_H
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "student.h"
+
+// Bump allocator for string bytes. Blocks never move, so a view returned by
+// store() stays valid until clear(), however much is stored after it.
+// Released strings are only counted; their bytes are reclaimed by copying
+// the live ones into a fresh arena.
+class StringArena {
+private:
+    std::vector<std::unique_ptr<char[]>> blocks;
+    size_t block_used; // bytes used in blocks.back()
+    size_t stored;     // bytes handed out by store()
+    size_t released;   // bytes passed back to release()
+    size_t reserved;   // bytes allocated across all blocks
+
+public:
+    StringArena();
+
+    std::string_view store(std::string_view text);
+    void release(std::string_view text) { released += text.size(); }
+    void clear();
+
+    size_t live_bytes() const { return stored - released; }
+    size_t garbage_bytes() const { return released; }
+    size_t reserved_bytes() const { return reserved; }
+};
+
+// Column-oriented student storage. Each row lives at a slot across
+// parallel columns: ids and ages as plain ints, major as a code into an
+// interned dictionary (a roster has only a few dozen distinct majors), and
+// name and reg_no as views into one StringArena. Student is only
+// materialized on request.
+//
+// Deleted rows keep their slot, with the id negated, until compact(), so
+// slots do not shift on delete. Views handed out by view() stay valid until
+// compact().
+//
+// Rows are normally appended in ascending id order; while that holds,
+// lower_bound() finds an id range by binary search over the id column.
+class StudentTable {
+private:
+    std::vector<int> ids;
+    std::vector<int> ages;
+    std::vector<uint32_t> majors;
+    std::vector<std::string_view> names;
+    std::vector<std::string_view> reg_nos;
+    std::deque<std::string> major_names; // code -> major; deque keeps views into it stable
+    std::unordered_map<std::string, uint32_t> major_codes;
+    StringArena arena;
+    size_t dead;
+    bool ordered; // slots are in ascending id order
+
+    uint32_t intern_major(std::string_view major);
+
+public:
+    StudentTable();
+
+    size_t slots() const { return ids.size(); }
+    size_t size() const { return ids.size() - dead; }
+    size_t dead_slots() const { return dead; }
+    bool live(size_t slot) const { return ids[slot] > 0; }
+    int id(size_t slot) const { return ids[slot]; }
+    int age(size_t slot) const { return ages[slot]; }
+    uint32_t major_code(size_t slot) const { return majors[slot]; }
+
+    bool id_ordered() const { return ordered; }
+    // First slot whose row, live or deleted, has an id >= id. Only
+    // meaningful while id_ordered().
+    size_t lower_bound(int id) const;
+
+    StudentView view(size_t slot) const;
+    // Reuses out's string buffers, so materializing row after row into the
+    // same Student stops allocating once they have grown.
+    void materialize(size_t slot, Student& out) const;
+
+    void reserve(size_t rows);
+    size_t append(const StudentView& s);
+    void assign(size_t slot, const StudentView& s);
+    void erase(size_t slot);
+
+    // Looks up the dictionary code for major (exact match).
+    bool find_major(const std::string& major, uint32_t& code) const;
+
+    // True once dead slots or superseded string bytes outweigh live data.
+    bool needs_compaction() const;
+    void compact();
+
+    // Approximate heap bytes held by the columns, dictionary and arena.
+    size_t memory_usage() const;
+};
+
+#endif // STUDENT_TABLE_H
@@ -0,0 +1,108 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+// The pool and deque of the worker running on this thread, if any.
+static thread_local ThreadPool* current_pool = nullptr;
+static thread_local size_t current_queue = 0;
+
+ThreadPool::ThreadPool(size_t threads) : next_queue(0), pending(0), stopping(false) {
+    if (threads == 0) threads = 1;
+    queue_count = threads;
+    queues.reset(new Queue[threads]);
+    for (size_t i = 0; i < threads; i++) {
+        workers.emplace_back(&ThreadPool::run, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    size_t q = current_pool == this ? current_queue : next_queue.fetch_add(1) % queue_count;
+    {
+        std::lock_guard<std::mutex> lock(queues[q].mutex);
+        queues[q].tasks.push_back(std::move(task));
+    }
+    {
+        // Counted under the sleep mutex, so a worker that just found
+        // nothing to do cannot miss the wake-up.
+        std::lock_guard<std::mutex> lock(mutex);
+        pending++;
+    }
+    wake.notify_one();
+}
+
+bool ThreadPool::try_take(size_t home, std::function<void()>& task) {
+    for (size_t i = 0; i < queue_count; i++) {
+        Queue& queue = queues[(home + i) % queue_count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) continue;
+        if (i == 0) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        } else {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        pending--;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::run(size_t index) {
+    current_pool = this;
+    current_queue = index;
+    while (true) {
+        std::function<void()> task;
+        if (try_take(index, task)) {
+            task();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this] { return stopping || pending > 0; });
+        if (pending == 0) {
+            return; // Stopping and drained
+        }
+    }
+}
+
+void ThreadPool::parallel_for(size_t count, const std::function<void(size_t)>& body) {
+    struct Shared {
+        std::atomic<size_t> next{0};
+        size_t done = 0;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+    auto shared = std::make_shared<Shared>();
+
+    // Each helper keeps claiming indexes until none are left, so a helper
+    // that starts late simply finds nothing to do. The body is only used
+    // while some index is unfinished, which the caller waits for.
+    auto work = [shared, count, &body] {
+        size_t i;
+        while ((i = shared->next.fetch_add(1)) < count) {
+            body(i);
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            if (++shared->done == count) {
+                shared->finished.notify_all();
+            }
+        }
+    };
+    size_t helpers = std::min(count, queue_count);
+    for (size_t h = 1; h < helpers; h++) {
+        submit(work);
+    }
+    work();
+
+    std::unique_lock<std::mutex> lock(shared->mutex);
+    shared->finished.wait(lock, [&] { return shared->done == count; });
+}
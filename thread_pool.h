@@ -0,0 +1,52 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads, each with its own deque of tasks. A worker
+// takes tasks from the front of its own deque and, once that is empty,
+// steals from the back of the others', so uneven work spreads itself out.
+// Tasks submitted from outside the pool are dealt round-robin; tasks a
+// worker submits go to its own deque.
+class ThreadPool {
+private:
+    struct alignas(64) Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::thread> workers;
+    std::unique_ptr<Queue[]> queues;
+    size_t queue_count;
+    std::atomic<size_t> next_queue; // round-robin for outside submitters
+    std::atomic<size_t> pending;    // queued, not yet taken
+    std::mutex mutex;               // only for sleeping and waking
+    std::condition_variable wake;
+    bool stopping;
+
+    bool try_take(size_t home, std::function<void()>& task);
+    void run(size_t index);
+
+public:
+    explicit ThreadPool(size_t threads);
+    ~ThreadPool(); // Finishes queued tasks, then joins
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> task);
+    // Calls body(i) for every i in [0, count) across the pool and returns
+    // once all calls are done. Indexes are claimed one at a time, and the
+    // calling thread claims them too, so this may be called from a task
+    // without waiting on itself.
+    void parallel_for(size_t count, const std::function<void(size_t)>& body);
+    size_t size() const { return workers.size(); }
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,105 @@
+#include "trigram_index.h"
+#include <algorithm>
+#include <iterator>
+
+static uint32_t pack(char a, char b, char c) {
+    return (static_cast<uint32_t>(static_cast<unsigned char>(a)) << 16) |
+           (static_cast<uint32_t>(static_cast<unsigned char>(b)) << 8) |
+           static_cast<uint32_t>(static_cast<unsigned char>(c));
+}
+
+static void collect_field(std::string_view text, std::vector<uint32_t>& out) {
+    for (size_t i = 0; i + 3 <= text.size(); i++) {
+        out.push_back(pack(fold_ascii(text[i]), fold_ascii(text[i + 1]), fold_ascii(text[i + 2])));
+    }
+}
+
+void TrigramIndex::collect(const StudentView& s, std::vector<uint32_t>& out) {
+    out.clear();
+    collect_field(s.name, out);
+    collect_field(s.reg_no, out);
+    collect_field(s.major, out);
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+void TrigramIndex::insert_id(uint32_t trigram, int id) {
+    postings[trigram].insert(id);
+}
+
+void TrigramIndex::remove_id(uint32_t trigram, int id) {
+    auto list = postings.find(trigram);
+    if (list == postings.end()) return;
+
+    list->second.erase(id);
+    if (list->second.empty()) {
+        postings.erase(list);
+    }
+}
+
+void TrigramIndex::add(const StudentView& s) {
+    std::vector<uint32_t> trigrams;
+    collect(s, trigrams);
+    for (uint32_t t : trigrams) {
+        insert_id(t, s.id);
+    }
+}
+
+void TrigramIndex::remove(const StudentView& s) {
+    std::vector<uint32_t> trigrams;
+    collect(s, trigrams);
+    for (uint32_t t : trigrams) {
+        remove_id(t, s.id);
+    }
+}
+
+void TrigramIndex::update(const StudentView& before, const StudentView& after) {
+    std::vector<uint32_t> old_trigrams, new_trigrams, changed;
+    collect(before, old_trigrams);
+    collect(after, new_trigrams);
+
+    std::set_difference(old_trigrams.begin(), old_trigrams.end(),
+                        new_trigrams.begin(), new_trigrams.end(), std::back_inserter(changed));
+    for (uint32_t t : changed) {
+        remove_id(t, before.id);
+    }
+
+    changed.clear();
+    std::set_difference(new_trigrams.begin(), new_trigrams.end(),
+                        old_trigrams.begin(), old_trigrams.end(), std::back_inserter(changed));
+    for (uint32_t t : changed) {
+        insert_id(t, after.id);
+    }
+}
+
+void TrigramIndex::clear() {
+    postings.clear();
+}
+
+bool TrigramIndex::candidates(const std::string& lower_query, std::vector<int>& out) const {
+    out.clear();
+    if (lower_query.size() < 3) {
+        return false;
+    }
+
+    std::vector<const PostingList*> lists;
+    for (size_t i = 0; i + 3 <= lower_query.size(); i++) {
+        auto it = postings.find(pack(lower_query[i], lower_query[i + 1], lower_query[i + 2]));
+        if (it == postings.end()) {
+            return true; // Some trigram occurs nowhere: no matches
+        }
+        lists.push_back(&it->second);
+    }
+
+    // Intersect smallest-first so the working set only shrinks.
+    std::sort(lists.begin(), lists.end());
+    lists.erase(std::unique(lists.begin(), lists.end()), lists.end());
+    std::sort(lists.begin(), lists.end(),
+              [](const PostingList* a, const PostingList* b) { return a->size() < b->size(); });
+
+    lists[0]->append_to(out);
+    for (size_t i = 1; i < lists.size() && !out.empty(); i++) {
+        lists[i]->intersect(out);
+    }
+    return true;
+}
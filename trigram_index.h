@@ -0,0 +1,37 @@
+#ifndef TRIGRAM_INDEX_H
+#define TRIGRAM_INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "fold_search.h"
+#include "posting_list.h"
+#include "student.h"
+
+// Inverted index from case-folded 3-byte substrings of name, reg_no and
+// major to the ids of the students containing them. A student's trigrams
+// are pooled across its three fields, so candidates() can return false
+// positives (query trigrams spread over different fields) but never misses
+// a real match; callers verify each candidate.
+class TrigramIndex {
+private:
+    std::unordered_map<uint32_t, PostingList> postings; // trigram -> ids
+
+    static void collect(const StudentView& s, std::vector<uint32_t>& out);
+    void insert_id(uint32_t trigram, int id);
+    void remove_id(uint32_t trigram, int id);
+
+public:
+    void add(const StudentView& s);
+    void remove(const StudentView& s);
+    void update(const StudentView& before, const StudentView& after);
+    void clear();
+
+    // Fills out with the sorted ids of students that may contain
+    // lower_query. Returns false if the query is shorter than a trigram and
+    // the index cannot narrow the search.
+    bool candidates(const std::string& lower_query, std::vector<int>& out) const;
+};
+
+#endif // TRIGRAM_INDEX_H
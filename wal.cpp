@@ -0,0 +1,250 @@
+#include "wal.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include "metrics.h"
+
+#ifdef _WIN32
+    #include <io.h>
+#else
+    #include <unistd.h>
+#endif
+
+static bool flush_to_disk(FILE* file) {
+    MetricTimer timer(Metric::Fsync);
+    if (std::fflush(file) != 0) {
+        return false;
+    }
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+WriteAheadLog::WriteAheadLog(const std::string& path)
+    : path(path), file(nullptr), bytes(0), broken(false), base_seq(0), records(0), unsynced(0), sync_every(64),
+      sync_interval(50), last_sync(std::chrono::steady_clock::now()) {}
+
+WriteAheadLog::~WriteAheadLog() {
+    close();
+}
+
+bool WriteAheadLog::replay(uint64_t snapshot_seq, const std::function<void(const std::string&)>& apply) {
+    base_seq = snapshot_seq;
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        return true; // No log yet
+    }
+
+    std::string line;
+    std::uintmax_t valid_bytes = 0;
+    records = 0;
+    if (in.peek() == 'S' && std::getline(in, line) && !in.eof()) {
+        base_seq = std::strtoull(line.c_str() + 2, nullptr, 10);
+        valid_bytes = line.size() + 1;
+        if (base_seq > snapshot_seq) {
+            std::cerr << "Write-ahead log " << path << " follows change " << base_seq
+                      << " but the snapshot only reaches change " << snapshot_seq << std::endl;
+            return false;
+        }
+    }
+    // Only records numbered past the snapshot are applied.
+    uint64_t seq = base_seq;
+    auto apply_after_snapshot = [&](const std::string& record) {
+        if (++seq > snapshot_seq) apply(record);
+    };
+    // Records of a batch are held back until the whole batch has been read,
+    // and valid_bytes only moves past a batch once it is complete.
+    std::vector<std::string> batch;
+    size_t batch_count = 0;
+    std::uintmax_t batch_bytes = 0;
+    while (std::getline(in, line)) {
+        if (in.eof()) break; // Last line has no newline: torn append
+        if (batch_count > 0) {
+            batch_bytes += line.size() + 1;
+            batch.push_back(line);
+            if (batch.size() == batch_count) {
+                for (const auto& record : batch) {
+                    apply_after_snapshot(record);
+                }
+                records += batch_count;
+                valid_bytes += batch_bytes;
+                batch.clear();
+                batch_count = 0;
+            }
+            continue;
+        }
+        if (line.compare(0, 2, "T|") == 0) {
+            batch_count = std::strtoul(line.c_str() + 2, nullptr, 10);
+            batch_bytes = line.size() + 1;
+            if (batch_count == 0) valid_bytes += batch_bytes;
+            continue;
+        }
+        valid_bytes += line.size() + 1;
+        if (line.empty()) continue;
+        apply_after_snapshot(line);
+        records++;
+    }
+    in.close();
+
+    std::error_code ec;
+    if (std::filesystem::file_size(path, ec) > valid_bytes && !ec) {
+        std::filesystem::resize_file(path, valid_bytes, ec);
+        if (ec) {
+            std::cerr << "Cannot truncate torn write-ahead log: " << ec.message() << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool WriteAheadLog::open() {
+    if (file) return true;
+    file = std::fopen(path.c_str(), "ab");
+    if (!file) {
+        std::cerr << "Cannot open write-ahead log " << path << std::endl;
+        return false;
+    }
+    std::error_code ec;
+    bytes = std::filesystem::file_size(path, ec);
+    if (ec) bytes = 0;
+    return bytes > 0 || write_header();
+}
+
+// Writes the S line into the empty log and syncs it, so records appended
+// after it are numbered from base_seq.
+bool WriteAheadLog::write_header() {
+    std::string line = "S|" + std::to_string(base_seq) + "\n";
+    if (std::fwrite(line.data(), 1, line.size(), file) != line.size() || !flush_to_disk(file)) {
+        std::cerr << "Cannot start write-ahead log " << path << std::endl;
+        return false;
+    }
+    bytes = line.size();
+    metrics_add_bytes(line.size());
+    return true;
+}
+
+void WriteAheadLog::close() {
+    if (!file) return;
+    sync();
+    std::fclose(file);
+    file = nullptr;
+}
+
+// Writes first then second, holding count records, and flushes them to the
+// OS right away so a process crash never loses an acknowledged record;
+// only the fsync is deferred.
+bool WriteAheadLog::write(std::string_view first, std::string_view second, size_t count) {
+    if (broken) {
+        std::cerr << "Write-ahead log " << path << " is damaged; save the database to start a new one" << std::endl;
+        return false;
+    }
+    if (!file && !open()) {
+        return false;
+    }
+    if (std::fwrite(first.data(), 1, first.size(), file) != first.size() ||
+        std::fwrite(second.data(), 1, second.size(), file) != second.size() || std::fflush(file) != 0) {
+        std::cerr << "Cannot append to write-ahead log" << std::endl;
+        cut_back(bytes, 0);
+        return false;
+    }
+    bytes += first.size() + second.size();
+    records += count;
+    unsynced += count;
+    metrics_add_bytes(first.size() + second.size());
+    return true;
+}
+
+// Takes the last count records back out by truncating the file to size.
+// The stream is closed first, so nothing it still buffers lands after the
+// cut, and reopened by the next append.
+bool WriteAheadLog::cut_back(uint64_t size, size_t count) {
+    records -= count;
+    unsynced -= std::min(unsynced, count);
+    std::fclose(file);
+    file = nullptr;
+    std::error_code ec;
+    std::filesystem::resize_file(path, size, ec);
+    if (ec) {
+        std::cerr << "Cannot cut failed append out of write-ahead log: " << ec.message() << std::endl;
+        broken = true;
+        return false;
+    }
+    bytes = size;
+    return true;
+}
+
+bool WriteAheadLog::append(const std::string& record) {
+    uint64_t start = bytes;
+    if (!write(record, "\n", 1)) {
+        return false;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if ((unsynced >= sync_every || now - last_sync >= sync_interval) && !sync()) {
+        cut_back(start, 1);
+        return false;
+    }
+    return true;
+}
+
+bool WriteAheadLog::append_batch(const std::string& batch, size_t count) {
+    uint64_t start = bytes;
+    if (!write("T|" + std::to_string(count) + "\n", batch, count)) {
+        return false;
+    }
+    if (!sync()) {
+        cut_back(start, count);
+        return false;
+    }
+    return true;
+}
+
+bool WriteAheadLog::append_raw(const std::string& lines, size_t count) {
+    uint64_t start = bytes;
+    if (!write(lines, std::string_view(), count)) {
+        return false;
+    }
+    if (!sync()) {
+        cut_back(start, count);
+        return false;
+    }
+    return true;
+}
+
+bool WriteAheadLog::sync() {
+    if (!file || unsynced == 0) return true;
+    if (!flush_to_disk(file)) {
+        std::cerr << "Cannot sync write-ahead log" << std::endl;
+        return false;
+    }
+    unsynced = 0;
+    last_sync = std::chrono::steady_clock::now();
+    return true;
+}
+
+bool WriteAheadLog::reset(uint64_t seq) {
+    if (file) {
+        std::fclose(file);
+    }
+    file = std::fopen(path.c_str(), "wb");
+    bytes = 0;
+    records = 0;
+    unsynced = 0;
+    base_seq = seq;
+    broken = !file || !write_header();
+    if (broken) {
+        std::cerr << "Cannot reset write-ahead log " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void WriteAheadLog::set_group_commit(size_t every, std::chrono::milliseconds interval) {
+    sync_every = every > 0 ? every : 1;
+    sync_interval = interval;
+}
@@ -0,0 +1,94 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <string_view>
+
+// Append-only log of student mutations, kept next to the snapshot file.
+// Each record is one line in the same '|'-separated layout as students.db,
+// prefixed with an op code:
+//
+//   A|id|name|reg_no|age|major    add
+//   U|id|name|reg_no|age|major    update
+//   D|id                          delete
+//   T|count                       the next count records are one batch
+//   S|seq                         first line: the log follows change seq
+//
+// Records are numbered on from the S line. A snapshot written just
+// before a crash, ahead of the reset() that would have emptied the log,
+// already holds some of them; replay skips those rather than applying
+// them twice. A log with no S line, from an older version, follows the
+// snapshot it is replayed onto.
+//
+// A batch is all or nothing: replay applies its records only if every one
+// of them made it to disk, and otherwise cuts the log back to the T line.
+//
+// An append that fails, in its write or in the fsync it runs, is cut back
+// out of the file, so the log never keeps part of a batch or a record its
+// caller was told did not make it. If even that fails the log refuses
+// appends until the next reset().
+//
+// Records reach the OS as soon as they are appended; fsync is batched
+// (group commit) so many small mutations share one flush. append() only
+// syncs when the next flush is due at the time it runs, so its owner calls
+// sync() once sync_due() has passed to keep a burst that has ended from
+// staying unsynced until the next append.
+class WriteAheadLog {
+private:
+    std::string path;
+    FILE* file;
+    uint64_t bytes;   // file size after the last complete append
+    bool broken;      // a failed append could not be cut back out, or a reset failed
+    uint64_t base_seq; // the change the log follows, as in its S line
+    size_t records;   // complete records in the log since the last reset
+    size_t unsynced;  // records written but not yet fsynced
+    size_t sync_every;
+    std::chrono::milliseconds sync_interval;
+    std::chrono::steady_clock::time_point last_sync;
+
+    bool write(std::string_view first, std::string_view second, size_t count);
+    bool write_header();
+    bool cut_back(uint64_t size, size_t count);
+
+public:
+    WriteAheadLog(const std::string& path);
+    ~WriteAheadLog();
+
+    // Feeds every complete record after change snapshot_seq to apply, then
+    // cuts off a torn tail left by a crash mid-append so later appends
+    // start on a clean line. Fails if the log starts after snapshot_seq,
+    // since the changes in between are lost.
+    bool replay(uint64_t snapshot_seq, const std::function<void(const std::string&)>& apply);
+
+    // Writes the S line first if the log is empty.
+    bool open();
+    void close();
+    bool append(const std::string& record);
+    // Writes count newline-terminated records as one batch, with one write
+    // and one fsync.
+    bool append_batch(const std::string& batch, size_t count);
+    // Writes lines already in log form, holding count records plus any T
+    // lines framing them, with one write and one fsync. Like
+    // append_batch(), a failure leaves none of them in the log.
+    bool append_raw(const std::string& lines, size_t count);
+    bool sync();
+    // Empties the log and starts it over after change seq, the last one in
+    // the snapshot just written. On failure the log refuses appends until
+    // a reset succeeds, since they would be numbered as if they came
+    // before the snapshot.
+    bool reset(uint64_t seq);
+
+    size_t size() const { return records; }
+    // Records appended but not yet synced, and when they are due.
+    size_t pending() const { return unsynced; }
+    std::chrono::steady_clock::time_point sync_due() const { return last_sync + sync_interval; }
+
+    // fsync after this many records, or once this long has passed since the
+    // previous flush, whichever comes first.
+    void set_group_commit(size_t every, std::chrono::milliseconds interval);
+};
+
+#endif // WAL_H